@@ -1,219 +1,106 @@
 #include "ED_OTA.h"
+#include "ED_OTA_bench.h"
+#include "ED_OTA_esp.h"
+#include "ED_OTA_session.h"
 #include "ED_sys.h"
 #include "ED_sysInfo.h"
-#include "esp_crt_bundle.h"
 #include <cctype>
 #include <cstring>
 #include <driver/gpio.h>
-#include <esp_http_client.h>
+#include <esp_attr.h>
+#include <esp_chip_info.h>
+#include <esp_heap_caps.h>
 #include <esp_log.h>
 #include <esp_ota_ops.h>
 #include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
 #include <freertos/semphr.h>
-#include <regex.h>
+#include <mbedtls/base64.h>
 #include <string>
+#include <strings.h>
+#include <time.h>
 
 namespace ED_OTA {
 
-static SemaphoreHandle_t ota_mutex = NULL;
-static const char *TAG = "ED_OTA";
-static OTAmanager *g_otaManager = nullptr;   // for static trampolines
-
-static std::string regex_escape(const std::string &s) {
-    static const char *meta = ".^$*+?()[{\\|";
-    std::string escaped;
-    for (char c : s) {
-        if (strchr(meta, c))
-            escaped.push_back('\\');
-        escaped.push_back(c);
-    }
-    return escaped;
-}
-
-bool scanFirmware(FirmwareScanner &scanner, const std::string &url) {
-    esp_http_client_config_t config = {
-        .url = url.c_str(),
-        .transport_type = HTTP_TRANSPORT_OVER_SSL,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_err_t err = esp_http_client_open(client, 0);
-    if (err != ESP_OK) {
-        esp_http_client_cleanup(client);
-        ESP_LOGE(TAG, "failed to open client to %s error: %s", config.url,
-                 esp_err_to_name(err));
-        return false;
-    }
-
-    int content_length = esp_http_client_fetch_headers(client);
-    if (content_length < 0) {
-        ESP_LOGE(TAG, "Failed to fetch headers, error: %d", content_length);
-        esp_http_client_cleanup(client);
-        return false;
-    }
-
-    uint8_t c_buffer[COMPRESSED_BLOCK_SIZE];
-    int bytes_read;
-    do {
-        bytes_read =
-            esp_http_client_read(client, (char *)c_buffer, sizeof(c_buffer));
-        if (bytes_read > 0) {
-            c_buffer[bytes_read] = '\0';
-            scanner.file_scanner_parse_chunk((char *)c_buffer, bytes_read);
-        } else if (bytes_read < 0) {
-            ESP_LOGE(TAG, "HTTP read error: %d", bytes_read);
-            esp_http_client_cleanup(client);
-            return false;
-        }
-    } while (bytes_read > 0);
-
-    esp_http_client_cleanup(client);
-    return scanner.targetFwFile() != nullptr;
-}
-
-// ---------- FirmwareScanner ----------
-
-void FirmwareScanner::parse_version_string(const char *ver_str, int out[4]) {
-    out[0] = out[1] = out[2] = out[3] = 0;
-    regex_t re;
-    if (regcomp(&re,
-                "v([[:digit:]]+)\\.([[:digit:]]+)\\.([[:digit:]]+)-([[:digit:]]+)",
-                REG_EXTENDED) == 0) {
-        regmatch_t matches[5];
-        if (regexec(&re, ver_str, 5, matches, 0) == 0) {
-            for (int i = 0; i < 4; i++) {
-                int start = matches[i + 1].rm_so;
-                int end = matches[i + 1].rm_eo;
-                if (start != -1 && end != -1) {
-                    char temp[16];
-                    int len = end - start;
-                    strncpy(temp, ver_str + start, len);
-                    temp[len] = '\0';
-                    out[i] = atoi(temp);
-                }
-            }
-        }
-        regfree(&re);
-    }
-}
-
-bool FirmwareScanner::matches_prefix(const int cand[4]) {
-    for (int i = 0; i < 4; i++) {
-        if (prefix_locked[i] && cand[i] != best_version[i])
-            return false;
-    }
-    return true;
-}
-
-bool FirmwareScanner::is_version_higher(int new_v[4]) {
-    for (int i = 0; i < 4; i++) {
-        if (new_v[i] > best_version[i])
-            return true;
-        if (new_v[i] < best_version[i])
-            return false;
-    }
-    return false;
-}
-
-FirmwareScanner::FirmwareScanner(const char *FwarePrj, const char *curFwareVer,
-                                 UpdateType mode)
-    : prjID(FwarePrj), updateMode(mode), matchingVersionFound(false) {
-    best_version[0] = best_version[1] = best_version[2] = best_version[3] = 0;
-    for (int i = 0; i < 4; i++)
-        prefix_locked[i] = false;
-
-    parse_version_string(curFwareVer, best_version);
-
-    if (mode == UPDATE_TO_SPECIFIC) {
-        regex_t re;
-        regmatch_t m[5];
-        if (regcomp(&re,
-                    "v([[:digit:]]+)(?:\\.([[:digit:]]+))?(?:\\.([[:digit:]]+))?(?:-([[:digit:]]+))?",
-                    REG_EXTENDED) == 0) {
-            if (regexec(&re, curFwareVer, 5, m, 0) == 0) {
-                for (int i = 0; i < 4; i++) {
-                    if (m[i + 1].rm_so != -1)
-                        prefix_locked[i] = true;
-                }
-            }
-            regfree(&re);
-        }
-    }
-
-    char pattern[256];
-    std::string escaped_prj = regex_escape(prjID);
-    snprintf(pattern, sizeof(pattern),
-             "href=\\\"(%s_v([[:digit:]]+)\\.([[:digit:]]+)\\.([[:digit:]]+)[^\\\"]*\\.bin(?:\\.[a-z0-9]+)?)\\\"",
-             escaped_prj.c_str());
-    int ret = regcomp(&regex, pattern, REG_EXTENDED);
-    if (ret != 0) {
-        ESP_LOGE(TAG, "Regex compilation failed: %d", ret);
-    }
-}
-
-FirmwareScanner::~FirmwareScanner() { regfree(&regex); }
-
-void FirmwareScanner::file_scanner_parse_chunk(const char *chunk,
-                                               size_t chunk_len) {
-    size_t carry_len = strlen(carryover);
-    memcpy(buffer, carryover, carry_len);
-    memcpy(buffer + carry_len, chunk, chunk_len);
-    buffer[carry_len + chunk_len] = '\0';
-
-    regmatch_t matches[6];
-    char *ptr = buffer;
-    while (regexec(&regex, ptr, 6, matches, 0) == 0) {
-        int len = matches[1].rm_eo - matches[1].rm_so;
-        char filename[MAX_FILENAME_LEN];
-        strncpy(filename, ptr + matches[1].rm_so, len);
-        filename[len] = '\0';
-
-        int version[4] = {0, 0, 0, 0};
-        for (int i = 0; i < 3; i++) {
-            int start = matches[i + 2].rm_so;
-            int end = matches[i + 2].rm_eo;
-            if (start != -1 && end != -1) {
-                char temp[16];
-                int vlen = end - start;
-                strncpy(temp, ptr + start, vlen);
-                temp[vlen] = '\0';
-                version[i] = atoi(temp);
-            }
-        }
-        version[3] = 0;
-
-        ESP_LOGV(TAG, "Candidate: %s → %d.%d.%d", filename, version[0], version[1],
-                 version[2]);
-
-        bool accept = false;
-        if (updateMode == UPDATE_TO_SPECIFIC) {
-            if (matches_prefix(version))
-                accept = is_version_higher(version);
-        } else {
-            accept = is_version_higher(version);
-        }
-
-        if (accept) {
-            snprintf(best_filename, MAX_FILENAME_LEN, "%s", filename);
-            memcpy(best_version, version, sizeof(version));
-            matchingVersionFound = true;
-        }
+/// @brief heap use of a session, sampled between steps from the heap-caps
+/// statistics; allocations made and freed within one step are not seen.
+struct Footprint {
+    size_t heapFreeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t heapFreeLow = heapFreeBefore;
 
-        ptr += matches[0].rm_eo;
+    void sample() {
+        size_t free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        if (free < heapFreeLow)
+            heapFreeLow = free;
     }
-
-    size_t total_len = carry_len + chunk_len;
-    if (total_len >= CARRYOVER_SIZE) {
-        memcpy(carryover, buffer + total_len - CARRYOVER_SIZE, CARRYOVER_SIZE);
-        carryover[CARRYOVER_SIZE] = '\0';
-    } else {
-        strcpy(carryover, buffer);
+};
+
+/// @brief a session with the ESP-IDF source and sink it runs on. With
+/// request.trace the source is recorded into the trace partition, with
+/// request.dryRun the image only goes through a DigestSink.
+struct EspSession {
+    Footprint footprint;   // first: measures from before the session exists
+    EspHttpSource source;
+    EspPartitionTraceOutput traceOutput;
+    TraceRecorder recorder;
+    EspOtaSink sink;
+    DigestSink digestSink;
+    OtaSession session;
+
+    EspSession(const OtaRequest &request, const char *storageUrl, const char *fallbackUrl)
+        : recorder(source, traceOutput),
+          session(request, storageUrl, fallbackUrl,
+                  {request.trace ? (HttpSource *)&recorder : &source,
+                   request.dryRun ? (OtaSink *)&digestSink : &sink,
+                   ED_SYS::ESP_std::Firmware::prjName(),
+                   ED_SYS::ESP_std::Firmware::version()}) {
+        session.setAppCheck(espAppCheck());
+        sink.setStageOnly(request.stage);
     }
-}
+};
+
+static SemaphoreHandle_t ota_mutex = NULL;    // guards the worker state below
+static QueueHandle_t ota_queue = NULL;          // single-slot request mailbox
+static EventGroupHandle_t ota_ctrl = NULL;      // cancel / pause flags
+static TaskHandle_t ota_worker = NULL;         // NULL in APP_POLL mode
+static EspSession *polled_update = nullptr;    // APP_POLL mode only
+static OtaRequest active_request = {};
+static bool session_active = false;
+// metrics of the last session, kept across the post-update reboot
+static RTC_NOINIT_ATTR OtaMetrics last_metrics;
+static RTC_NOINIT_ATTR uint32_t last_metrics_magic;
+#define OTA_METRICS_MAGIC 0x4F544D39
+// verdict of the last health check, kept across the rollback reboot
+struct HealthReport {
+    bool valid;
+    uint8_t probes;
+    uint8_t passed;
+    uint32_t afterMs;   // from boot to the verdict
+    char failed[24];
+};
+static RTC_NOINIT_ATTR HealthReport last_health;
+static RTC_NOINIT_ATTR uint32_t last_health_magic;
+#define OTA_HEALTH_MAGIC 0x4F544831
+static OtaHealth health;
+static bool health_active = false;   // PENDING_VERIFY at start, no verdict yet; ota_mutex
+static int64_t health_next_us = 0;
+// image staged by "FWUP … stage", booted by FWAC; guarded by ota_mutex
+static const esp_partition_t *staged_partition = nullptr;
+static char staged_file[64];
+static bool activation_armed = false;
+static int64_t activation_at_us = 0;
+static OTAmanager::SafePoint safe_point = nullptr;
+static void *safe_point_arg = nullptr;
+
+static OtaRelease announced_release = {};   // url "" = none
+#define OTA_CLOCK_VALID 1700000000   // time() before this: SNTP has not set the clock
+static const char *TAG = "ED_OTA";
+static OTAmanager *g_otaManager = nullptr;   // for static trampolines
 
-const char *FirmwareScanner::targetFwFile() {
-    return matchingVersionFound ? best_filename : nullptr;
-}
+#define OTA_EVT_CANCEL (1 << 0)
+#define OTA_EVT_PAUSE (1 << 1)
 
 // ---------- OTAmanager ----------
 
@@ -227,17 +114,122 @@ static void trampoline_FWCO(ED_MQTT_dispatcher::ctrlCommand *cmd) {
 static void trampoline_FWQS(ED_MQTT_dispatcher::ctrlCommand *cmd) {
     if (g_otaManager) g_otaManager->cmd_getFwStatus(cmd);
 }
+static void trampoline_FWCA(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    if (g_otaManager) g_otaManager->cmd_cancelUpdate(cmd);
+}
+static void trampoline_FWPA(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    if (g_otaManager) g_otaManager->cmd_pauseUpdate(cmd);
+}
+static void trampoline_FWRE(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    if (g_otaManager) g_otaManager->cmd_resumeUpdate(cmd);
+}
+static void trampoline_FWTR(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    if (g_otaManager) g_otaManager->cmd_getTrace(cmd);
+}
+static void trampoline_FWBM(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    if (g_otaManager) g_otaManager->cmd_benchmark(cmd);
+}
+static void trampoline_FWRB(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    if (g_otaManager) g_otaManager->cmd_rollback(cmd);
+}
+static void trampoline_FWAC(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    if (g_otaManager) g_otaManager->cmd_activate(cmd);
+}
+static void trampoline_FWRA(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    if (g_otaManager) g_otaManager->cmd_announceRelease(cmd);
+}
+
+/// @brief acks a command by message id, also after the command returned.
+static void ackMessage(long long msgId, const std::string &cmdID, bool ok,
+                       const char *message) {
+    ED_MQTT_dispatcher::MQTTdispatcher::ackCommand(
+        msgId, cmdID,
+        ok ? ED_MQTT_dispatcher::MQTTdispatcher::ackType::OK
+           : ED_MQTT_dispatcher::MQTTdispatcher::ackType::FAIL,
+        message);
+}
+
+static void ackResult(ED_MQTT_dispatcher::ctrlCommand *cmd, bool ok,
+                      const char *message) {
+    const char *msgid_str = cmd->getParam("_msgID");
+    if (msgid_str)
+        ackMessage(std::stoll(msgid_str), cmd->cmdID, ok, message);
+}
+
+/// @brief true when the optional command parameter is set to 1/true/on.
+static bool paramFlag(ED_MQTT_dispatcher::ctrlCommand *cmd, const char *name) {
+    const char *value = cmd->getParam(name);
+    return value && (strcmp(value, "1") == 0 || strcasecmp(value, "true") == 0 ||
+                     strcasecmp(value, "on") == 0);
+}
+
+/// @brief optional numeric command parameter, clamped to maxValue.
+static uint32_t paramUInt(ED_MQTT_dispatcher::ctrlCommand *cmd, const char *name,
+                          uint32_t maxValue) {
+    const char *value = cmd->getParam(name);
+    if (value == nullptr || *value == '\0')
+        return 0;
+    unsigned long v = strtoul(value, nullptr, 10);
+    return v > maxValue ? maxValue : (uint32_t)v;
+}
+
+/// @brief stackSize 0: the driving task is the application's, its size is
+/// not known here.
+static void recordMetrics(const OtaMetrics &metrics, const Footprint &footprint,
+                          uint32_t stackSize) {
+    OtaMetrics record = metrics;
+    record.stackSize = stackSize;
+    record.stackFreeMin = uxTaskGetStackHighWaterMark(NULL);   // bytes on ESP-IDF
+    record.heapPeakBytes = footprint.heapFreeBefore - footprint.heapFreeLow;
+    record.heapFreeMin = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    record.heapLargestFree = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    if (last_metrics_magic == OTA_METRICS_MAGIC) {
+        record.prevThroughputBps = last_metrics.throughputBps;
+        record.prevTurbo = last_metrics.turbo;
+    }
+    last_metrics = record;
+    last_metrics_magic = OTA_METRICS_MAGIC;
+}
 
-OTAmanager::OTAmanager() {
+OTAmanager::OTAmanager(ExecMode mode) {
     if (ota_mutex == NULL) {
         ota_mutex = xSemaphoreCreateMutex();
     }
+    if (ota_queue == NULL) {
+        ota_queue = xQueueCreate(1, sizeof(OtaRequest));
+    }
+    if (ota_ctrl == NULL) {
+        ota_ctrl = xEventGroupCreate();
+    }
+    // before the worker starts, which polls the probes only while this is set
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t ota_state;
+    if (ota_mutex && esp_ota_get_state_partition(running, &ota_state) == ESP_OK &&
+        ota_state == ESP_OTA_IMG_PENDING_VERIFY) {
+        xSemaphoreTake(ota_mutex, portMAX_DELAY);
+        bool started = !health_active;
+        health_active = true;
+        xSemaphoreGive(ota_mutex);
+        if (started)
+            ESP_LOGI(TAG, "Image PENDING_VERIFY: health check started");
+    }
+    if (mode == WORKER_TASK && ota_worker == NULL && ota_mutex && ota_queue &&
+        ota_ctrl) {
+        if (xTaskCreatePinnedToCore(&ED_OTA::OTAmanager::ota_worker_task, "ota_task",
+                                    OTA_WORKER_STACK_SIZE, NULL, OTA_WORKER_PRIORITY,
+                                    &ota_worker, OTA_WORKER_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create OTA worker task");
+            ota_worker = NULL;
+        }
+    }
     g_otaManager = this;   // set singleton pointer
 
     // Register MQTT commands – use static trampolines (no lambda capture)
     ED_MQTT_dispatcher::ctrlCommand cmd(
         "FWUP", "Update firmware via OTA",
-        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL, {{"default", ""}});
+        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL,
+        {{"default", ""}, {"turbo", ""}, {"bw", ""}, {"cpu", ""}, {"load", ""},
+         {"slice", ""}, {"trace", ""}, {"dryrun", ""}, {"stage", ""}});
     cmd.funcPointer = trampoline_FWUP;
     registerCommand(cmd);
 
@@ -252,251 +244,462 @@ OTAmanager::OTAmanager() {
         ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL, {});
     cmd2.funcPointer = trampoline_FWQS;
     registerCommand(cmd2);
+
+    ED_MQTT_dispatcher::ctrlCommand cmd3(
+        "FWCA", "Cancel running or pending OTA",
+        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL, {});
+    cmd3.funcPointer = trampoline_FWCA;
+    registerCommand(cmd3);
+
+    ED_MQTT_dispatcher::ctrlCommand cmd4(
+        "FWPA", "Pause running OTA",
+        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL, {});
+    cmd4.funcPointer = trampoline_FWPA;
+    registerCommand(cmd4);
+
+    ED_MQTT_dispatcher::ctrlCommand cmd5(
+        "FWRE", "Resume paused OTA",
+        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL, {});
+    cmd5.funcPointer = trampoline_FWRE;
+    registerCommand(cmd5);
+
+    ED_MQTT_dispatcher::ctrlCommand cmd6(
+        "FWTR", "Read recorded OTA transfer trace",
+        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL, {{"default", ""}});
+    cmd6.funcPointer = trampoline_FWTR;
+    registerCommand(cmd6);
+
+    ED_MQTT_dispatcher::ctrlCommand cmd7(
+        "FWBM", "Benchmark download, decode and flash speed",
+        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL, {{"default", ""}});
+    cmd7.funcPointer = trampoline_FWBM;
+    registerCommand(cmd7);
+
+    ED_MQTT_dispatcher::ctrlCommand cmd8(
+        "FWRB", "Roll back to the firmware in the other OTA slot",
+        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL, {{"default", ""}});
+    cmd8.funcPointer = trampoline_FWRB;
+    registerCommand(cmd8);
+
+    ED_MQTT_dispatcher::ctrlCommand cmd9(
+        "FWAC", "Activate the staged firmware (reboot)",
+        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL, {{"default", ""}});
+    cmd9.funcPointer = trampoline_FWAC;
+    registerCommand(cmd9);
+
+    ED_MQTT_dispatcher::ctrlCommand cmd10(
+        "FWRA", "Release announcement (retained on fware/<project>/release)",
+        ED_MQTT_dispatcher::ctrlCommand::cmdScope::GLOBAL,
+        {{"default", ""}, {"version", ""}, {"size", ""}, {"sha256", ""}, {"codec", ""},
+         {"stage", ""}});
+    cmd10.funcPointer = trampoline_FWRA;
+    registerCommand(cmd10);
 }
 
-void OTAmanager::ota_update_task(void *pvParameter) {
-    if (ota_mutex == NULL || xSemaphoreTake(ota_mutex, portMAX_DELAY) != pdTRUE) {
-        ESP_LOGE(TAG, "Failed to take OTA mutex");
-        if (pvParameter)
-            free(pvParameter);
-        vTaskDelete(NULL);
-        return;
+/// @brief moves the pending request, if any, to the active slot. The request
+/// leaves the mailbox only under the mutex, so a concurrent cancel either
+/// drops it or sees the session as active.
+static bool takeRequest(OtaRequest &request) {
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    bool taken = xQueueReceive(ota_queue, &request, 0) == pdTRUE;
+    if (taken) {
+        active_request = request;
+        session_active = true;
+        if (!request.benchmark && !request.dryRun) {   // the update rewrites the staged slot
+            staged_partition = nullptr;
+            activation_armed = false;
+        }
+        xEventGroupClearBits(ota_ctrl, OTA_EVT_CANCEL | OTA_EVT_PAUSE);
     }
+    xSemaphoreGive(ota_mutex);
+    return taken;
+}
 
-    // All variables with non‑trivial constructors declared at top (no goto crossing)
-    const char *verRef = static_cast<const char *>(pvParameter);
-    uint8_t *c_buffer = (uint8_t *)malloc(COMPRESSED_BLOCK_SIZE);
-    uint8_t *d_buffer = (uint8_t *)malloc(DECOMPRESSED_BLOCK_SIZE);
-    esp_http_client_config_t config = {};
-    esp_http_client_handle_t client = nullptr;
-    esp_ota_handle_t ota_handle = 0;
-    LZ4_streamDecode_t *lz4_stream = nullptr;
-    std::string fullUrl;   // non‑trivial, but declared before any goto
-    esp_err_t err = ESP_OK;
-    bool ota_data_written = false;
-    int status = 0;
-    const char *version = "";
-    const char *httpPath = "";
-    const esp_partition_t *update_partition = nullptr;
-    FirmwareScanner *fwScanner = nullptr;
-    size_t total_compressed_read = 0;
-
-    const int LZ4_DICT_SIZE = 16 * 1024;
-    uint8_t *dict_buffer =
-        (uint8_t *)heap_caps_malloc(LZ4_DICT_SIZE, MALLOC_CAP_8BIT);
-    int dict_size = 0;
-
-    bool error = false;
-
-    do {   // single‑iteration loop to allow `break` instead of `goto`
-        if (!c_buffer || !d_buffer || !dict_buffer) {
-            ESP_LOGE(TAG, "Memory allocation failed");
-            error = true;
-            break;
-        }
+static void endRequest(bool ok) {
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    bool benchmark = active_request.benchmark;
+    bool dryRun = active_request.dryRun;
+    bool stage = active_request.stage;
+    session_active = false;
+    xEventGroupClearBits(ota_ctrl, OTA_EVT_CANCEL | OTA_EVT_PAUSE);
+    xSemaphoreGive(ota_mutex);
+    ESP_LOGI(TAG, "OTA: %s %s, waiting for next request",
+             benchmark ? "benchmark" : dryRun ? "dry run" : stage ? "staging" : "update",
+             ok ? "completed" : benchmark ? "incomplete" : dryRun ? "failed" : "not applied");
+}
 
-        version = (verRef == nullptr) ? ED_SYS::ESP_std::Firmware::version() : verRef;
-
-        fwScanner = new FirmwareScanner(ED_SYS::ESP_std::Firmware::prjName(), version,
-                                        (verRef == nullptr) ? FirmwareScanner::UPDATE_TO_LATEST
-                                                            : FirmwareScanner::UPDATE_TO_SPECIFIC);
-
-        httpPath = fwStorageUrl;
-        if (!scanFirmware(*fwScanner, fwStorageUrl)) {
-            ESP_LOGW(TAG, "Primary scan failed, trying fallback...");
-            delete fwScanner;
-            fwScanner = new FirmwareScanner(
-                ED_SYS::ESP_std::Firmware::prjName(), version,
-                (verRef == nullptr) ? FirmwareScanner::UPDATE_TO_LATEST
-                                    : FirmwareScanner::UPDATE_TO_SPECIFIC);
-            httpPath = fwObsUrl;
-            if (!scanFirmware(*fwScanner, fwObsUrl)) {
-                ESP_LOGE(TAG, "Fallback scan also failed");
-                error = true;
-                break;
-            }
-        }
+/// @brief result of a dry run: what was fetched, the digest of the decoded
+/// image and whether the image header confirmed it, and the rates, acked to
+/// the reply id of the active request (a merged dry run may have set it).
+static void reportDryRun(EspSession &update) {
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    int64_t replyId = active_request.replyId;
+    xSemaphoreGive(ota_mutex);
+    const OtaSession &session = update.session;
+    const OtaMetrics &m = session.metrics();
+    bool ok = session.state() == OtaSession::DONE;
+    char reply[320];
+    if (ok) {
+        char digest[2 * OTA_DIGEST_SIZE + 1];
+        for (int i = 0; i < OTA_DIGEST_SIZE; i++)
+            snprintf(digest + 2 * i, 3, "%02x", update.digestSink.digest()[i]);
+        snprintf(reply, sizeof(reply),
+                 "OTA dry run: %s, %u -> %u bytes in %u ms, %u B/s (fetch %u, decode %u B/s), "
+                 "sha256 %s%s",
+                 session.targetFile(), (unsigned)m.compressedBytes, (unsigned)m.writtenBytes,
+                 (unsigned)((m.endUs - m.startUs) / 1000), (unsigned)m.throughputBps,
+                 (unsigned)m.fetchBps, (unsigned)m.decodeBps, digest,
+                 session.imageHeader() ? " verified" : " (no image header to verify)");
+    } else {
+        snprintf(reply, sizeof(reply), "OTA dry run %s: %s after %u bytes",
+                 session.state() == OtaSession::CANCELLED ? "cancelled" : "failed",
+                 session.targetFile() ? session.targetFile() : "no image",
+                 (unsigned)m.writtenBytes);
+    }
+    ESP_LOGI(TAG, "%s", reply);
+    if (replyId)
+        ackMessage(replyId, "FWUP", ok, reply);
+}
 
-        if (fwScanner->targetFwFile() == nullptr) {
-            ESP_LOGI(TAG, "No target firmware found");
-            error = true;
-            break;
-        }
+/// @brief answers a dry run merged into an identical one that already has a
+/// reply id: the single result is acked to resultId.
+static void ackMerged(const OtaRequest &request, int64_t resultId) {
+    char reply[96];
+    snprintf(reply, sizeof(reply), "OTA: merged with the same dry run, result to message %lld",
+             (long long)resultId);
+    ackMessage(request.replyId, "FWUP", true, reply);
+}
 
-        fullUrl = httpPath + std::string(fwScanner->targetFwFile());
-        ESP_LOGI(TAG, "OTA: launching update with file <%s>",
-                 fwScanner->targetFwFile());
-
-        config = {
-            .url = fullUrl.c_str(),
-            .transport_type = HTTP_TRANSPORT_OVER_SSL,
-            .crt_bundle_attach = esp_crt_bundle_attach,
-        };
-
-        client = esp_http_client_init(&config);
-        err = esp_http_client_open(client, 0);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Could not open HTTP connection: %s", esp_err_to_name(err));
-            error = true;
-            break;
-        }
+/// @brief FAIL-acks a request dropped before it ran (replaced or cancelled)
+/// to its reply id, so the sender of a benchmark or dry run is not left
+/// waiting for the result.
+static void ackDropped(const OtaRequest &request, const char *why) {
+    if (request.replyId)
+        ackMessage(request.replyId, request.benchmark ? "FWBM" : "FWUP", false, why);
+}
 
-        int content_length = esp_http_client_fetch_headers(client);
-        if (content_length < 0) {
-            ESP_LOGE(TAG, "Failed to fetch headers, error: %d", content_length);
-            error = true;
-            break;
-        }
+/// @brief keeps the image written by a stage request for FWAC.
+static void stageImage(EspSession &update) {
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    staged_partition = update.sink.partition();
+    snprintf(staged_file, sizeof(staged_file), "%s",
+             update.session.targetFile() ? update.session.targetFile() : "?");
+    xSemaphoreGive(ota_mutex);
+    ESP_LOGI(TAG, "OTA update staged: %s in %s, waiting for FWAC", staged_file,
+             staged_partition ? staged_partition->label : "?");
+}
 
-        status = esp_http_client_get_status_code(client);
-        ESP_LOGI(TAG, "HTTP status code: %d", status);
-        if (status != 200) {
-            ESP_LOGE(TAG, "Unexpected HTTP status — aborting");
-            error = true;
-            break;
+void OTAmanager::ota_worker_task(void *pvParameter) {
+    OtaRequest request;
+    while (true) {
+        // wait without consuming, see takeRequest(); health probes and the
+        // staged image's activation are checked meanwhile
+        xSemaphoreTake(ota_mutex, portMAX_DELAY);
+        bool watch = health_active || staged_partition;
+        xSemaphoreGive(ota_mutex);
+        TickType_t wait = watch ? pdMS_TO_TICKS(OTA_HEALTH_POLL_MS) : portMAX_DELAY;
+        if (xQueuePeek(ota_queue, &request, wait) != pdTRUE) {
+            ota_health_step();
+            ota_activation_step();
+            continue;
         }
+        if (!takeRequest(request))
+            continue;
 
-        update_partition = esp_ota_get_next_update_partition(NULL);
-        if ((err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &ota_handle)) !=
-            ESP_OK) {
-            ESP_LOGE(TAG, "Failed to begin OTA: %s", esp_err_to_name(err));
-            error = true;
-            break;
+        if (request.benchmark) {
+            ESP_LOGI(TAG, "OTA worker: starting benchmark");
+            endRequest(ota_benchmark_task(request));
+            continue;
         }
+        ESP_LOGI(TAG, "OTA worker: starting update to <%s>",
+                 request.target[0] ? request.target : "latest");
+        endRequest(ota_update_task(request));
+    }
+}
 
-        lz4_stream = LZ4_createStreamDecode();
-        if (!lz4_stream) {
-            ESP_LOGE(TAG, "Failed to create LZ4 stream decoder");
-            error = true;
-            break;
-        }
+/// @brief called between blocks: holds while paused, returns false once the
+/// session has been cancelled.
+bool OTAmanager::ota_checkpoint() {
+    EventBits_t bits = xEventGroupGetBits(ota_ctrl);
+    if ((bits & OTA_EVT_PAUSE) && !(bits & OTA_EVT_CANCEL))
+        ESP_LOGI(TAG, "OTA paused");
+    while ((bits & OTA_EVT_PAUSE) && !(bits & OTA_EVT_CANCEL)) {
+        esp_task_wdt_reset();
+        vTaskDelay(pdMS_TO_TICKS(100));
+        bits = xEventGroupGetBits(ota_ctrl);
+        if (!(bits & OTA_EVT_PAUSE))
+            ESP_LOGI(TAG, "OTA resumed");
+    }
+    return !(bits & OTA_EVT_CANCEL);
+}
 
-        ESP_LOGI(TAG, "Starting OTA read loop...");
-        size_t total_written = 0;
-
-        while (true) {
-            esp_task_wdt_reset();
-
-            uint32_t block_size = 0;
-            int bytes_read =
-                esp_http_client_read(client, (char *)&block_size, sizeof(block_size));
-            if (bytes_read == 0) {
-                ESP_LOGI(TAG, "End of OTA data stream");
-                break;
-            }
-            if (bytes_read != sizeof(block_size)) {
-                ESP_LOGE(TAG, "Failed to read block size (got %d)", bytes_read);
-                error = true;
-                break;
-            }
-
-            if (block_size > COMPRESSED_BLOCK_SIZE) {
-                ESP_LOGE(TAG, "Compressed block too large: %u bytes", block_size);
-                error = true;
-                break;
-            }
-
-            bytes_read = esp_http_client_read(client, (char *)c_buffer, block_size);
-            if (bytes_read < 0) {
-                ESP_LOGE(TAG, "HTTP read error: %d", bytes_read);
-                error = true;
-                break;
-            }
-            if ((size_t)bytes_read != block_size) {
-                ESP_LOGE(TAG, "Incomplete block read: expected %u, got %d", block_size,
-                         bytes_read);
-                error = true;
-                break;
-            }
-            total_compressed_read += bytes_read;
-
-            LZ4_setStreamDecode(lz4_stream, (const char *)dict_buffer, dict_size);
-            int decompressed_bytes = LZ4_decompress_safe_continue(
-                lz4_stream, (const char *)c_buffer, (char *)d_buffer, bytes_read,
-                DECOMPRESSED_BLOCK_SIZE);
-            if (decompressed_bytes < 0) {
-                ESP_LOGE(TAG, "LZ4 decompression failed with code %d",
-                         decompressed_bytes);
-                error = true;
-                break;
-            }
-
-            err = esp_ota_write(ota_handle, d_buffer, decompressed_bytes);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to write OTA chunk: %s", esp_err_to_name(err));
-                error = true;
-                break;
-            }
-
-            total_written += decompressed_bytes;
-            ota_data_written = true;
-
-            if (dict_size + decompressed_bytes <= LZ4_DICT_SIZE) {
-                memcpy(dict_buffer + dict_size, d_buffer, decompressed_bytes);
-                dict_size += decompressed_bytes;
-            } else {
-                int overflow = dict_size + decompressed_bytes - LZ4_DICT_SIZE;
-                memmove(dict_buffer, dict_buffer + overflow, dict_size - overflow);
-                memcpy(dict_buffer + (LZ4_DICT_SIZE - decompressed_bytes), d_buffer,
-                       decompressed_bytes);
-                dict_size = LZ4_DICT_SIZE;
-            }
-        } // end while
-
-        if (error) break;
-
-        if (!ota_data_written) {
-            ESP_LOGE(TAG, "No OTA data was written — aborting");
-            error = true;
-            break;
+/// @brief runs one update to completion on the calling task: a thin driver
+/// around OtaSession that honours pause/cancel between steps and reboots on
+/// success.
+bool OTAmanager::ota_update_task(const OtaRequest &request) {
+    EspSession update(request, fwStorageUrl, fwObsUrl);
+    OtaSession &session = update.session;
+    if (request.turbo)
+        session.setTurbo({true, true, true, OTA_TURBO_PRIORITY});
+    session.setLimits(OtaSession::limitsFor(request));
+    session.setStepBudget(request.stepBudgetUs);
+    // staging is not waited for: it yields to everything above the idle task
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+    bool background = request.stage && !request.turbo && priority > OTA_STAGE_PRIORITY;
+    if (background)
+        vTaskPrioritySet(NULL, OTA_STAGE_PRIORITY);
+    while (!session.finished()) {
+        esp_task_wdt_reset();
+        if (!ota_checkpoint())
+            session.cancel();
+        session.step();
+        update.footprint.sample();
+        if (uint32_t waitUs = session.waitHintUs()) {
+            TickType_t ticks = pdMS_TO_TICKS((waitUs + 999) / 1000);
+            vTaskDelay(ticks ? ticks : 1);
         }
+    }
+    if (background)
+        vTaskPrioritySet(NULL, priority);
+    update.recorder.end();   // before the reboot below
+    if (session.state() == OtaSession::CURRENT)
+        return true;   // already running: the last update's metrics stay
+    recordMetrics(session.metrics(), update.footprint, OTA_WORKER_STACK_SIZE);
+    if (request.dryRun) {
+        reportDryRun(update);
+        return session.state() == OtaSession::DONE;
+    }
+    if (session.state() != OtaSession::DONE)
+        return false;
+    if (request.stage) {
+        stageImage(update);
+        return true;
+    }
 
-        // content_length is the compressed size from HTTP header
-        if (content_length > 0 && total_compressed_read != (size_t)content_length) {
-            ESP_LOGE(TAG, "OTA size mismatch: expected %d compressed bytes, got %zu",
-                     content_length, total_compressed_read);
-            error = true;
-            break;
-        }
+    ESP_LOGI(TAG, "OTA update successful. Rebooting...");
+    esp_restart();
+    return true;
+}
 
-        if ((err = esp_ota_end(ota_handle)) != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to complete OTA: %s", esp_err_to_name(err));
-            error = true;
-            break;
-        }
+static bool benchCancelled() {
+    esp_task_wdt_reset();
+    return xEventGroupGetBits(ota_ctrl) & OTA_EVT_CANCEL;
+}
 
-        ESP_LOGI(TAG, "OTA update successful. Switching partition and rebooting...");
-        err = esp_ota_set_boot_partition(update_partition);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s",
-                     esp_err_to_name(err));
-            error = true;
-            break;
+/// @brief FWBM: measures what an update depends on (download from the
+/// firmware server, decode, flash) without touching the running or the
+/// rollback image, and acks the JSON result to request.replyId. Cancel is
+/// honoured between the phases.
+bool OTAmanager::ota_benchmark_task(const OtaRequest &request) {
+    const char *project = ED_SYS::ESP_std::Firmware::prjName();
+    esp_chip_info_t chip;
+    esp_chip_info(&chip);
+    char buf[320];
+    snprintf(buf, sizeof(buf),
+             "{\"project\": \"%s\", \"version\": \"%s\", \"chip\": {\"target\": \"%s\", "
+             "\"revision\": %u, \"cores\": %u, \"cpuMhz\": %u, \"psramBytes\": %u, "
+             "\"heapFree\": %u}",
+             project, ED_SYS::ESP_std::Firmware::version(), CONFIG_IDF_TARGET,
+             (unsigned)chip.revision, (unsigned)chip.cores, (unsigned)OtaTurbo::cpuMhz(),
+             (unsigned)heap_caps_get_total_size(MALLOC_CAP_SPIRAM),
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    std::string json = buf;
+
+    // the image FWUP to the latest version would download, storage then fallback
+    EspHttpSource source;
+    TransportBench transport = {};
+    std::string url;
+    bool fetched = (benchResolve(source, fwStorageUrl, project, url) ||
+                    benchResolve(source, fwObsUrl, project, url)) &&
+                   !benchCancelled() &&
+                   benchTransport(source, url.c_str(),
+                                  request.benchBytes ? request.benchBytes
+                                                     : OTA_BENCH_TRANSPORT_BYTES,
+                                  OTA_BENCH_TRANSPORT_US, transport);
+    json += ", \"url\": \"" + url + "\", \"transport\": " +
+            (fetched ? benchJson(transport) : std::string("null"));
+
+    DecodeBench decode = {};
+    bool decoded = !benchCancelled() && benchDecode(OTA_BENCH_DECODE_BYTES, decode);
+    json += ", \"decode\": " + (decoded ? benchJson(decode) : std::string("null"));
+
+    FlashBench flash = {};
+    bool flashed = !benchCancelled() && benchFlash(flash);
+    json += ", \"flash\": " + (flashed || flash.error ? benchJson(flash) : std::string("null"));
+    json += "}";
+
+    bool cancelled = benchCancelled();
+    bool ok = !cancelled && fetched && decoded && flashed;
+    ESP_LOGI(TAG, "OTA benchmark: %s", json.c_str());
+    if (request.replyId)
+        ackMessage(request.replyId, "FWBM", ok,
+                   cancelled ? "OTA: benchmark cancelled" : json.c_str());
+    return ok;
+}
+
+bool OTAmanager::poll(uint32_t budgetUs) {
+    if (ota_worker != NULL || ota_queue == NULL)
+        return false;   // updates run on the worker task
+
+    if (polled_update == nullptr) {
+        ota_health_step();
+        ota_activation_step();
+        OtaRequest request;
+        if (!takeRequest(request))
+            return false;
+        if (request.benchmark) {   // refused by cmd_benchmark() in this mode
+            endRequest(false);
+            return false;
         }
+        ESP_LOGI(TAG, "OTA poll: starting update to <%s>",
+                 request.target[0] ? request.target : "latest");
+        polled_update = new EspSession(request, fwStorageUrl, fwObsUrl);
+        polled_update->source.setReadTimeoutMs(OTA_POLL_READ_TIMEOUT_MS);
+        OtaSession &session = polled_update->session;
+        if (request.turbo)   // the application's loop keeps its own priority
+            session.setTurbo({true, true, true, -1});
+        session.setLimits(OtaSession::limitsFor(request));
+        // sliced: sector-by-sector erase instead of the whole slot in one call
+        session.setStepBudget(request.stepBudgetUs ? request.stepBudgetUs : budgetUs);
+    }
+    OtaSession &session = polled_update->session;
+
+    EventBits_t bits = xEventGroupGetBits(ota_ctrl);
+    if (bits & OTA_EVT_CANCEL)
+        session.cancel();
+    else if (bits & OTA_EVT_PAUSE)
+        return true;
+
+    if (!session.finished()) {
+        session.poll(budgetUs);
+        polled_update->footprint.sample();
+    }
+    if (!session.finished())
+        return true;
+
+    bool ok = session.state() == OtaSession::DONE;
+    bool current = session.state() == OtaSession::CURRENT;
+    bool dryRun = active_request.dryRun;   // only the driving loop changes it
+    if (!current)
+        recordMetrics(session.metrics(), polled_update->footprint, 0);
+    if (dryRun)
+        reportDryRun(*polled_update);
+    bool stage = ok && active_request.stage;
+    if (stage)
+        stageImage(*polled_update);
+    delete polled_update;
+    polled_update = nullptr;
+    endRequest(ok || current);
+    if (ok && !dryRun && !stage) {
+        ESP_LOGI(TAG, "OTA update successful. Rebooting...");
         esp_restart();
+    }
+    return false;
+}
+
+bool OTAmanager::addHealthProbe(const char *name, OtaHealth::Probe probe, void *arg,
+                                uint32_t deadlineMs) {
+    return health.add(name, probe, arg, deadlineMs);
+}
+
+/// @brief one round of the health probes, at most every OTA_HEALTH_POLL_MS;
+/// on a verdict, records it and confirms or rolls back the image.
+static void setHealthActive(bool active) {
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    health_active = active;
+    xSemaphoreGive(ota_mutex);
+}
+
+void OTAmanager::ota_health_step() {
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    bool active = health_active;
+    xSemaphoreGive(ota_mutex);
+    if (!active || now < health_next_us)
+        return;
+    health_next_us = now + OTA_HEALTH_POLL_MS * 1000;
+
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t ota_state;
+    if (esp_ota_get_state_partition(running, &ota_state) != ESP_OK ||
+        ota_state != ESP_OTA_IMG_PENDING_VERIFY) {
+        ESP_LOGI(TAG, "Image confirmed outside the health check");
+        setHealthActive(false);
+        return;
+    }
+    if (health.size() == 0) {
+        if (now > OTA_HEALTH_WAIT_MS * 1000LL) {
+            ESP_LOGW(TAG, "No health probes registered: the image waits for FWCO");
+            setHealthActive(false);
+        }
+        return;
+    }
+    OtaHealth::Result result = health.run(0, now);
+    if (result == OtaHealth::PENDING)
+        return;
+
+    setHealthActive(false);
+    last_health = {};
+    last_health.valid = result == OtaHealth::PASS;
+    last_health.probes = (uint8_t)health.size();
+    last_health.passed = (uint8_t)health.passed();
+    last_health.afterMs = (uint32_t)(now / 1000);
+    if (health.failed())
+        snprintf(last_health.failed, sizeof(last_health.failed), "%s", health.failed());
+    last_health_magic = OTA_HEALTH_MAGIC;
+    ESP_LOGI(TAG, "Health check %s after %u ms (%u/%u probes passed)",
+             last_health.valid ? "passed" : "failed", (unsigned)last_health.afterMs,
+             last_health.passed, last_health.probes);
+    if (g_otaManager)
+        g_otaManager->cmd_otaValidate(last_health.valid);   // reboots on failure
+}
 
-    } while (0);   // end of "do { } while(0)" block
+/// @brief boots the staged image once its activation is due and the safe
+/// point, if any, allows it.
+void OTAmanager::ota_activation_step() {
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    const esp_partition_t *part = staged_partition;
+    bool due = part && activation_armed && !session_active &&
+               esp_timer_get_time() >= activation_at_us;
+    xSemaphoreGive(ota_mutex);
+    if (!due || (safe_point && !safe_point(safe_point_arg)))
+        return;
 
-    // Cleanup (same as before, but no goto)
-    if (ota_mutex)
+    esp_err_t err = esp_ota_set_boot_partition(part);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Staged image not activated: %s", esp_err_to_name(err));
+        xSemaphoreTake(ota_mutex, portMAX_DELAY);
+        staged_partition = nullptr;
+        activation_armed = false;
         xSemaphoreGive(ota_mutex);
-    if (client)
-        esp_http_client_cleanup(client);
-    if (fwScanner)
-        delete fwScanner;
-    if (c_buffer)
-        free(c_buffer);
-    if (d_buffer)
-        free(d_buffer);
-    if (dict_buffer)
-        free(dict_buffer);
-    if (lz4_stream)
-        LZ4_freeStreamDecode(lz4_stream);
-    if (pvParameter != nullptr)
-        free((void *)pvParameter);
-    vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Staged image %s activated in %s. Rebooting...", staged_file, part->label);
+    esp_restart();
 }
 
+bool OTAmanager::cmd_activate(uint32_t delayMs, char *staged, size_t stagedLen) {
+    if (ota_mutex == NULL)
+        return false;
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    bool armed = staged_partition != nullptr;
+    if (armed) {
+        activation_armed = true;
+        activation_at_us = esp_timer_get_time() + (int64_t)delayMs * 1000;
+        if (staged)
+            snprintf(staged, stagedLen, "%s", staged_file);
+    }
+    xSemaphoreGive(ota_mutex);
+    return armed;
+}
+
+void OTAmanager::setSafePoint(SafePoint safePoint, void *arg) {
+    safe_point_arg = arg;
+    safe_point = safePoint;
+}
+
+void OTAmanager::reportLoad(uint8_t loadPct) { OtaGovernor::reportLoad(loadPct); }
+
 void OTAmanager::cmd_otaValidate(ED_MQTT_dispatcher::ctrlCommand *cmd) {
     cmd_otaValidate(true);
 }
@@ -522,7 +725,25 @@ void OTAmanager::cmd_otaValidate(bool otaIsValid) {
 
 void OTAmanager::cmd_launchUpdate(ED_MQTT_dispatcher::ctrlCommand *cmd) {
     const char *target = cmd->getParam("_default");
-    cmd_launchUpdate(target);
+    OtaRequest request = {};
+    if (!request.setTarget(target)) {
+        ESP_LOGE(TAG, "Version target too long: %s", target);
+        ackResult(cmd, false, "OTA: version target too long");
+        return;
+    }
+    request.turbo = paramFlag(cmd, "_turbo");
+    request.bwKBps = paramUInt(cmd, "_bw", UINT16_MAX);
+    request.cpuPct = paramUInt(cmd, "_cpu", 100);
+    request.maxLoadPct = paramUInt(cmd, "_load", 100);
+    request.stepBudgetUs = paramUInt(cmd, "_slice", 1000000);
+    request.trace = paramFlag(cmd, "_trace");
+    request.dryRun = paramFlag(cmd, "_dryrun");
+    request.stage = paramFlag(cmd, "_stage");
+    if (request.dryRun) {   // the result is the reply
+        const char *msgid_str = cmd->getParam("_msgID");
+        request.replyId = msgid_str ? std::stoll(msgid_str) : 0;
+    }
+    cmd_launchUpdate(request);
 }
 
 void OTAmanager::cmd_getFwStatus(ED_MQTT_dispatcher::ctrlCommand *cmd) {
@@ -538,36 +759,473 @@ void OTAmanager::cmd_getFwStatus(ED_MQTT_dispatcher::ctrlCommand *cmd) {
         }
     } else {
         ESP_LOGE(TAG, "Failed to get OTA state");
-        const char *msgid_str = cmd->getParam("_msgID");
-        if (msgid_str) {
-            ED_MQTT_dispatcher::MQTTdispatcher::ackCommand(
-                std::stoll(msgid_str), cmd->cmdID,
-                ED_MQTT_dispatcher::MQTTdispatcher::ackType::FAIL,
-                "Failed to get OTA state");
+        ackResult(cmd, false, "Failed to get OTA state");
+        return;
+    }
+    bool healthRunning = false;
+    if (ota_mutex && xSemaphoreTake(ota_mutex, portMAX_DELAY) == pdTRUE) {
+        healthRunning = health_active;
+        if (session_active && active_request.benchmark) {
+            response += "; benchmark running";
+        } else if (session_active) {
+            response += std::string(active_request.dryRun ? "; dry run of <"
+                                                          : "; update to <") +
+                        (active_request.target[0] ? active_request.target : "latest") +
+                        ((xEventGroupGetBits(ota_ctrl) & OTA_EVT_PAUSE) ? "> paused"
+                                                                       : "> running");
+        }
+        if (uxQueueMessagesWaiting(ota_queue) > 0)
+            response += "; request pending";
+        if (announced_release.url[0])
+            response += std::string("; release <") + announced_release.file() + "> announced";
+        if (staged_partition) {
+            response += std::string("; staged <") + staged_file + "> in " +
+                        staged_partition->label;
+            int64_t left = activation_at_us - esp_timer_get_time();
+            if (activation_armed && left > 0)
+                response += ", activation in " + std::to_string(left / 1000000 + 1) + " s";
+            else if (activation_armed)
+                response += safe_point ? ", activation waiting for the safe point"
+                                       : ", activating";
+        }
+        xSemaphoreGive(ota_mutex);
+    }
+    if (healthRunning) {
+        response += "; health check running (" + std::to_string(health.passed()) + "/" +
+                    std::to_string(health.size()) + " probes passed)";
+    } else if (last_health_magic == OTA_HEALTH_MAGIC) {
+        char buf[96];
+        if (last_health.valid)
+            snprintf(buf, sizeof(buf), "; health check: valid %u ms after boot (%u probes)",
+                     (unsigned)last_health.afterMs, last_health.probes);
+        else
+            snprintf(buf, sizeof(buf), "; health check: rolled back, probe %s failed at %u ms",
+                     last_health.failed, (unsigned)last_health.afterMs);
+        response += buf;
+    }
+    if (last_metrics_magic == OTA_METRICS_MAGIC) {
+        char buf[160];
+        snprintf(buf, sizeof(buf), "; last %s: %u bytes%s, %u B/s%s, throttled %u ms",
+                 last_metrics.dryRun ? "dry run" : "update", (unsigned)last_metrics.writtenBytes,
+                 last_metrics.slotReused ? " (image already in the slot)" : "",
+                 (unsigned)last_metrics.throughputBps,
+                 last_metrics.turbo ? " turbo" : "",
+                 (unsigned)last_metrics.throttledMs);
+        response += buf;
+        if (last_metrics.turbo)
+            snprintf(buf, sizeof(buf), " (CPU %u->%u MHz, prio %u->%u)",
+                     last_metrics.cpuMhzBefore, last_metrics.cpuMhzDuring,
+                     last_metrics.priorityBefore, last_metrics.priorityDuring);
+        else
+            buf[0] = '\0';
+        response += buf;
+        if (last_metrics.stepMaxState == OTA_STEP_NONE)
+            snprintf(buf, sizeof(buf), ", worst step none (budget %u us)",
+                     (unsigned)last_metrics.stepBudgetUs);
+        else
+            snprintf(buf, sizeof(buf), ", worst step %u us in %s (budget %u us)",
+                     (unsigned)last_metrics.stepMaxUs,
+                     OtaSession::stateName((OtaSession::State)last_metrics.stepMaxState),
+                     (unsigned)last_metrics.stepBudgetUs);
+        response += buf;
+        snprintf(buf, sizeof(buf), ", decode %u B/s%s, fetch %u B/s, write %u B/s",
+                 (unsigned)last_metrics.decodeBps, last_metrics.iramDecode ? " (IRAM)" : "",
+                 (unsigned)last_metrics.fetchBps, (unsigned)last_metrics.writeBps);
+        response += buf;
+        if (last_metrics.stackSize)
+            snprintf(buf, sizeof(buf), ", stack %u/%u B",
+                     (unsigned)(last_metrics.stackSize - last_metrics.stackFreeMin),
+                     (unsigned)last_metrics.stackSize);
+        else
+            snprintf(buf, sizeof(buf), ", stack free min %u B",
+                     (unsigned)last_metrics.stackFreeMin);
+        response += buf;
+        snprintf(buf, sizeof(buf), ", heap peak %u B (free min %u, largest block %u)",
+                 (unsigned)last_metrics.heapPeakBytes, (unsigned)last_metrics.heapFreeMin,
+                 (unsigned)last_metrics.heapLargestFree);
+        response += buf;
+        if (last_metrics.prevThroughputBps) {
+            snprintf(buf, sizeof(buf), ", previous %u B/s%s",
+                     (unsigned)last_metrics.prevThroughputBps,
+                     last_metrics.prevTurbo ? " turbo" : "");
+            response += buf;
         }
+    }
+    ackResult(cmd, true, response.c_str());   // send status instead of original command
+    ESP_LOGI(TAG, "OTA status: %s", response.c_str());
+}
+
+void OTAmanager::cmd_cancelUpdate(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    switch (cmd_cancelUpdate()) {
+        case CANCELLED_UPDATE:     ackResult(cmd, true, "OTA: cancel requested"); break;
+        case CANCELLED_PENDING:    ackResult(cmd, true, "OTA: pending request dropped"); break;
+        case CANCELLED_ACTIVATION:
+            ackResult(cmd, true, "OTA: activation cancelled, image still staged");
+            break;
+        default:                   ackResult(cmd, true, "OTA: nothing running"); break;
+    }
+}
+
+void OTAmanager::cmd_pauseUpdate(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    bool wasActive = cmd_pauseUpdate(true);
+    ackResult(cmd, wasActive, wasActive ? "OTA: paused" : "OTA: nothing running");
+}
+
+void OTAmanager::cmd_resumeUpdate(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    bool wasActive = cmd_pauseUpdate(false);
+    ackResult(cmd, wasActive, wasActive ? "OTA: resumed" : "OTA: nothing running");
+}
+
+/// @brief returns OTA_TRACE_CHUNK bytes of the recorded trace from the byte
+/// offset given as parameter, base64-encoded: "OTA trace <offset>+<n>/<total>:
+/// <data>". Decoding the chunks in order gives the trace file for the host.
+void OTAmanager::cmd_getTrace(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    const esp_partition_t *part = EspPartitionTraceOutput::partition();
+    uint8_t data[OTA_TRACE_CHUNK];
+    if (part == nullptr || esp_partition_read(part, 0, data, OTA_TRACE_HEADER_SIZE) != ESP_OK ||
+        memcmp(data, OTA_TRACE_MAGIC, 4) != 0) {
+        ackResult(cmd, false, "OTA: no transfer trace");
         return;
     }
+    uint32_t length;
+    memcpy(&length, data + OTA_TRACE_LENGTH_OFFSET, sizeof(length));
+    bool complete = length != 0xFFFFFFFF;   // else interrupted: the reader stops at erased flash
+    uint32_t total = part->size;
+    if (complete && length < part->size - OTA_TRACE_HEADER_SIZE)
+        total = OTA_TRACE_HEADER_SIZE + length;
+    uint32_t offset = paramUInt(cmd, "_default", total);
+    size_t n = total - offset < OTA_TRACE_CHUNK ? total - offset : OTA_TRACE_CHUNK;
+    if (n > 0 && esp_partition_read(part, offset, data, n) != ESP_OK) {
+        ackResult(cmd, false, "OTA: trace read failed");
+        return;
+    }
+    char reply[64 + (OTA_TRACE_CHUNK + 2) / 3 * 4 + 1];
+    int used = snprintf(reply, sizeof(reply), "OTA trace %u+%u/%u%s: ", (unsigned)offset,
+                        (unsigned)n, (unsigned)total, complete ? "" : " incomplete");
+    size_t encoded = 0;
+    mbedtls_base64_encode((unsigned char *)reply + used, sizeof(reply) - used, &encoded, data, n);
+    reply[used + encoded] = '\0';
+    ackResult(cmd, true, reply);
+}
+
+/// @brief FWBM [KB]: queues a benchmark downloading KB kilobytes (default
+/// OTA_BENCH_TRANSPORT_BYTES) of the latest image; the JSON result is the
+/// reply, sent when the worker has finished.
+void OTAmanager::cmd_benchmark(ED_MQTT_dispatcher::ctrlCommand *cmd) {
     const char *msgid_str = cmd->getParam("_msgID");
-    if (msgid_str) {
-        ED_MQTT_dispatcher::MQTTdispatcher::ackCommand(
-            std::stoll(msgid_str), cmd->cmdID,
-            ED_MQTT_dispatcher::MQTTdispatcher::ackType::OK,
-            response.c_str());   // send status instead of original command
+    OtaRequest request = {};
+    request.benchmark = true;
+    request.benchBytes = paramUInt(cmd, "_default", 16 * 1024) * 1024;
+    request.replyId = msgid_str ? std::stoll(msgid_str) : 0;
+    char reply[96];
+    if (!cmd_benchmark(request, reply, sizeof(reply)))
+        ackResult(cmd, false, reply);
+}
+
+bool OTAmanager::cmd_benchmark(const OtaRequest &request, char *reply, size_t replyLen) {
+    const char *refused = nullptr;
+    if (ota_queue == NULL) {
+        refused = "not initialized";
+    } else if (ota_worker == NULL) {
+        refused = "no worker task (APP_POLL mode)";
+    } else {
+        xSemaphoreTake(ota_mutex, portMAX_DELAY);
+        // the flash phase uses the slot an update writes to
+        if (session_active || uxQueueMessagesWaiting(ota_queue) > 0) {
+            refused = "busy";
+        } else if (staged_partition) {
+            refused = "an image is staged in the slot the flash phase uses";
+        } else {
+            OtaRequest benchmark = request;
+            benchmark.benchmark = true;
+            xQueueOverwrite(ota_queue, &benchmark);
+        }
+        xSemaphoreGive(ota_mutex);
     }
-    ESP_LOGI(TAG, "OTA status: %s", response.c_str());
+    if (refused) {
+        ESP_LOGW(TAG, "Benchmark refused: %s", refused);
+        if (reply)
+            snprintf(reply, replyLen, "OTA: %s", refused);
+    }
+    return refused == nullptr;
 }
 
-void OTAmanager::cmd_launchUpdate(const char *versionTarget) {
-    char *ver_copy = nullptr;
-    if (versionTarget != nullptr && strlen(versionTarget) > 0) {
-        ver_copy = strdup(versionTarget);
-        if (ver_copy == NULL) {
-            ESP_LOGE(TAG, "strdup failed");
+static void restartTimer(void *) { esp_restart(); }
+
+/// @brief FWAC [+seconds|HH:MM]: boots the image staged by "FWUP … stage"
+/// OTA_ACTIVATE_REBOOT_MS after the reply, the given seconds later or at the
+/// next HH:MM local time; a safe point set by the application can hold it
+/// further. FWCA disarms it.
+void OTAmanager::cmd_activate(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    const char *when = cmd->getParam("_default");
+    uint32_t delayS = 0;
+    int hh, mm;
+    if (when == nullptr || *when == '\0') {
+        // now
+    } else if (when[0] == '+' && isdigit((unsigned char)when[1])) {
+        unsigned long s = strtoul(when + 1, nullptr, 10);
+        delayS = s < 7 * 24 * 3600 ? (uint32_t)s : 7 * 24 * 3600;
+    } else if (sscanf(when, "%d:%d", &hh, &mm) == 2 && hh >= 0 && hh < 24 && mm >= 0 &&
+               mm < 60) {
+        time_t now = time(NULL);
+        if (now < OTA_CLOCK_VALID) {
+            ackResult(cmd, false, "OTA: clock not set, give the delay as +seconds");
             return;
         }
+        struct tm t;
+        localtime_r(&now, &t);
+        t.tm_hour = hh;
+        t.tm_min = mm;
+        t.tm_sec = 0;
+        time_t at = mktime(&t);
+        if (at <= now)
+            at += 24 * 3600;   // next occurrence
+        delayS = (uint32_t)(at - now);
+    } else {
+        ackResult(cmd, false, "OTA: activation time is +seconds or HH:MM");
+        return;
+    }
+    uint32_t delayMs = delayS * 1000 > OTA_ACTIVATE_REBOOT_MS ? delayS * 1000
+                                                              : OTA_ACTIVATE_REBOOT_MS;
+    char staged[sizeof(staged_file)];
+    if (!cmd_activate(delayMs, staged, sizeof(staged))) {
+        ackResult(cmd, false, "OTA: no staged image, see FWUP stage");
+        return;
+    }
+    char reply[128];
+    snprintf(reply, sizeof(reply), "OTA: %s activation in %u s%s", staged,
+             (unsigned)(delayMs / 1000), safe_point ? ", at the next safe point" : "");
+    ackResult(cmd, true, reply);
+}
+
+/// @brief FWRB [check]: switches the boot partition to the image kept in the
+/// other OTA slot and reboots OTA_ROLLBACK_REBOOT_MS after the reply, which
+/// names the version rolled back to. "check" only runs the image check.
+void OTAmanager::cmd_rollback(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    const char *arg = cmd->getParam("_default");
+    bool apply = arg == nullptr || strcasecmp(arg, "check") != 0;
+    char reply[160];
+    bool ok = cmd_rollback(apply, reply, sizeof(reply));
+    ackResult(cmd, ok, reply);
+    if (!ok || !apply)
+        return;
+    static esp_timer_handle_t restart = nullptr;
+    esp_timer_create_args_t args = {};
+    args.callback = restartTimer;
+    args.name = "ota_rollback";
+    if (restart == nullptr && esp_timer_create(&args, &restart) != ESP_OK)
+        restart = nullptr;
+    if (restart == nullptr ||
+        esp_timer_start_once(restart, OTA_ROLLBACK_REBOOT_MS * 1000) != ESP_OK)
+        esp_restart();
+}
+
+bool OTAmanager::cmd_rollback(bool apply, char *reply, size_t replyLen) {
+    if (ota_mutex == NULL) {
+        snprintf(reply, replyLen, "OTA rollback: not initialized");
+        return false;
+    }
+    // an update writes the slot the rollback boots: hold it back meanwhile
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    bool busy = session_active || uxQueueMessagesWaiting(ota_queue) > 0;
+    bool staged = staged_partition != nullptr;   // the other slot holds the new image
+    RollbackImage image = {};
+    bool ok = !busy && !staged && espRollbackImage(image);
+    if (ok && apply)
+        ok = espRollback(image);
+    xSemaphoreGive(ota_mutex);
+
+    if (busy)
+        snprintf(reply, replyLen, "OTA rollback: busy, an update is running or pending");
+    else if (staged)
+        snprintf(reply, replyLen, "OTA rollback: the other slot holds the staged %s",
+                 staged_file);
+    else if (image.error)
+        snprintf(reply, replyLen, "OTA rollback refused: %s%s%s", image.error,
+                 image.app.version[0] ? ", slot holds " : "", image.app.version);
+    else
+        snprintf(reply, replyLen, "OTA rollback %s %s %s in '%s' (%u bytes, checked in %u ms%s)",
+                 !ok ? "failed, cannot boot" : apply ? "to" : "check passed for", image.app.project,
+                 image.app.version, image.partition->label, (unsigned)image.imageSize,
+                 (unsigned)image.checkMs, image.checkMs ? "" : ", cached");
+    ESP_LOGI(TAG, "%s", reply);
+    return ok;
+}
+
+/// @brief FWRA URL version=… size=… sha256=… codec=lz4 [stage=1]: a release
+/// announcement sent once on the command topic; the retained one goes to the
+/// release topic (releaseTopic()). size and sha256 describe the decoded image
+/// and let the device skip an image it holds before any download.
+void OTAmanager::cmd_announceRelease(ED_MQTT_dispatcher::ctrlCommand *cmd) {
+    OtaRelease release;
+    const char *error = release.set(cmd->getParam("_default"), cmd->getParam("_version"),
+                                    cmd->getParam("_size"), cmd->getParam("_sha256"),
+                                    cmd->getParam("_codec"));
+    if (error) {
+        ESP_LOGE(TAG, "Release announcement ignored: %s", error);
+        ackResult(cmd, false, (std::string("OTA: release announcement ") + error).c_str());
+        return;
+    }
+    bool stage = paramFlag(cmd, "_stage");
+    const char *outcome = "";
+    switch (onReleaseAnnouncement(release, stage)) {
+        case RELEASE_KEPT:        outcome = stage ? " announced, staging" : " announced"; break;
+        case RELEASE_NOT_NEWER:   outcome = " not a newer release of this project, ignored"; break;
+        case RELEASE_STAGED:      outcome = " already staged, see FWAC"; break;
+        case RELEASE_UNAVAILABLE: outcome = " ignored, OTA not initialized"; break;
+        case RELEASE_INVALID:     break;   // set() checked it above
+    }
+    std::string reply = std::string("OTA: release <") + release.file() + ">" + outcome;
+    ackResult(cmd, true, reply.c_str());
+}
+
+OTAmanager::Announced OTAmanager::onReleaseAnnouncement(const OtaRelease &release,
+                                                        bool stage) {
+    if (ota_mutex == NULL)
+        return RELEASE_UNAVAILABLE;
+    // the rules of the listing scan: the file must name a newer version. The
+    // scanner holds a chunk buffer, too large for the MQTT task stack.
+    FirmwareScanner *scanner = new FirmwareScanner(ED_SYS::ESP_std::Firmware::prjName(),
+                                                   ED_SYS::ESP_std::Firmware::version(),
+                                                   FirmwareScanner::UPDATE_TO_LATEST);
+    std::string href = "href=\"" + std::string(release.file()) + "\"";
+    scanner->file_scanner_parse_chunk(href.c_str(), href.size());
+    bool newer = scanner->targetFwFile() != nullptr;
+    delete scanner;
+    if (!newer) {
+        ESP_LOGI(TAG, "Release %s is not newer than the running firmware", release.file());
+        return RELEASE_NOT_NEWER;
+    }
+
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    bool known = strcmp(announced_release.url, release.url) == 0;
+    announced_release = release;
+    bool staged = staged_partition && strcmp(staged_file, release.file()) == 0;
+    xSemaphoreGive(ota_mutex);
+    if (!known)
+        ESP_LOGI(TAG, "Release %s %s announced: %s", release.file(), release.version,
+                 release.url);
+    if (staged)
+        return RELEASE_STAGED;
+    if (stage) {
+        OtaRequest request = {};
+        request.stage = true;
+        request.release = release;
+        cmd_launchUpdate(request);   // merged with the same request running or pending
+    }
+    return RELEASE_KEPT;
+}
+
+bool OTAmanager::releaseTopic(char *topic, size_t len) {
+    return otaReleaseTopic(topic, len, ED_SYS::ESP_std::Firmware::prjName());
+}
+
+OTAmanager::Announced OTAmanager::onReleaseMessage(const char *data, size_t len) {
+    OtaRelease release;
+    bool stage = false;
+    const char *error = release.parse(data, len, &stage);
+    if (error) {
+        ESP_LOGE(TAG, "Release announcement ignored: %s", error);
+        return RELEASE_INVALID;
+    }
+    return onReleaseAnnouncement(release, stage);
+}
+
+OTAmanager::Cancelled OTAmanager::cmd_cancelUpdate() {
+    if (ota_mutex == NULL)
+        return CANCELLED_NOTHING;
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    OtaRequest pending = {};
+    bool hadPending = xQueueReceive(ota_queue, &pending, 0) == pdTRUE;
+    Cancelled found = session_active     ? CANCELLED_UPDATE
+                      : hadPending       ? CANCELLED_PENDING
+                      : activation_armed ? CANCELLED_ACTIVATION
+                                         : CANCELLED_NOTHING;
+    activation_armed = false;
+    if (session_active) {
+        xEventGroupSetBits(ota_ctrl, OTA_EVT_CANCEL);
+        ESP_LOGW(TAG, "OTA cancel requested");
+    }
+    xSemaphoreGive(ota_mutex);
+    ackDropped(pending, "OTA: cancelled before it ran");
+    return found;
+}
+
+bool OTAmanager::cmd_pauseUpdate(bool pause) {
+    if (ota_mutex == NULL)
+        return false;
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    bool active = session_active;
+    if (active) {
+        if (pause)
+            xEventGroupSetBits(ota_ctrl, OTA_EVT_PAUSE);
+        else
+            xEventGroupClearBits(ota_ctrl, OTA_EVT_PAUSE);
+    }
+    xSemaphoreGive(ota_mutex);
+    return active;
+}
+
+void OTAmanager::cmd_launchUpdate(const char *versionTarget) {
+    OtaRequest request = {};
+    if (!request.setTarget(versionTarget)) {
+        ESP_LOGE(TAG, "Version target too long: %s", versionTarget);
+        return;
+    }
+    cmd_launchUpdate(request);
+}
+
+void OTAmanager::cmd_launchUpdate(const OtaRequest &launched) {
+    if (ota_queue == NULL) {
+        ESP_LOGE(TAG, "OTA request queue not available, update ignored");
+        return;
+    }
+
+    xSemaphoreTake(ota_mutex, portMAX_DELAY);
+    // the session tries the announced release first, if it fits the request
+    OtaRequest request = launched;
+    if (!request.benchmark && request.release.url[0] == '\0')
+        request.release = announced_release;
+    if (session_active && active_request.sameTarget(request) &&
+        !(xEventGroupGetBits(ota_ctrl) & OTA_EVT_CANCEL)) {
+        ESP_LOGI(TAG, "Update to <%s> already running, request merged",
+                 request.target[0] ? request.target : "latest");
+        // a merged dry run takes over the result if the running one has no
+        // reply id, else it is told where the result goes
+        int64_t resultId = active_request.replyId;
+        if (resultId == 0)
+            active_request.replyId = request.replyId;
+        xSemaphoreGive(ota_mutex);
+        if (resultId && request.replyId && request.replyId != resultId)
+            ackMerged(request, resultId);
+        return;
+    }
+    OtaRequest pending;
+    OtaRequest merged = {};
+    OtaRequest replaced = {};
+    if (xQueuePeek(ota_queue, &pending, 0) == pdTRUE) {
+        if (pending.benchmark) {
+            ESP_LOGI(TAG, "Update request replaces pending benchmark");
+            replaced = pending;
+        } else if (pending.sameTarget(request)) {
+            ESP_LOGI(TAG, "Update request merged with pending one");
+            // one result for both dry runs: to the pending sender when the new
+            // request has no reply id, else to the new one
+            if (request.replyId == 0)
+                request.replyId = pending.replyId;
+            else if (pending.replyId && pending.replyId != request.replyId)
+                merged = pending;
+        } else {
+            ESP_LOGI(TAG, "Update request replaces pending <%s>",
+                     pending.target[0] ? pending.target : "latest");
+            replaced = pending;
+        }
     }
-    xTaskCreate(&ED_OTA::OTAmanager::ota_update_task, "ota_task", 16384,
-                (void *)ver_copy, 5, NULL);
+    xQueueOverwrite(ota_queue, &request);
+    xSemaphoreGive(ota_mutex);
+    if (merged.replyId)
+        ackMerged(merged, request.replyId);
+    ackDropped(replaced, "OTA: replaced by a later request before it ran");
 }
 
 } // namespace ED_OTA
\ No newline at end of file
@@ -12,49 +12,23 @@
 #pragma once
 
 #include "ED_MQTT_dispatcher.h"
-#include "lz4.h"
-#include <regex.h>
-
-
-#define COMPRESSED_BLOCK_SIZE 4096 // maximum compressed block size from HTTP
-#define DECOMPRESSED_BLOCK_SIZE                                                \
-  16384 // must be >= max decompressed output (16KB)
-#define CARRYOVER_SIZE 128
-#define MAX_FILENAME_LEN 128
+#include "ED_OTA_core.h"
+#include "ED_OTA_health.h"
+
+#ifndef OTA_WORKER_STACK_SIZE
+#define OTA_WORKER_STACK_SIZE 16384 // FWQS reports the measured peak, see host/footprint.cpp
+#endif
+#define OTA_WORKER_PRIORITY 5
+#define OTA_WORKER_CORE tskNO_AFFINITY // pin to 1 to keep OTA off the Wi-Fi core
+#define OTA_TURBO_PRIORITY 10
+#define OTA_TRACE_CHUNK 192 // trace bytes per FWTR reply (256 base64 characters)
+#define OTA_ROLLBACK_REBOOT_MS 2000 // FWRB: lets the reply leave before the reboot
+#define OTA_ACTIVATE_REBOOT_MS 2000 // FWAC: shortest delay, lets the reply leave
+#define OTA_STAGE_PRIORITY 1        // worker priority while staging (not turbo)
+#define OTA_POLL_READ_TIMEOUT_MS 10 // APP_POLL: longest wait of a read for data
 
 namespace ED_OTA {
 
-/// @brief scans firmware files in an HTTP directory listing to find the best
-/// candidate.
-struct FirmwareScanner {
-  enum UpdateType { UPDATE_TO_LATEST, UPDATE_TO_SPECIFIC };
-
-  FirmwareScanner(const char *FwarePrj, const char *curFwareVer,
-                  UpdateType mode);
-  ~FirmwareScanner();
-
-  void file_scanner_parse_chunk(const char *chunk, size_t chunk_len);
-  const char *targetFwFile();
-
-private:
-  const char *prjID;
-  regex_t regex;
-  UpdateType updateMode;
-
-  char buffer[COMPRESSED_BLOCK_SIZE + CARRYOVER_SIZE + 1];
-  char carryover[CARRYOVER_SIZE + 1];
-  char best_filename[MAX_FILENAME_LEN];
-  int best_version[4]; // major, minor, patch, build
-  bool prefix_locked[4];
-  bool matchingVersionFound;
-
-  bool is_version_higher(int new_v[4]);
-  void parse_version_string(const char *ver_str, int out[4]);
-  bool matches_prefix(const int cand[4]);
-
-  FirmwareScanner() = delete;
-};
-
 /**
  * @brief OTA updater controlled via MQTT commands.
  * Implements HTTPS + LZ4 streaming.
@@ -63,16 +37,104 @@ class OTAmanager : public ED_MQTT_dispatcher::CommandWithRegistry {
 private:
   static inline const char fwStorageUrl[30] = "https://raspi00/fware/";
   static inline const char fwObsUrl[30] = "https://raspi00/fware/obs/";
-  static void ota_update_task(void *pvParameter);
+  static void ota_worker_task(void *pvParameter);
+  static bool ota_update_task(const OtaRequest &request);
+  static bool ota_benchmark_task(const OtaRequest &request);
+  static bool ota_checkpoint();
+  static void ota_health_step();
+  static void ota_activation_step();
 
 public:
   void cmd_otaValidate(ED_MQTT_dispatcher::ctrlCommand *cmd);
   void cmd_launchUpdate(ED_MQTT_dispatcher::ctrlCommand *cmd);
   void cmd_getFwStatus(ED_MQTT_dispatcher::ctrlCommand *cmd);
-  OTAmanager();
-
+  void cmd_cancelUpdate(ED_MQTT_dispatcher::ctrlCommand *cmd);
+  void cmd_pauseUpdate(ED_MQTT_dispatcher::ctrlCommand *cmd);
+  void cmd_resumeUpdate(ED_MQTT_dispatcher::ctrlCommand *cmd);
+  void cmd_getTrace(ED_MQTT_dispatcher::ctrlCommand *cmd);
+  void cmd_benchmark(ED_MQTT_dispatcher::ctrlCommand *cmd);
+  void cmd_rollback(ED_MQTT_dispatcher::ctrlCommand *cmd);
+  void cmd_activate(ED_MQTT_dispatcher::ctrlCommand *cmd);
+  void cmd_announceRelease(ED_MQTT_dispatcher::ctrlCommand *cmd);
+
+  /// @brief WORKER_TASK runs updates on a dedicated task; APP_POLL creates no
+  /// task and updates advance only through poll().
+  enum ExecMode { WORKER_TASK, APP_POLL };
+  OTAmanager(ExecMode mode = WORKER_TASK);
+
+  /// @brief APP_POLL mode: starts the pending update and advances it by about
+  /// budgetUs. The session runs sliced (budgetUs per step unless the request
+  /// sets one) and reads wait at most OTA_POLL_READ_TIMEOUT_MS; opening a
+  /// connection (TLS handshake) and the final image check still block for
+  /// their whole duration. Call from one application loop only; returns true
+  /// while an update is in progress. Reboots when the update completes.
+  /// Benchmarks are not run in this mode (see cmd_benchmark()).
+  bool poll(uint32_t budgetUs);
+
+  /// @brief queues an update request for the OTA worker. A request identical
+  /// to the running or pending one is merged, a different one replaces the
+  /// pending request.
   void cmd_launchUpdate(const char *versionTarget);
+  void cmd_launchUpdate(const OtaRequest &request);
+  /// @brief queues request as a benchmark (see ED_OTA_bench.h) for the
+  /// worker. False, with the reason in reply, in APP_POLL mode (its phases
+  /// block for seconds, beyond any poll() budget), while an update is
+  /// running or pending and while an image is staged.
+  bool cmd_benchmark(const OtaRequest &request, char *reply = nullptr, size_t replyLen = 0);
   void cmd_otaValidate(bool otaIsValid);
+  /// @brief checks the image kept in the other OTA slot (the previous
+  /// firmware) and, with apply, makes it the boot partition without a
+  /// download. Does not reboot. reply gets the outcome and the version;
+  /// false while an update is running, pending or staged, or when the image
+  /// fails the check.
+  bool cmd_rollback(bool apply, char *reply, size_t replyLen);
+  /// @brief arms the activation of the image staged by a request with stage
+  /// set: delayMs later, and once the safe point (if any) allows it, the
+  /// boot partition is switched and the device reboots. Checked with the
+  /// health probes, every OTA_HEALTH_POLL_MS. staged gets the file name of
+  /// the image armed; false when nothing is staged.
+  bool cmd_activate(uint32_t delayMs, char *staged = nullptr, size_t stagedLen = 0);
+  /// @brief an armed activation also waits for safePoint(arg) to return
+  /// true (e.g. the machine is idle); nullptr removes it. Must not block.
+  typedef bool (*SafePoint)(void *arg);
+  static void setSafePoint(SafePoint safePoint, void *arg);
+  /// @brief what onReleaseAnnouncement() made of a release.
+  enum Announced { RELEASE_KEPT, RELEASE_NOT_NEWER, RELEASE_STAGED, RELEASE_UNAVAILABLE,
+                   RELEASE_INVALID };
+  /// @brief takes a release announcement: when it is newer than the running
+  /// firmware, later update requests without one fetch it directly instead
+  /// of scanning the listing, and with stage a stage request is queued for
+  /// it. Announcements are retained and come again on every reconnect: one
+  /// not newer, or already staged, is left alone.
+  Announced onReleaseAnnouncement(const OtaRelease &release, bool stage);
+  /// @brief this project's release topic (OTA_RELEASE_TOPIC), where the
+  /// release pipeline publishes the announcement retained. The dispatcher
+  /// reads the command topic only: the application subscribes to this one
+  /// and hands its messages to onReleaseMessage(). False if it does not fit.
+  static bool releaseTopic(char *topic, size_t len);
+  /// @brief takes a message of the release topic (see OtaRelease::parse())
+  /// as onReleaseAnnouncement() does; RELEASE_INVALID when it cannot be read,
+  /// an empty message (the retained one deleted) included.
+  Announced onReleaseMessage(const char *data, size_t len);
+  /// @brief registers a post-update health probe. While the running image
+  /// is PENDING_VERIFY the probes are polled every OTA_HEALTH_POLL_MS (by the
+  /// worker, or by poll() in APP_POLL mode) with deadlines counted from boot;
+  /// when all have passed the image is confirmed, when one fails it is
+  /// rolled back. Without probes by OTA_HEALTH_WAIT_MS, FWCO confirms.
+  static bool addHealthProbe(const char *name, OtaHealth::Probe probe, void *arg,
+                             uint32_t deadlineMs);
+  /// @brief reports the application's current load (0-100) to the governor
+  /// of a running update started with maxLoadPct.
+  static void reportLoad(uint8_t loadPct);
+  /// @brief what cmd_cancelUpdate() found to cancel, the first that applies.
+  enum Cancelled { CANCELLED_NOTHING, CANCELLED_UPDATE, CANCELLED_PENDING,
+                   CANCELLED_ACTIVATION };
+  /// @brief drops the pending request, disarms the activation of a staged
+  /// image and stops the running update at the next block boundary.
+  Cancelled cmd_cancelUpdate();
+  /// @brief holds (or releases) the running update at the next block
+  /// boundary; false when no update is running.
+  bool cmd_pauseUpdate(bool pause);
 };
 
 } // namespace ED_OTA
\ No newline at end of file
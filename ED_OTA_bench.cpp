@@ -0,0 +1,294 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_bench.cpp
+ * @brief transport and decode self-benchmark, see ED_OTA_bench.h.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "ED_OTA_bench.h"
+#include "ED_OTA_lz4slice.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "ED_OTA";
+
+namespace ED_OTA {
+
+namespace {
+
+const int LZ4_DICT_SIZE = 16 * 1024;   // as OtaSession
+const size_t BENCH_SLICE = 2048;       // LZ4SliceDecoder slice of the sliced run
+const uint32_t READ_AGAIN_US = 500;    // wait when the source has no data yet
+
+struct SampleRng {
+    uint32_t s;
+    uint32_t next() {
+        s ^= s << 13;
+        s ^= s >> 17;
+        s ^= s << 5;
+        return s;
+    }
+};
+
+/// @brief bytes of the length extension of a 4-bit length field.
+size_t extBytes(size_t len) { return len >= 15 ? (len - 15) / 255 + 1 : 0; }
+
+uint8_t *putExt(uint8_t *p, size_t len) {
+    if (len < 15)
+        return p;
+    len -= 15;
+    while (len >= 255) {
+        *p++ = 255;
+        len -= 255;
+    }
+    *p++ = (uint8_t)len;
+    return p;
+}
+
+uint32_t rate(uint64_t bytes, int64_t us) {
+    return us > 0 ? (uint32_t)(bytes * 1000000ull / (uint64_t)us) : 0;
+}
+
+} // namespace
+
+size_t lz4Sample(uint8_t *dst, size_t capacity, size_t &decodedSize, uint32_t seed) {
+    SampleRng rng = {seed ? seed : 1};
+    const size_t target = decodedSize;
+    size_t ip = 0, op = 0;
+
+    // LZ4 end rules: the last match ends 12 bytes before the end of the block
+    // and the block ends with a literal run (at least 13 compressed bytes)
+    while (true) {
+        size_t lit = rng.next() % 8;
+        if (rng.next() % 16 == 0)
+            lit = 16 + rng.next() % 64;
+        if (op == 0 && lit == 0)
+            lit = 1;
+        size_t ml = 4 + rng.next() % 16;
+        if (rng.next() % 8 == 0)
+            ml = 20 + rng.next() % 120;
+        size_t seqBytes = 1 + extBytes(lit) + lit + 2 + extBytes(ml - 4);
+        if (op + lit + ml + 12 > target || ip + seqBytes + 13 > capacity)
+            break;
+
+        uint8_t *p = dst + ip;
+        *p++ = (uint8_t)((lit < 15 ? lit : 15) << 4 | (ml - 4 < 15 ? ml - 4 : 15));
+        p = putExt(p, lit);
+        for (size_t i = 0; i < lit; i++)
+            *p++ = (uint8_t)rng.next();
+        // mostly near references, some across the block, some runs of padding
+        size_t history = op + lit;
+        uint32_t kind = rng.next() % 20;
+        size_t offset;
+        if (kind == 0)
+            offset = 1 + rng.next() % 4;
+        else if (kind < 6)
+            offset = 1 + rng.next() % history;
+        else
+            offset = 1 + rng.next() % (history < 512 ? history : 512);
+        if (offset > history)
+            offset = history;
+        *p++ = (uint8_t)offset;
+        *p++ = (uint8_t)(offset >> 8);
+        p = putExt(p, ml - 4);
+        ip = p - dst;
+        op += lit + ml;
+    }
+
+    size_t room = capacity - ip;
+    size_t lit = target - op;
+    if (lit > room - 1)
+        lit = room - 1;
+    while (1 + extBytes(lit) + lit > room)
+        lit--;
+    uint8_t *p = dst + ip;
+    *p++ = (uint8_t)((lit < 15 ? lit : 15) << 4);
+    p = putExt(p, lit);
+    for (size_t i = 0; i < lit; i++)
+        *p++ = (uint8_t)rng.next();
+    decodedSize = op + lit;
+    return p - dst;
+}
+
+bool benchResolve(HttpSource &source, const char *dirUrl, const char *project,
+                  std::string &url) {
+    if (!source.open(dirUrl)) {
+        OTA_LOGE(TAG, "Benchmark: cannot open %s", dirUrl);
+        source.close();
+        return false;
+    }
+    if (source.status() != 200) {
+        OTA_LOGE(TAG, "Benchmark: HTTP %d for %s", source.status(), dirUrl);
+        source.close();
+        return false;
+    }
+    // no version parts given: the highest image of the project is selected
+    FirmwareScanner *scanner =
+        new FirmwareScanner(project, "", FirmwareScanner::UPDATE_TO_SPECIFIC);
+    char *chunk = (char *)malloc(COMPRESSED_BLOCK_SIZE);
+    int n = chunk ? 0 : -1;
+    while (chunk) {
+        n = source.read(chunk, COMPRESSED_BLOCK_SIZE - 1);
+        if (n == OTA_READ_AGAIN) {
+            otaSleepUs(READ_AGAIN_US);
+            continue;
+        }
+        if (n <= 0)
+            break;
+        chunk[n] = '\0';
+        scanner->file_scanner_parse_chunk(chunk, n);
+    }
+    source.close();
+    bool found = n == 0 && scanner->targetFwFile() != nullptr;
+    if (found)
+        url = std::string(dirUrl) + scanner->targetFwFile();
+    else
+        OTA_LOGE(TAG, "Benchmark: no %s image in %s", project, dirUrl);
+    free(chunk);
+    delete scanner;
+    return found;
+}
+
+bool benchTransport(HttpSource &source, const char *url, size_t maxBytes, uint32_t maxUs,
+                    TransportBench &out) {
+    out = {};
+    int64_t t0 = otaNowUs();
+    if (!source.open(url)) {
+        OTA_LOGE(TAG, "Benchmark: cannot open %s", url);
+        source.close();
+        return false;
+    }
+    int64_t opened = otaNowUs();
+    out.openUs = (uint32_t)(opened - t0);
+    out.status = source.status();
+    if (out.status != 200) {
+        OTA_LOGE(TAG, "Benchmark: HTTP %d for %s", out.status, url);
+        source.close();
+        return false;
+    }
+
+    char *buf = (char *)malloc(COMPRESSED_BLOCK_SIZE);
+    int64_t last = opened;
+    while (buf && out.bytes < maxBytes && last - opened < (int64_t)maxUs) {
+        size_t want = maxBytes - out.bytes;
+        int n = source.read(buf, want < COMPRESSED_BLOCK_SIZE ? want : COMPRESSED_BLOCK_SIZE);
+        if (n == OTA_READ_AGAIN) {
+            otaSleepUs(READ_AGAIN_US);
+            last = otaNowUs();
+            continue;
+        }
+        if (n <= 0) {
+            if (n < 0)
+                OTA_LOGW(TAG, "Benchmark: HTTP read error %d after %u bytes", n,
+                         (unsigned)out.bytes);
+            break;
+        }
+        last = otaNowUs();
+        if (out.bytes == 0)
+            out.firstByteUs = (uint32_t)(last - opened);
+        out.bytes += n;
+    }
+    source.close();
+    free(buf);
+    out.readUs = (uint32_t)(last - opened);
+    out.fetchBps = rate(out.bytes, out.readUs);
+    return out.bytes > 0;
+}
+
+bool benchDecode(size_t bytes, DecodeBench &out) {
+    out = {};
+    out.iram = ED_OTA_IRAM_DECODE;
+    uint8_t *cBuffer = (uint8_t *)malloc(COMPRESSED_BLOCK_SIZE);
+    uint8_t *dBuffer = (uint8_t *)malloc(DECOMPRESSED_BLOCK_SIZE);
+    uint8_t *check = (uint8_t *)malloc(DECOMPRESSED_BLOCK_SIZE);
+    uint8_t *dictBuffer = (uint8_t *)malloc(LZ4_DICT_SIZE);
+    LZ4SliceDecoder *slicer = new LZ4SliceDecoder();
+    bool ok = cBuffer && dBuffer && check && dictBuffer;
+
+    size_t decoded = DECOMPRESSED_BLOCK_SIZE;
+    int compressed = 0;
+    if (ok) {
+        compressed = (int)lz4Sample(cBuffer, COMPRESSED_BLOCK_SIZE, decoded, 0x4F544142);
+        ok = LZ4_decompress_safe((const char *)cBuffer, (char *)check, compressed,
+                                 DECOMPRESSED_BLOCK_SIZE) == (int)decoded;
+        if (!ok)
+            OTA_LOGE(TAG, "Benchmark: decode sample is invalid");
+    }
+    size_t blocks = ok ? (bytes + decoded - 1) / decoded : 0;
+    if (blocks == 0)
+        blocks = 1;
+
+    // whole blocks: the unsliced DECODE step and its window upkeep
+    int dictSize = 0;
+    int64_t t0 = otaNowUs();
+    for (size_t i = 0; ok && i < blocks; i++) {
+        int n = LZ4_decompress_safe_usingDict((const char *)cBuffer, (char *)dBuffer, compressed,
+                                              DECOMPRESSED_BLOCK_SIZE, (const char *)dictBuffer,
+                                              dictSize);
+        ok = n == (int)decoded;
+        if (ok)
+            dictSize = windowAppend(dictBuffer, dictSize, LZ4_DICT_SIZE, dBuffer, n);
+    }
+    int64_t wholeUs = otaNowUs() - t0;
+    ok = ok && memcmp(dBuffer, check, decoded) == 0;
+
+    // sliced: the same blocks through LZ4SliceDecoder
+    dictSize = 0;
+    t0 = otaNowUs();
+    for (size_t i = 0; ok && i < blocks; i++) {
+        slicer->begin(cBuffer, compressed, dBuffer, DECOMPRESSED_BLOCK_SIZE, dictBuffer, dictSize);
+        LZ4SliceDecoder::Result res;
+        do {
+            res = slicer->decode(BENCH_SLICE);
+        } while (res == LZ4SliceDecoder::MORE);
+        ok = res == LZ4SliceDecoder::DONE && slicer->produced() == decoded;
+        if (ok)
+            dictSize = windowAppend(dictBuffer, dictSize, LZ4_DICT_SIZE, dBuffer, (int)decoded);
+    }
+    int64_t slicedUs = otaNowUs() - t0;
+    ok = ok && memcmp(dBuffer, check, decoded) == 0;
+
+    if (ok) {
+        out.blockBytes = (uint32_t)decoded;
+        out.compressedBytes = (uint32_t)compressed;
+        out.bytes = (uint32_t)(blocks * decoded);
+        out.decodeBps = rate(out.bytes, wholeUs);
+        out.slicedBps = rate(out.bytes, slicedUs);
+    } else if (cBuffer == nullptr || dBuffer == nullptr || check == nullptr ||
+               dictBuffer == nullptr) {
+        OTA_LOGE(TAG, "Benchmark: out of memory for the decode buffers");
+    }
+    delete slicer;
+    free(cBuffer);
+    free(dBuffer);
+    free(check);
+    free(dictBuffer);
+    return ok;
+}
+
+std::string benchJson(const TransportBench &t) {
+    char buf[192];
+    snprintf(buf, sizeof(buf),
+             "{\"status\": %d, \"openUs\": %u, \"firstByteUs\": %u, \"bytes\": %u, "
+             "\"readUs\": %u, \"fetchBps\": %u}",
+             t.status, (unsigned)t.openUs, (unsigned)t.firstByteUs, (unsigned)t.bytes,
+             (unsigned)t.readUs, (unsigned)t.fetchBps);
+    return buf;
+}
+
+std::string benchJson(const DecodeBench &d) {
+    char buf[192];
+    snprintf(buf, sizeof(buf),
+             "{\"blockBytes\": %u, \"compressedBytes\": %u, \"bytes\": %u, "
+             "\"decodeBps\": %u, \"slicedBps\": %u, \"iram\": %s}",
+             (unsigned)d.blockBytes, (unsigned)d.compressedBytes, (unsigned)d.bytes,
+             (unsigned)d.decodeBps, (unsigned)d.slicedBps, d.iram ? "true" : "false");
+    return buf;
+}
+
+} // namespace ED_OTA
@@ -0,0 +1,67 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_bench.h
+ * @brief self-benchmark of the update path: transport throughput from the
+ * firmware server and LZ4 decode speed on a built-in sample, the parts of
+ * the FWBM command that do not depend on the platform.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_core.h"
+#include "ED_OTA_platform.h"
+#include <string>
+
+#define OTA_BENCH_TRANSPORT_BYTES (256 * 1024) // default body bytes read
+#define OTA_BENCH_TRANSPORT_US 3000000         // read time limit (below the task WDT)
+#define OTA_BENCH_DECODE_BYTES (512 * 1024)    // default decoded bytes
+
+namespace ED_OTA {
+
+/// @brief one GET of a firmware image, cut after a byte or time limit.
+struct TransportBench {
+  int status;            // HTTP status, 0 when the request failed
+  uint32_t openUs;       // open(): connection, TLS handshake and headers
+  uint32_t firstByteUs;  // from open() returning to the first body byte
+  uint32_t bytes;        // body bytes read
+  uint32_t readUs;       // from open() returning to the last read
+  uint32_t fetchBps;     // bytes over readUs, network waits included as in OtaMetrics
+};
+
+/// @brief the session's decode loop (dictionary window included) on a
+/// generated sample, whole blocks and LZ4SliceDecoder slices.
+struct DecodeBench {
+  uint32_t blockBytes;       // decoded bytes per sample block
+  uint32_t compressedBytes;  // compressed bytes per sample block
+  uint32_t bytes;            // decoded bytes per run
+  uint32_t decodeBps;        // LZ4_decompress_safe_usingDict, as OtaSession unsliced
+  uint32_t slicedBps;        // LZ4SliceDecoder in 2 KB slices, as OtaSession sliced
+  bool iram;                 // built with CONFIG_ED_OTA_IRAM_DECODE
+};
+
+/// @brief the URL of the highest image of project in the listing at dirUrl.
+bool benchResolve(HttpSource &source, const char *dirUrl, const char *project,
+                  std::string &url);
+/// @brief reads url until maxBytes or maxUs; false when it cannot be opened
+/// or returns no body.
+bool benchTransport(HttpSource &source, const char *url, size_t maxBytes, uint32_t maxUs,
+                    TransportBench &out);
+/// @brief decodes about bytes of sample; false when out of memory.
+bool benchDecode(size_t bytes, DecodeBench &out);
+
+/// @brief writes one LZ4 block of at most decodedSize bytes (literal runs
+/// and short and long matches mixed as in firmware images) into dst and
+/// returns its compressed size, at most capacity. decodedSize is set to the
+/// exact decoded size. Deterministic for a seed.
+size_t lz4Sample(uint8_t *dst, size_t capacity, size_t &decodedSize, uint32_t seed);
+
+/// @brief JSON objects of the results, for the FWBM reply.
+std::string benchJson(const TransportBench &t);
+std::string benchJson(const DecodeBench &d);
+
+} // namespace ED_OTA
@@ -0,0 +1,327 @@
+#include "ED_OTA_core.h"
+#include "ED_OTA_platform.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <strings.h>
+
+namespace ED_OTA {
+
+static const char *TAG = "ED_OTA";
+
+static std::string regex_escape(const std::string &s) {
+    static const char *meta = ".^$*+?()[{\\|";
+    std::string escaped;
+    for (char c : s) {
+        if (strchr(meta, c))
+            escaped.push_back('\\');
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+// ---------- FirmwareScanner ----------
+
+/// @brief number of regex group g of str, 0 when the group did not match.
+static int group_int(const char *str, const regmatch_t &g) {
+    if (g.rm_so == -1 || g.rm_eo - g.rm_so >= 16)
+        return 0;
+    char temp[16];
+    int len = g.rm_eo - g.rm_so;
+    memcpy(temp, str + g.rm_so, len);
+    temp[len] = '\0';
+    return atoi(temp);
+}
+
+/// @brief parses [v]X[.Y[.Z[-N]]]; missing parts are 0 and left unlocked.
+void FirmwareScanner::parse_version_string(const char *ver_str, int out[4],
+                                           bool present[4]) {
+    out[0] = out[1] = out[2] = out[3] = 0;
+    for (int i = 0; i < 4; i++)
+        present[i] = false;
+    // POSIX ERE has no (?:...): the optional parts are groups 3, 5 and 7
+    regex_t re;
+    if (regcomp(&re,
+                "v?([[:digit:]]+)(\\.([[:digit:]]+))?(\\.([[:digit:]]+))?(-([[:digit:]]+))?",
+                REG_EXTENDED) == 0) {
+        regmatch_t m[8];
+        if (regexec(&re, ver_str, 8, m, 0) == 0) {
+            for (int i = 0; i < 4; i++) {
+                const regmatch_t &g = m[2 * i + 1];
+                present[i] = g.rm_so != -1;
+                out[i] = group_int(ver_str, g);
+            }
+        }
+        regfree(&re);
+    }
+}
+
+bool FirmwareScanner::matches_prefix(const int cand[4]) {
+    for (int i = 0; i < 4; i++) {
+        if (prefix_locked[i] && cand[i] != best_version[i])
+            return false;
+    }
+    return true;
+}
+
+bool FirmwareScanner::is_version_higher(int new_v[4]) {
+    for (int i = 0; i < 4; i++) {
+        if (new_v[i] > best_version[i])
+            return true;
+        if (new_v[i] < best_version[i])
+            return false;
+    }
+    return false;
+}
+
+FirmwareScanner::FirmwareScanner(const char *FwarePrj, const char *curFwareVer,
+                                 UpdateType mode)
+    : prjID(FwarePrj), regexValid(false), updateMode(mode),
+      matchingVersionFound(false) {
+    carryover[0] = '\0';
+    best_filename[0] = '\0';
+    best_version[0] = best_version[1] = best_version[2] = best_version[3] = 0;
+    for (int i = 0; i < 4; i++)
+        prefix_locked[i] = false;
+
+    // latest: candidates must beat the running version; specific: they must
+    // match the given parts of the target (best_version holds them until a
+    // candidate is found)
+    bool present[4];
+    parse_version_string(curFwareVer, best_version, present);
+    if (mode == UPDATE_TO_SPECIFIC) {
+        for (int i = 0; i < 4; i++)
+            prefix_locked[i] = present[i];
+    }
+
+    char pattern[256];
+    std::string escaped_prj = regex_escape(prjID);
+    snprintf(pattern, sizeof(pattern),
+             "href=\\\"(%s_v([[:digit:]]+)\\.([[:digit:]]+)\\.([[:digit:]]+)(-([[:digit:]]+))?[^\\\"]*\\.bin(\\.[a-z0-9]+)?)\\\"",
+             escaped_prj.c_str());
+    int ret = regcomp(&regex, pattern, REG_EXTENDED);
+    regexValid = ret == 0;
+    if (!regexValid) {
+        OTA_LOGE(TAG, "Regex compilation failed: %d", ret);
+    }
+}
+
+FirmwareScanner::~FirmwareScanner() {
+    if (regexValid)
+        regfree(&regex);
+}
+
+void FirmwareScanner::file_scanner_parse_chunk(const char *chunk,
+                                               size_t chunk_len) {
+    if (!regexValid)
+        return;
+    size_t carry_len = strlen(carryover);
+    memcpy(buffer, carryover, carry_len);
+    memcpy(buffer + carry_len, chunk, chunk_len);
+    buffer[carry_len + chunk_len] = '\0';
+
+    // groups: 1 file name, 2-4 major.minor.patch, 6 build
+    regmatch_t matches[8];
+    char *ptr = buffer;
+    while (regexec(&regex, ptr, 8, matches, 0) == 0) {
+        int len = matches[1].rm_eo - matches[1].rm_so;
+        if (len >= MAX_FILENAME_LEN) {
+            ptr += matches[0].rm_eo;
+            continue;
+        }
+        char filename[MAX_FILENAME_LEN];
+        memcpy(filename, ptr + matches[1].rm_so, len);
+        filename[len] = '\0';
+
+        int version[4];
+        for (int i = 0; i < 3; i++)
+            version[i] = group_int(ptr, matches[i + 2]);
+        version[3] = group_int(ptr, matches[6]);
+
+        OTA_LOGV(TAG, "Candidate: %s → %d.%d.%d-%d", filename, version[0], version[1],
+                 version[2], version[3]);
+
+        bool accept = false;
+        if (updateMode == UPDATE_TO_SPECIFIC) {
+            if (matches_prefix(version))
+                accept = !matchingVersionFound || is_version_higher(version);
+        } else {
+            accept = is_version_higher(version);
+        }
+
+        if (accept) {
+            snprintf(best_filename, MAX_FILENAME_LEN, "%s", filename);
+            memcpy(best_version, version, sizeof(version));
+            matchingVersionFound = true;
+        }
+
+        ptr += matches[0].rm_eo;
+    }
+
+    size_t total_len = carry_len + chunk_len;
+    if (total_len >= CARRYOVER_SIZE) {
+        memcpy(carryover, buffer + total_len - CARRYOVER_SIZE, CARRYOVER_SIZE);
+        carryover[CARRYOVER_SIZE] = '\0';
+    } else {
+        strcpy(carryover, buffer);
+    }
+}
+
+const char *FirmwareScanner::targetFwFile() {
+    return matchingVersionFound ? best_filename : nullptr;
+}
+
+// ---------- OtaAppInfo ----------
+
+static uint16_t le16(const uint8_t *p) { return p[0] | p[1] << 8; }
+
+bool OtaAppInfo::parse(const uint8_t *data, size_t len) {
+    const size_t descAt = 32;   // image header + first segment header
+    if (len < OTA_APP_HEADER_BYTES || data[0] != 0xE9)   // ESP_IMAGE_HEADER_MAGIC
+        return false;
+    if (le16(data + descAt) != 0x5432 || le16(data + descAt + 2) != 0xABCD)
+        return false;   // ESP_APP_DESC_MAGIC_WORD
+    chipId = le16(data + 12);
+    minChipRev = le16(data + 15);
+    maxChipRev = le16(data + 17);
+    memcpy(version, data + descAt + 16, sizeof(version));
+    memcpy(project, data + descAt + 48, sizeof(project));
+    version[sizeof(version) - 1] = '\0';
+    project[sizeof(project) - 1] = '\0';
+    return true;
+}
+
+const char *OtaAppCheck::reject(const OtaAppInfo &info) const {
+    if (chipId >= 0 && info.chipId != chipId)
+        return "built for another chip";
+    if (chipRev >= 0 && (chipRev < info.minChipRev ||
+                         (info.maxChipRev != 0 && info.maxChipRev != 0xFFFF &&
+                          chipRev > info.maxChipRev)))
+        return "chip revision out of the supported range";
+    if (project && strcmp(info.project, project) != 0)
+        return "built for another project";
+    if (version && strcmp(info.version, version) == 0)
+        return "same version as the running app";
+    return nullptr;
+}
+
+// ---------- OtaRelease ----------
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+const char *OtaRelease::set(const char *releaseUrl, const char *releaseVersion,
+                            const char *size, const char *digest, const char *codec) {
+    *this = {};
+    if (releaseUrl == nullptr || *releaseUrl == '\0')
+        return "no url";
+    if (strlen(releaseUrl) >= sizeof(url))
+        return "url too long";
+    if (codec && *codec && strcasecmp(codec, "lz4") != 0)
+        return "codec not supported";
+    if ((size && *size) != (digest && *digest))
+        return "size and sha256 go together";
+    if (digest && *digest) {
+        char *end;
+        unsigned long n = strtoul(size, &end, 10);
+        if (*end != '\0' || n == 0 || n > UINT32_MAX)
+            return "bad size";
+        if (strlen(digest) != 2 * OTA_DIGEST_SIZE)
+            return "bad sha256";
+        for (int i = 0; i < OTA_DIGEST_SIZE; i++) {
+            int hi = hexDigit(digest[2 * i]), lo = hexDigit(digest[2 * i + 1]);
+            if (hi < 0 || lo < 0)
+                return "bad sha256";
+            sha256[i] = (uint8_t)(hi << 4 | lo);
+        }
+        imageSize = (uint32_t)n;
+    }
+    strcpy(url, releaseUrl);
+    snprintf(version, sizeof(version), "%s", releaseVersion ? releaseVersion : "");
+    return nullptr;
+}
+
+/// @brief copies the value of "key" in the flat JSON object json into out,
+/// "" when the key is missing; false when the value does not fit.
+static bool jsonValue(const char *json, size_t len, const char *key, char *out, size_t outLen) {
+    const char *end = json + len;
+    size_t keyLen = strlen(key);
+    out[0] = '\0';
+    for (const char *p = json; p + keyLen + 2 <= end; p++) {
+        if (*p != '"' || p[keyLen + 1] != '"' || strncmp(p + 1, key, keyLen) != 0)
+            continue;
+        const char *v = p + keyLen + 2;
+        while (v < end && isspace((unsigned char)*v))
+            v++;
+        if (v == end || *v != ':')
+            continue;   // the key text was a value
+        for (v++; v < end && isspace((unsigned char)*v); v++)
+            ;
+        bool quoted = v < end && *v == '"';
+        const char *stop = v += quoted;
+        while (stop < end && (quoted ? *stop != '"' : !strchr(",} \t\r\n", *stop)))
+            stop++;
+        if ((size_t)(stop - v) >= outLen)
+            return false;
+        memcpy(out, v, stop - v);
+        out[stop - v] = '\0';
+        return true;
+    }
+    return true;
+}
+
+const char *OtaRelease::parse(const char *json, size_t len, bool *stage) {
+    char releaseUrl[OTA_RELEASE_URL_LEN + 1], releaseVersion[MAX_VERSION_LEN];
+    char size[16], digest[2 * OTA_DIGEST_SIZE + 1], codec[8], flag[8];
+    *this = {};
+    if (!jsonValue(json, len, "data", releaseUrl, sizeof(releaseUrl)))
+        return "url too long";
+    if (!jsonValue(json, len, "version", releaseVersion, sizeof(releaseVersion)))
+        return "version too long";
+    if (!jsonValue(json, len, "size", size, sizeof(size)))
+        return "bad size";
+    if (!jsonValue(json, len, "sha256", digest, sizeof(digest)))
+        return "bad sha256";
+    if (!jsonValue(json, len, "codec", codec, sizeof(codec)))
+        return "codec not supported";
+    if (!jsonValue(json, len, "stage", flag, sizeof(flag)))
+        flag[0] = '\0';
+    if (stage)
+        *stage = strcmp(flag, "1") == 0 || strcasecmp(flag, "true") == 0 ||
+                 strcasecmp(flag, "on") == 0;
+    return set(releaseUrl, releaseVersion, size, digest, codec);
+}
+
+bool otaReleaseTopic(char *topic, size_t len, const char *project) {
+    int n = snprintf(topic, len, OTA_RELEASE_TOPIC, project);
+    return n > 0 && (size_t)n < len;
+}
+
+const char *OtaRelease::file() const {
+    const char *slash = strrchr(url, '/');
+    return slash ? slash + 1 : url;
+}
+
+bool OtaRequest::sameTarget(const OtaRequest &other) const {
+    return benchmark == other.benchmark && dryRun == other.dryRun && stage == other.stage &&
+           strncmp(target, other.target, sizeof(target)) == 0 &&
+           strcmp(release.url, other.release.url) == 0;
+}
+
+bool OtaRequest::setTarget(const char *versionTarget) {
+    target[0] = '\0';
+    if (versionTarget == nullptr || strlen(versionTarget) == 0 ||
+        strcasecmp(versionTarget, "latest") == 0)
+        return true;
+    if (strlen(versionTarget) >= sizeof(target))
+        return false;
+    strcpy(target, versionTarget);
+    return true;
+}
+
+} // namespace ED_OTA
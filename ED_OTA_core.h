@@ -0,0 +1,165 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_core.h
+ * @brief platform-independent OTA definitions: buffer limits, image header,
+ * update request and firmware listing scanner.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-14
+ */
+// #endregion
+
+#pragma once
+
+#include "lz4.h"
+#include <regex.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPRESSED_BLOCK_SIZE 4096 // maximum compressed block size from HTTP
+#define DECOMPRESSED_BLOCK_SIZE                                                \
+  16384 // must be >= max decompressed output (16KB)
+#define CARRYOVER_SIZE 128
+#define MAX_FILENAME_LEN 128
+#define MAX_VERSION_LEN 32
+#define OTA_IMAGE_MAGIC 0x544F4445u // "EDOT" as a little-endian uint32
+#define OTA_IMAGE_FORMAT 1
+#define OTA_DIGEST_SIZE 32          // SHA-256
+#define OTA_APP_HEADER_BYTES 288    // esp_image_header_t, segment header, esp_app_desc_t
+#define OTA_RELEASE_URL_LEN 160
+#define OTA_RELEASE_TOPIC "fware/%s/release" // retained announcement, %s = project
+
+namespace ED_OTA {
+
+/// @brief scans firmware files in an HTTP directory listing to find the best
+/// candidate.
+struct FirmwareScanner {
+  enum UpdateType { UPDATE_TO_LATEST, UPDATE_TO_SPECIFIC };
+
+  FirmwareScanner(const char *FwarePrj, const char *curFwareVer,
+                  UpdateType mode);
+  ~FirmwareScanner();
+
+  void file_scanner_parse_chunk(const char *chunk, size_t chunk_len);
+  const char *targetFwFile();
+
+private:
+  const char *prjID;
+  regex_t regex;
+  bool regexValid;
+  UpdateType updateMode;
+
+  char buffer[COMPRESSED_BLOCK_SIZE + CARRYOVER_SIZE + 1];
+  char carryover[CARRYOVER_SIZE + 1];
+  char best_filename[MAX_FILENAME_LEN];
+  int best_version[4]; // major, minor, patch, build
+  bool prefix_locked[4];
+  bool matchingVersionFound;
+
+  bool is_version_higher(int new_v[4]);
+  void parse_version_string(const char *ver_str, int out[4], bool present[4]);
+  bool matches_prefix(const int cand[4]);
+
+  FirmwareScanner() = delete;
+};
+
+/**
+ * @brief optional header in front of the first block of a packed image, as
+ * written by the host packer (host/pack.cpp). All fields are little endian.
+ *
+ * Read as a block size, the magic exceeds COMPRESSED_BLOCK_SIZE, so a stream
+ * that starts with it cannot be a headerless image: old images stay valid and
+ * old decoders reject new ones instead of misreading them.
+ */
+struct OtaImageHeader {
+  uint32_t magic;                  // OTA_IMAGE_MAGIC
+  uint8_t format;                  // OTA_IMAGE_FORMAT
+  uint8_t reserved;
+  uint16_t headerSize;             // header bytes, later extensions included
+  uint32_t imageSize;              // decoded image bytes
+  uint32_t maxCompressed;          // largest compressed block
+  uint32_t maxBlock;               // largest decoded block
+  uint32_t window;                 // dictionary the blocks refer back to
+  uint8_t sha256[OTA_DIGEST_SIZE]; // digest of the decoded image
+  char project[32];                // NUL-padded, esp_app_desc_t::project_name
+  char version[MAX_VERSION_LEN];   // NUL-padded, esp_app_desc_t::version
+};
+static_assert(sizeof(OtaImageHeader) == 120, "OtaImageHeader is a wire format");
+
+/// @brief identity of an ESP-IDF application image, read from its first
+/// OTA_APP_HEADER_BYTES (esp_image_header_t and esp_app_desc_t).
+struct OtaAppInfo {
+  uint16_t chipId;      // esp_chip_id_t
+  uint16_t minChipRev;  // major * 100 + minor
+  uint16_t maxChipRev;  // 0 or 0xFFFF when not set
+  char project[32];     // esp_app_desc_t::project_name
+  char version[32];     // esp_app_desc_t::version
+
+  /// @brief false when data does not start with an application image.
+  bool parse(const uint8_t *data, size_t len);
+};
+
+/// @brief what an image must match before anything is written to the slot,
+/// see OtaSession::setAppCheck().
+struct OtaAppCheck {
+  int chipId;           // esp_chip_id_t of this chip, -1 = any
+  int chipRev;          // revision of this chip, major * 100 + minor, -1 = any
+  uint32_t slotSize;    // bytes of the target slot, 0 = unchecked
+  const char *project;  // project_name of the running app, nullptr = any
+  const char *version;  // version of the running app, refused; nullptr = unchecked
+
+  /// @brief nullptr when info passes, otherwise the reason it does not.
+  const char *reject(const OtaAppInfo &info) const;
+};
+
+/// @brief a release announced over MQTT (FWRA, see OTAmanager): a
+/// session given one fetches it directly instead of scanning the listing,
+/// when its file name is what the scan would pick.
+struct OtaRelease {
+  char url[OTA_RELEASE_URL_LEN];      // image URL, file named as in the listing
+  char version[MAX_VERSION_LEN];      // informational
+  uint32_t imageSize;                 // decoded image bytes, 0 = not announced
+  uint8_t sha256[OTA_DIGEST_SIZE];    // digest of the decoded image, with imageSize
+
+  /// @brief fills the release from the announcement fields (size, sha256,
+  /// version and codec may be nullptr). nullptr when they are valid,
+  /// otherwise the reason they are not; codec must be "lz4".
+  const char *set(const char *url, const char *version, const char *size,
+                  const char *sha256, const char *codec);
+  /// @brief fills the release from a message of the release topic: a flat
+  /// JSON object with the FWRA fields ("data" the URL, "version", "size",
+  /// "sha256", "codec", "stage"), string or bare values, other keys ignored.
+  /// stage (may be nullptr) gets the stage flag. Returns as set().
+  const char *parse(const char *json, size_t len, bool *stage);
+  /// @brief the file name part of url.
+  const char *file() const;
+};
+
+/// @brief the release topic of project (OTA_RELEASE_TOPIC); false if it does
+/// not fit in len.
+bool otaReleaseTopic(char *topic, size_t len, const char *project);
+
+/// @brief update request handed to the OTA worker through its mailbox queue.
+struct OtaRequest {
+  char target[MAX_VERSION_LEN]; // requested version (prefix), empty for latest
+  bool turbo;                   // max CPU/APB clocks, no Wi-Fi power save
+  uint16_t bwKBps;              // governor: bandwidth cap in KB/s, 0 = none
+  uint8_t cpuPct;               // governor: CPU share per slice, 0 = none
+  uint8_t maxLoadPct;           // governor: back off above this load, 0 = off
+  uint32_t stepBudgetUs;        // sliced decode/write budget per step, 0 = off
+  bool trace;                   // record the transfer timing, see ED_OTA_trace.h
+  bool dryRun;                  // decode into a DigestSink, leave the partitions alone
+  bool stage;                   // write and verify, but leave the boot partition (FWAC)
+  bool benchmark;               // measure transport, decode and flash instead (FWBM)
+  uint32_t benchBytes;          // benchmark: download bytes, 0 = default
+  int64_t replyId;              // message id of the result (benchmark, dry run), 0 = none
+  OtaRelease release;           // announced release to try before the listing, url "" = none
+
+  bool sameTarget(const OtaRequest &other) const;
+  /// @brief sets target ("latest" or empty for the latest version), false if
+  /// it does not fit.
+  bool setTarget(const char *versionTarget);
+};
+
+} // namespace ED_OTA
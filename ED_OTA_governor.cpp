@@ -0,0 +1,132 @@
+#include "ED_OTA_governor.h"
+#include "ED_OTA_core.h"
+#include "ED_OTA_platform.h"
+
+namespace ED_OTA {
+
+// written by the application, read by the OTA task: the 64-bit timestamp
+// needs the lock on 32-bit targets
+static OtaMutex app_load_mutex;
+static uint8_t app_load = 0;
+static int64_t app_load_us = 0;
+
+void OtaGovernor::reportLoad(uint8_t loadPct) {
+    OtaLock lock(app_load_mutex);
+    app_load = loadPct > 100 ? 100 : loadPct;
+    app_load_us = otaNowUs();
+}
+
+void OtaGovernor::configure(const GovernorLimits &limits) {
+    lim = limits;
+    if (lim.bandwidthBps && lim.burstBytes == 0)
+        lim.burstBytes = COMPRESSED_BLOCK_SIZE + sizeof(uint32_t);
+    if (lim.cpuBudgetUs > OTA_GOVERNOR_SLICE_US)
+        lim.cpuBudgetUs = OTA_GOVERNOR_SLICE_US;
+    isEnabled = lim.bandwidthBps || lim.cpuBudgetUs || lim.maxLoadPct;
+    tokens = lim.burstBytes;
+    lastRefillUs = sliceStartUs = 0;
+}
+
+uint32_t OtaGovernor::admit(int64_t nowUs) {
+    if (!isEnabled)
+        return 0;
+    int64_t wait = 0;
+
+    if (lim.bandwidthBps) {
+        if (lastRefillUs != 0) {
+            tokens += (nowUs - lastRefillUs) * lim.bandwidthBps / 1000000;
+            if (tokens > (int64_t)lim.burstBytes)
+                tokens = lim.burstBytes;
+        }
+        lastRefillUs = nowUs;
+        if (tokens < 0)
+            wait = -tokens * 1000000 / lim.bandwidthBps + 1;
+    }
+
+    if (lim.cpuBudgetUs) {
+        if (nowUs - sliceStartUs >= OTA_GOVERNOR_SLICE_US) {
+            sliceStartUs = nowUs;
+            sliceBusyUs = 0;
+        } else if (sliceBusyUs >= lim.cpuBudgetUs) {
+            int64_t sliceLeft = sliceStartUs + OTA_GOVERNOR_SLICE_US - nowUs;
+            if (sliceLeft > wait)
+                wait = sliceLeft;
+        }
+    }
+
+    if (lim.maxLoadPct) {
+        sampleLoad(nowUs);
+        if (backoffUs > wait)
+            wait = backoffUs;
+    }
+
+    if (wait > 0) {
+        if (deniedSinceUs == 0)
+            deniedSinceUs = nowUs;
+        return (uint32_t)wait;
+    }
+    if (deniedSinceUs != 0) {
+        throttled += nowUs - deniedSinceUs;
+        deniedSinceUs = 0;
+    }
+    return 0;
+}
+
+void OtaGovernor::charge(int64_t busyUs, uint32_t rxBytes) {
+    if (!isEnabled)
+        return;
+    tokens -= rxBytes;
+    sliceBusyUs += busyUs;
+}
+
+/// @brief exponential backoff while the load stays above maxLoadPct, decaying
+/// once it drops below.
+void OtaGovernor::sampleLoad(int64_t nowUs) {
+    if (nowUs - lastLoadSampleUs < OTA_GOVERNOR_LOAD_SAMPLE_US)
+        return;
+    lastLoadSampleUs = nowUs;
+
+    uint8_t pct;
+    int64_t reportedUs;
+    {
+        OtaLock lock(app_load_mutex);
+        pct = app_load;
+        reportedUs = app_load_us;
+    }
+    if (reportedUs != 0 && nowUs - reportedUs < OTA_GOVERNOR_LOAD_STALE_US)
+        load = pct;
+    else if (runtimeLoad(nowUs, pct))
+        load = pct;
+    else
+        return;   // no load source: leave the backoff as it is
+
+    if (load > lim.maxLoadPct) {
+        backoffUs = backoffUs ? backoffUs * 2 : OTA_GOVERNOR_BACKOFF_MIN_US;
+        if (backoffUs > OTA_GOVERNOR_BACKOFF_MAX_US)
+            backoffUs = OTA_GOVERNOR_BACKOFF_MAX_US;
+    } else {
+        backoffUs /= 2;
+        if (backoffUs < OTA_GOVERNOR_BACKOFF_MIN_US)
+            backoffUs = 0;
+    }
+}
+
+/// @brief load of the calling core from the platform's idle time counter
+/// (the idle task's run time counter on ESP-IDF).
+bool OtaGovernor::runtimeLoad(int64_t nowUs, uint8_t &loadPct) {
+    static uint32_t prevIdle = 0;
+    static int64_t prevUs = 0;
+    uint32_t idle;
+    if (!otaIdleUs(idle))
+        return false;
+    bool valid = prevUs != 0 && nowUs > prevUs;
+    if (valid) {
+        int64_t idlePct = (int64_t)(uint32_t)(idle - prevIdle) * 100 / (nowUs - prevUs);
+        loadPct = idlePct >= 100 ? 0 : (uint8_t)(100 - idlePct);
+    }
+    prevIdle = idle;
+    prevUs = nowUs;
+    return valid;
+}
+
+} // namespace ED_OTA
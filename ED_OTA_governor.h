@@ -0,0 +1,80 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_governor.h
+ * @brief resource governor bounding the impact of a background OTA session
+ * on the host application (bandwidth, CPU time, load backoff).
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-08
+ */
+// #endregion
+
+#pragma once
+
+#include <stdint.h>
+
+#define OTA_GOVERNOR_SLICE_US 20000     // CPU budget accounting period
+#define OTA_GOVERNOR_LOAD_SAMPLE_US 100000
+#define OTA_GOVERNOR_LOAD_STALE_US 2000000
+#define OTA_GOVERNOR_BACKOFF_MIN_US 10000
+#define OTA_GOVERNOR_BACKOFF_MAX_US 500000
+
+namespace ED_OTA {
+
+/// @brief limits enforced by OtaGovernor; 0 disables the corresponding limit.
+struct GovernorLimits {
+  uint32_t bandwidthBps;  // token-bucket rate on received bytes
+  uint32_t burstBytes;    // bucket depth, 0 for one compressed block
+  uint32_t cpuBudgetUs;   // busy time allowed per OTA_GOVERNOR_SLICE_US
+  uint8_t maxLoadPct;     // back off while the CPU/application load is above
+};
+
+/**
+ * @brief decides when the next OTA step may run.
+ *
+ * The session asks admit() before each step and reports the step's cost with
+ * charge(). Waiting is left to the driver, so the governor works both for the
+ * worker task (which sleeps) and for APP_POLL mode (which returns to the
+ * application loop).
+ */
+class OtaGovernor {
+public:
+  void configure(const GovernorLimits &limits);
+  bool enabled() const { return isEnabled; }
+
+  /// @brief microseconds to wait before the next step, 0 to proceed.
+  uint32_t admit(int64_t nowUs);
+  /// @brief accounts for a step that kept the CPU busy for busyUs and
+  /// received rxBytes.
+  void charge(int64_t busyUs, uint32_t rxBytes);
+
+  /// @brief total time the session has been held back.
+  int64_t throttledUs() const { return throttled; }
+
+  /// @brief load reported by the application (0-100), used instead of the
+  /// FreeRTOS runtime statistics while fresh.
+  static void reportLoad(uint8_t loadPct);
+
+private:
+  GovernorLimits lim = {};
+  bool isEnabled = false;
+
+  int64_t tokens = 0;  // bytes available, negative when in debt
+  int64_t lastRefillUs = 0;
+
+  int64_t sliceStartUs = 0;
+  int64_t sliceBusyUs = 0;
+
+  int64_t backoffUs = 0;
+  int64_t lastLoadSampleUs = 0;
+  uint8_t load = 0;
+
+  int64_t deniedSinceUs = 0;
+  int64_t throttled = 0;
+
+  void sampleLoad(int64_t nowUs);
+  static bool runtimeLoad(int64_t nowUs, uint8_t &loadPct);
+};
+
+} // namespace ED_OTA
@@ -0,0 +1,61 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_health.cpp
+ * @brief post-update health probes, see ED_OTA_health.h.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "ED_OTA_health.h"
+
+static const char *TAG = "ED_OTA";
+
+namespace ED_OTA {
+
+bool OtaHealth::add(const char *name, Probe probe, void *arg, uint32_t deadlineMs) {
+    OtaLock lock(mutex);
+    if (count == OTA_HEALTH_MAX_PROBES || probe == nullptr) {
+        OTA_LOGE(TAG, "Health probe %s not registered", name);
+        return false;
+    }
+    probes[count] = {name, probe, arg, deadlineMs, false};
+    count++;
+    return true;
+}
+
+size_t OtaHealth::size() {
+    OtaLock lock(mutex);
+    return count;
+}
+
+OtaHealth::Result OtaHealth::run(int64_t startUs, int64_t nowUs) {
+    size_t n = size();   // probes are called without the lock: they may add()
+    size_t passedNow = 0;
+    for (size_t i = 0; i < n; i++) {
+        Entry &e = probes[i];
+        Result r = e.passed ? PASS : e.probe(e.arg);
+        if (r == PASS && !e.passed) {
+            e.passed = true;
+            OTA_LOGI(TAG, "Health probe %s passed after %u ms", e.name,
+                     (unsigned)((nowUs - startUs) / 1000));
+        }
+        if (r == PASS) {
+            passedNow++;
+            continue;
+        }
+        if (r == FAIL || nowUs - startUs > (int64_t)e.deadlineMs * 1000) {
+            OTA_LOGE(TAG, "Health probe %s %s", e.name,
+                     r == FAIL ? "failed" : "missed its deadline");
+            failedName = e.name;
+            passedCount = passedNow;
+            return FAIL;
+        }
+    }
+    passedCount = passedNow;
+    return n > 0 && passedNow == n ? PASS : PENDING;
+}
+
+} // namespace ED_OTA
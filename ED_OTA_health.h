@@ -0,0 +1,67 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_health.h
+ * @brief registry of post-update health probes: components register checks
+ * with deadlines, OTAmanager runs them while the new image is
+ * PENDING_VERIFY and confirms or rolls back on their verdict.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_platform.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_HEALTH_MAX_PROBES 8
+#define OTA_HEALTH_POLL_MS 500          // between probe rounds
+#define OTA_HEALTH_WAIT_MS 30000        // without probes by then, FWCO is left to confirm
+
+namespace ED_OTA {
+
+/**
+ * @brief health probes with deadlines.
+ *
+ * A probe is polled each round until it returns PASS, which is kept; FAIL,
+ * or no PASS by its deadline, fails the whole check. Probes are added from
+ * any task, rounds run on one (the OTA worker or the poll() loop).
+ */
+class OtaHealth {
+public:
+  enum Result { PENDING, PASS, FAIL };
+  /// @brief must not block: PENDING when the condition is not met yet.
+  typedef Result (*Probe)(void *arg);
+
+  /// @brief name must outlive the registry; deadlineMs counts from the
+  /// startUs given to run(). False when the registry is full.
+  bool add(const char *name, Probe probe, void *arg, uint32_t deadlineMs);
+
+  /// @brief polls the probes not passed yet: PASS once all have passed,
+  /// FAIL when one failed or missed its deadline (see failed()).
+  Result run(int64_t startUs, int64_t nowUs);
+
+  size_t size();
+  size_t passed() const { return passedCount; }
+  /// @brief the probe that failed the check, nullptr before that.
+  const char *failed() const { return failedName; }
+
+private:
+  struct Entry {
+    const char *name;
+    Probe probe;
+    void *arg;
+    uint32_t deadlineMs;
+    bool passed;
+  };
+  Entry probes[OTA_HEALTH_MAX_PROBES];
+  size_t count = 0;   // entries below count are complete; guarded by mutex
+  size_t passedCount = 0;
+  const char *failedName = nullptr;
+  OtaMutex mutex;
+};
+
+} // namespace ED_OTA
@@ -0,0 +1,134 @@
+#include "ED_OTA_lz4slice.h"
+#include <string.h>
+
+namespace ED_OTA {
+
+#define LZ4_MINMATCH 4
+#define LZ4_RUN_MASK 15
+
+void LZ4SliceDecoder::begin(const uint8_t *source, size_t sourceSize,
+                            uint8_t *dest, size_t destCapacity,
+                            const uint8_t *dictionary, size_t dictionarySize) {
+    src = source;
+    srcSize = sourceSize;
+    dst = dest;
+    dstCapacity = destCapacity;
+    dict = dictionary;
+    dictSize = dictionary ? dictionarySize : 0;
+    phase = TOKEN;
+    ip = op = 0;
+    pendingLiterals = pendingMatch = matchOffset = 0;
+}
+
+/// @brief adds the 255-terminated length extension bytes to length.
+bool ED_OTA_IRAM LZ4SliceDecoder::readLength(size_t &length) {
+    uint8_t b;
+    do {
+        if (ip >= srcSize)
+            return false;
+        b = src[ip++];
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+LZ4SliceDecoder::Result ED_OTA_IRAM LZ4SliceDecoder::decode(size_t maxOut) {
+    size_t limit = op + maxOut;
+    if (limit > dstCapacity || limit < op)
+        limit = dstCapacity;
+
+    while (true) {
+        switch (phase) {
+            case TOKEN: {
+                if (ip >= srcSize)
+                    return ERROR;   // a block always ends with literals
+                uint8_t token = src[ip++];
+                size_t literals = token >> 4;
+                if (literals == LZ4_RUN_MASK && !readLength(literals))
+                    return ERROR;
+                if (literals > srcSize - ip || literals > dstCapacity - op)
+                    return ERROR;
+                pendingLiterals = literals;
+                matchNibble = token & LZ4_RUN_MASK;
+                phase = LITERALS;
+            }
+            // fall through
+            case LITERALS: {
+                size_t n = pendingLiterals;
+                if (n > limit - op)
+                    n = limit - op;
+                memcpy(dst + op, src + ip, n);
+                ip += n;
+                op += n;
+                pendingLiterals -= n;
+                if (pendingLiterals)
+                    return MORE;
+                if (ip == srcSize)
+                    return DONE;   // last sequence: literals only
+
+                if (srcSize - ip < 2)
+                    return ERROR;
+                matchOffset = src[ip] | (src[ip + 1] << 8);
+                ip += 2;
+                size_t length = matchNibble;
+                if (length == LZ4_RUN_MASK && !readLength(length))
+                    return ERROR;
+                length += LZ4_MINMATCH;
+                if (matchOffset == 0 || matchOffset > op + dictSize ||
+                    length > dstCapacity - op)
+                    return ERROR;
+                pendingMatch = length;
+                phase = MATCH;
+            }
+            // fall through
+            case MATCH: {
+                size_t n = pendingMatch;
+                if (n > limit - op)
+                    n = limit - op;
+                pendingMatch -= n;
+                while (n) {
+                    size_t chunk;
+                    if (matchOffset > op) {
+                        // source still in the dictionary
+                        size_t back = matchOffset - op;
+                        chunk = n < back ? n : back;
+                        memcpy(dst + op, dict + dictSize - back, chunk);
+                    } else if (matchOffset >= n) {
+                        chunk = n;
+                        memcpy(dst + op, dst + op - matchOffset, chunk);
+                    } else {
+                        // overlapping copy: repeat the last matchOffset bytes
+                        chunk = matchOffset;
+                        memcpy(dst + op, dst + op - matchOffset, chunk);
+                    }
+                    op += chunk;
+                    n -= chunk;
+                }
+                if (pendingMatch)
+                    return MORE;
+                phase = TOKEN;
+                if (op >= limit)
+                    return MORE;
+                break;
+            }
+        }
+    }
+}
+
+int ED_OTA_IRAM windowAppend(uint8_t *window, int used, int windowSize,
+                             const uint8_t *data, int len) {
+    if (len >= windowSize) {
+        memcpy(window, data + len - windowSize, windowSize);
+        return windowSize;
+    }
+    if (used + len <= windowSize) {
+        memcpy(window + used, data, len);
+        return used + len;
+    }
+    int overflow = used + len - windowSize;
+    memmove(window, window + overflow, used - overflow);
+    memcpy(window + (windowSize - len), data, len);
+    return windowSize;
+}
+
+} // namespace ED_OTA
@@ -0,0 +1,79 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_lz4slice.h
+ * @brief resumable LZ4 block decoder producing output in bounded slices.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-10
+ */
+// #endregion
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#ifdef ESP_PLATFORM
+#include <sdkconfig.h>
+#endif
+
+#if CONFIG_ED_OTA_IRAM_DECODE
+#include <esp_attr.h>
+#define ED_OTA_IRAM IRAM_ATTR // decode hot path, see Kconfig
+#define ED_OTA_IRAM_DECODE 1
+#else
+#define ED_OTA_IRAM
+#define ED_OTA_IRAM_DECODE 0
+#endif
+
+namespace ED_OTA {
+
+/**
+ * @brief decodes one LZ4 block (with an external dictionary, as
+ * LZ4_setStreamDecode + LZ4_decompress_safe_continue do) in resumable slices.
+ *
+ * LZ4_decompress_safe_partial can stop early but cannot resume; this decoder
+ * keeps its position inside literal runs and matches, so every call to
+ * decode() produces at most maxOut bytes and the next call continues where
+ * the previous one stopped. All reads and writes are bounds checked.
+ */
+class LZ4SliceDecoder {
+public:
+  enum Result { MORE, DONE, ERROR };
+
+  /// @brief starts a block: src/srcSize compressed input, dst/dstCapacity
+  /// output, dict/dictSize the previously decoded data (may be empty).
+  void begin(const uint8_t *src, size_t srcSize, uint8_t *dst,
+             size_t dstCapacity, const uint8_t *dict, size_t dictSize);
+  /// @brief decodes up to maxOut more bytes.
+  Result decode(size_t maxOut);
+  /// @brief bytes decoded so far in the current block.
+  size_t produced() const { return op; }
+
+private:
+  enum Phase { TOKEN, LITERALS, MATCH };
+
+  const uint8_t *src = nullptr;
+  size_t srcSize = 0;
+  uint8_t *dst = nullptr;
+  size_t dstCapacity = 0;
+  const uint8_t *dict = nullptr;
+  size_t dictSize = 0;
+
+  Phase phase = TOKEN;
+  size_t ip = 0;
+  size_t op = 0;
+  size_t pendingLiterals = 0;
+  size_t pendingMatch = 0;
+  size_t matchOffset = 0;
+  uint8_t matchNibble = 0;
+
+  bool readLength(size_t &length);
+};
+
+/// @brief keeps the last windowSize bytes of decoded output as the dictionary
+/// of the next block; returns the new dictionary size.
+int windowAppend(uint8_t *window, int used, int windowSize, const uint8_t *data,
+                 int len);
+
+} // namespace ED_OTA
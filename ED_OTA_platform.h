@@ -0,0 +1,108 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_platform.h
+ * @brief interfaces between the OTA engine and the platform it runs on:
+ * HTTP source, image sink, clock, logging and locking.
+ *
+ * The engine (session, scanner, governor, decoders) only uses what is
+ * declared here. ESP-IDF implementations live in platform/esp, POSIX ones in
+ * platform/posix; the build puts exactly one of these directories on the
+ * include path, which selects ED_OTA_port.h (logging macros, OtaMutex,
+ * OtaSha256).
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-14
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_port.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_READ_AGAIN (-2) // HttpSource::read: no data yet, try again
+
+namespace ED_OTA {
+
+/// @brief a GET request whose body is read incrementally.
+class HttpSource {
+public:
+  virtual ~HttpSource() {}
+  /// @brief sends the request for url and receives the response headers.
+  /// False on connection or protocol errors; an HTTP error status is not a
+  /// failure, see status().
+  virtual bool open(const char *url) = 0;
+  /// @brief HTTP status code of the open response.
+  virtual int status() = 0;
+  /// @brief Content-Length of the open response, -1 when unknown.
+  virtual int64_t contentLength() = 0;
+  /// @brief reads up to len body bytes: the number of bytes read, 0 at the
+  /// end of the body, OTA_READ_AGAIN when nothing arrived yet, other
+  /// negative values on errors.
+  virtual int read(char *buf, size_t len) = 0;
+  /// @brief ends the request; safe to call when nothing is open.
+  virtual void close() = 0;
+};
+
+/// @brief destination of the decoded firmware image.
+class OtaSink {
+public:
+  /// @brief what the device already holds of an image, see holds().
+  enum Held {
+    HELD_NONE,     // not held: download it
+    HELD_RUNNING,  // it is the running image: nothing to do
+    HELD_STAGED    // complete in the slot begin() would write: activate() it
+  };
+
+  virtual ~OtaSink() {}
+  /// @brief looks for the image with this SHA-256 and size in the device's
+  /// slots; sinks that cannot tell return HELD_NONE.
+  virtual Held holds(const uint8_t *digest, size_t imageSize) {
+    (void)digest;
+    (void)imageSize;
+    return HELD_NONE;
+  }
+  /// @brief makes the staged image found by holds() the boot image.
+  virtual bool activate() { return false; }
+  /// @brief prepares the target slot; sequentialErase erases while writing
+  /// instead of all at once.
+  virtual bool begin(bool sequentialErase) = 0;
+  virtual bool write(const uint8_t *data, size_t len) = 0;
+  /// @brief closes and validates the image and makes it the boot image.
+  virtual bool finish() = 0;
+  /// @brief discards an image that was begun but not finished.
+  virtual void abort() = 0;
+};
+
+/// @brief what a session runs against. The caller owns source and sink,
+/// which must outlive the session.
+struct OtaContext {
+  HttpSource *source;
+  OtaSink *sink;
+  const char *project; // firmware project, prefix of the image file names
+  const char *version; // running firmware version, vX.Y.Z-N
+};
+
+/// @brief monotonic time in microseconds.
+int64_t otaNowUs();
+/// @brief blocks the calling task for about us microseconds.
+void otaSleepUs(uint32_t us);
+/// @brief idle time accumulated by the calling core, in microseconds;
+/// false when the platform does not track it.
+bool otaIdleUs(uint32_t &idleUs);
+
+/// @brief OtaMutex scope guard.
+class OtaLock {
+public:
+  explicit OtaLock(OtaMutex &mutex) : m(mutex) { m.lock(); }
+  ~OtaLock() { m.unlock(); }
+
+private:
+  OtaMutex &m;
+  OtaLock(const OtaLock &) = delete;
+  OtaLock &operator=(const OtaLock &) = delete;
+};
+
+} // namespace ED_OTA
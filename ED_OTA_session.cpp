@@ -0,0 +1,677 @@
+#include "ED_OTA_session.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace ED_OTA {
+
+static const char *TAG = "ED_OTA";
+
+OtaSession::OtaSession(const OtaRequest &req, const char *storageUrl,
+                       const char *fallbackUrl, const OtaContext &context)
+    : request(req), ctx(context), urls{storageUrl, fallbackUrl} {
+    m.wifiPsBefore = -1;
+    m.stepMaxState = OTA_STEP_NONE;
+    cBuffer = (uint8_t *)malloc(COMPRESSED_BLOCK_SIZE);
+    dBuffer = (uint8_t *)malloc(DECOMPRESSED_BLOCK_SIZE);
+    dictBuffer = (uint8_t *)malloc(LZ4_DICT_SIZE);
+}
+
+OtaSession::~OtaSession() {
+    release();
+    delete fwScanner;
+}
+
+const char *OtaSession::stateName(State s) {
+    switch (s) {
+        case RESOLVE:   return "RESOLVE";
+        case CONNECT:   return "CONNECT";
+        case FETCH:     return "FETCH";
+        case DECODE:    return "DECODE";
+        case WRITE:     return "WRITE";
+        case VERIFY:    return "VERIFY";
+        case DONE:      return "DONE";
+        case FAILED:    return "FAILED";
+        case CANCELLED: return "CANCELLED";
+        case CURRENT:   return "CURRENT";
+    }
+    return s == (State)OTA_STEP_NONE ? "none" : "?";
+}
+
+void OtaSession::setStepBudget(uint32_t budgetUs) {
+    stepBudget = budgetUs;
+    m.stepBudgetUs = budgetUs;
+}
+
+void OtaSession::setTurbo(const TurboProfile &profile) {
+    turboProfile = profile;
+    turboRequested = true;
+}
+
+GovernorLimits OtaSession::limitsFor(const OtaRequest &request) {
+    GovernorLimits limits = {};
+    limits.bandwidthBps = request.bwKBps * 1024u;
+    limits.cpuBudgetUs = request.cpuPct * OTA_GOVERNOR_SLICE_US / 100;
+    limits.maxLoadPct = request.maxLoadPct;
+    return limits;
+}
+
+const char *OtaSession::targetFile() const {
+    if (fwScanner)
+        return fwScanner->targetFwFile();
+    return failedFile[0] ? failedFile : nullptr;
+}
+
+OtaSession::State OtaSession::step() {
+    if (finished())
+        return curState;
+    if (cancelRequested) {
+        OTA_LOGW(TAG, "OTA cancelled in %s after %zu bytes", stateName(curState),
+                 totalWritten);
+        curState = CANCELLED;
+        release();
+        return curState;
+    }
+    if (m.startUs == 0) {
+        m.startUs = otaNowUs();
+        m.cpuMhzBefore = m.cpuMhzDuring = (uint16_t)OtaTurbo::cpuMhz();
+        if (turboRequested)
+            turbo.apply(turboProfile, m);
+    }
+    if (!cBuffer || !dBuffer || !dictBuffer) {
+        OTA_LOGE(TAG, "Memory allocation failed");
+        fail();
+        return curState;
+    }
+
+    int64_t t0 = otaNowUs();
+    waitUs = governor.admit(t0);
+    if (waitUs)
+        return curState;
+    size_t rx0 = rxBytes;
+
+    State stepped = curState;
+    switch (curState) {
+        case RESOLVE: stepResolve(); break;
+        case CONNECT: stepConnect(); break;
+        case FETCH:   stepFetch();   break;
+        case DECODE:  stepDecode();  break;
+        case WRITE:   stepWrite();   break;
+        case VERIFY:  stepVerify();  break;
+        default: break;
+    }
+    int64_t took = otaNowUs() - t0;
+    governor.charge(took, rxBytes - rx0);
+    if (stepped == FETCH)
+        fetchUs += took;
+    else if (stepped == DECODE)
+        decodeUs += took;
+    else if (stepped == WRITE)
+        writeUs += took;
+    if ((stepped == FETCH || stepped == DECODE || stepped == WRITE) && took > m.stepMaxUs) {
+        m.stepMaxUs = (uint32_t)took;
+        m.stepMaxState = (uint8_t)stepped;
+    }
+    return curState;
+}
+
+OtaSession::State OtaSession::poll(uint32_t budgetUs) {
+    int64_t start = otaNowUs();
+    do {
+        step();
+    } while (!finished() && waitUs == 0 &&
+             otaNowUs() - start < (int64_t)budgetUs);
+    return curState;
+}
+
+// ---------- steps ----------
+
+void OtaSession::stepResolve() {
+    if (!releaseTried && request.release.url[0]) {
+        releaseTried = true;
+        if (resolveRelease())
+            return;
+    }
+    if (fwScanner == nullptr) {
+        const char *version = request.target[0] ? request.target : ctx.version;
+        fwScanner = new FirmwareScanner(ctx.project, version,
+                                        request.target[0] ? FirmwareScanner::UPDATE_TO_SPECIFIC
+                                                          : FirmwareScanner::UPDATE_TO_LATEST);
+        if (openSource(urls[urlIndex]))
+            return;
+        // falls through to the next listing below
+    } else {
+        // listing chunks are NUL-terminated for the scanner: keep one byte spare
+        int bytes_read = ctx.source->read((char *)cBuffer, COMPRESSED_BLOCK_SIZE - 1);
+        if (bytes_read == OTA_READ_AGAIN)
+            return;
+        if (bytes_read > 0) {
+            rxBytes += bytes_read;
+            cBuffer[bytes_read] = '\0';
+            fwScanner->file_scanner_parse_chunk((char *)cBuffer, bytes_read);
+            return;
+        }
+        if (bytes_read < 0)
+            OTA_LOGE(TAG, "HTTP read error: %d", bytes_read);
+        ctx.source->close();
+
+        if (bytes_read == 0 && fwScanner->targetFwFile() != nullptr) {
+            fullUrl = urls[urlIndex] + std::string(fwScanner->targetFwFile());
+            OTA_LOGI(TAG, "OTA: launching update with file <%s>",
+                     fwScanner->targetFwFile());
+            curState = CONNECT;
+            return;
+        }
+    }
+
+    // this listing failed or holds no candidate: move to the fallback
+    delete fwScanner;
+    fwScanner = nullptr;
+    if (urlIndex == 0 && urls[1] != nullptr) {
+        OTA_LOGW(TAG, "Primary scan failed, trying fallback...");
+        urlIndex = 1;
+    } else {
+        OTA_LOGE(TAG, "Fallback scan also failed, no target firmware found");
+        fail();
+    }
+}
+
+/// @brief takes the announced release when the listing scan would pick its
+/// file: its URL is fetched directly, and a release announced with its digest
+/// is checked against the device before any request. False to scan instead.
+bool OtaSession::resolveRelease() {
+    const OtaRelease &rel = request.release;
+    const char *version = request.target[0] ? request.target : ctx.version;
+    fwScanner = new FirmwareScanner(ctx.project, version,
+                                    request.target[0] ? FirmwareScanner::UPDATE_TO_SPECIFIC
+                                                      : FirmwareScanner::UPDATE_TO_LATEST);
+    std::string href = "href=\"" + std::string(rel.file()) + "\"";
+    fwScanner->file_scanner_parse_chunk(href.c_str(), href.size());
+    if (fwScanner->targetFwFile() == nullptr) {
+        OTA_LOGI(TAG, "Announced release %s is not a candidate, scanning the listing",
+                 rel.file());
+        delete fwScanner;
+        fwScanner = nullptr;
+        return false;
+    }
+
+    releaseUsed = true;
+    if (rel.imageSize) {
+        snprintf(image.project, sizeof(image.project), "%s", ctx.project);
+        snprintf(image.version, sizeof(image.version), "%s", rel.version);
+        image.imageSize = rel.imageSize;
+        memcpy(image.sha256, rel.sha256, sizeof(image.sha256));
+        if (skipHeldImage())
+            return true;
+        if (appCheckSet && appCheck.slotSize && rel.imageSize > appCheck.slotSize) {
+            OTA_LOGE(TAG, "Announced image of %u bytes does not fit the %u byte slot",
+                     (unsigned)rel.imageSize, (unsigned)appCheck.slotSize);
+            fail();
+            return true;
+        }
+        imageDigest = new OtaSha256();   // verifies headerless images too
+    }
+    fullUrl = rel.url;
+    OTA_LOGI(TAG, "OTA: launching update with announced release <%s>", fullUrl.c_str());
+    curState = CONNECT;
+    return true;
+}
+
+/// @brief the announced release could not be fetched: forgets it and goes
+/// back to RESOLVE to scan the listing as usual. False when fullUrl is not
+/// the announced release.
+bool OtaSession::dropRelease() {
+    if (!releaseUsed)
+        return false;
+    OTA_LOGW(TAG, "Announced release <%s> unavailable, scanning the listing", fullUrl.c_str());
+    ctx.source->close();
+    fullUrl.clear();
+    releaseUsed = false;   // releaseTried stays set: it is not tried again
+    image = {};
+    delete imageDigest;
+    imageDigest = nullptr;
+    delete fwScanner;
+    fwScanner = nullptr;
+    curState = RESOLVE;
+    return true;
+}
+
+void OtaSession::stepConnect() {
+    if (!openSource(fullUrl.c_str())) {
+        if (!dropRelease())
+            fail();
+        return;
+    }
+
+    int status = ctx.source->status();
+    OTA_LOGI(TAG, "HTTP status code: %d", status);
+    if (status != 200) {
+        if (dropRelease())
+            return;
+        OTA_LOGE(TAG, "Unexpected HTTP status — aborting");
+        fail();
+        return;
+    }
+
+    OTA_LOGI(TAG, "Starting OTA read loop...");
+    headerFill = 0;
+    curState = FETCH;
+}
+
+void OtaSession::stepFetch() {
+    if (imageFill < imageEnd) {
+        fetchImageHeader();
+        return;
+    }
+    if (headerFill < sizeof(blockSize)) {
+        int bytes_read = ctx.source->read((char *)&blockSize + headerFill,
+                                          sizeof(blockSize) - headerFill);
+        if (bytes_read == OTA_READ_AGAIN)
+            return;
+        if (bytes_read == 0 && headerFill == 0) {
+            OTA_LOGI(TAG, "End of OTA data stream");
+            curState = VERIFY;
+            return;
+        }
+        if (bytes_read <= 0) {
+            OTA_LOGE(TAG, "Failed to read block size (got %d)", bytes_read);
+            fail();
+            return;
+        }
+        headerFill += bytes_read;
+        rxBytes += bytes_read;
+        if (headerFill < sizeof(blockSize))
+            return;
+
+        if (blockSize == OTA_IMAGE_MAGIC && totalCompressed == 0) {
+            image.magic = blockSize;
+            imageFill = sizeof(blockSize);
+            imageEnd = sizeof(image);
+            totalCompressed = imageFill;
+            return;
+        }
+        if (blockSize > COMPRESSED_BLOCK_SIZE) {
+            OTA_LOGE(TAG, "Compressed block too large: %u bytes", (unsigned)blockSize);
+            fail();
+            return;
+        }
+        blockFill = 0;
+    }
+
+    int bytes_read = ctx.source->read((char *)cBuffer + blockFill, blockSize - blockFill);
+    if (bytes_read == OTA_READ_AGAIN)
+        return;
+    if (bytes_read < 0) {
+        OTA_LOGE(TAG, "HTTP read error: %d", bytes_read);
+        fail();
+        return;
+    }
+    if (bytes_read == 0 && blockFill < blockSize) {
+        OTA_LOGE(TAG, "Incomplete block read: expected %u, got %zu",
+                 (unsigned)blockSize, blockFill);
+        fail();
+        return;
+    }
+    blockFill += bytes_read;
+    rxBytes += bytes_read;
+    if (blockFill < blockSize)
+        return;
+
+    totalCompressed += sizeof(blockSize) + blockSize;
+    curState = DECODE;
+}
+
+/// @brief reads the image header; bytes past sizeof(image) belong to later
+/// format extensions and are skipped.
+void OtaSession::fetchImageHeader() {
+    char *dst = (char *)cBuffer;
+    size_t want = std::min<size_t>(imageEnd - imageFill, COMPRESSED_BLOCK_SIZE);
+    if (imageFill < sizeof(image)) {
+        dst = (char *)&image + imageFill;
+        want = sizeof(image) - imageFill;
+    }
+    int bytes_read = ctx.source->read(dst, want);
+    if (bytes_read == OTA_READ_AGAIN)
+        return;
+    if (bytes_read <= 0) {
+        OTA_LOGE(TAG, "Incomplete image header: expected %zu, got %zu", imageEnd, imageFill);
+        fail();
+        return;
+    }
+    imageFill += bytes_read;
+    rxBytes += bytes_read;
+    totalCompressed += bytes_read;
+    if (imageFill == sizeof(image)) {
+        if (!checkImageHeader()) {
+            fail();
+            return;
+        }
+        if (finished())
+            return;   // the device already holds the image
+        imageEnd = image.headerSize;
+    }
+    if (imageFill == imageEnd)
+        headerFill = 0;   // the first block follows
+}
+
+bool OtaSession::checkImageHeader() {
+    if (image.format != OTA_IMAGE_FORMAT || image.headerSize < sizeof(image)) {
+        OTA_LOGE(TAG, "Unsupported image format %u (%u byte header)", image.format,
+                 image.headerSize);
+        return false;
+    }
+    if (image.maxCompressed > COMPRESSED_BLOCK_SIZE || image.maxBlock > DECOMPRESSED_BLOCK_SIZE ||
+        image.window > LZ4_DICT_SIZE) {
+        OTA_LOGE(TAG, "Image needs a larger decoder: blocks %u/%u bytes, window %u",
+                 (unsigned)image.maxCompressed, (unsigned)image.maxBlock,
+                 (unsigned)image.window);
+        return false;
+    }
+    image.project[sizeof(image.project) - 1] = '\0';
+    image.version[sizeof(image.version) - 1] = '\0';
+    if (image.project[0] && strcmp(image.project, ctx.project) != 0) {
+        OTA_LOGE(TAG, "Image is for project %s, not %s", image.project, ctx.project);
+        return false;
+    }
+    if (releaseUsed && request.release.imageSize &&
+        (image.imageSize != request.release.imageSize ||
+         memcmp(image.sha256, request.release.sha256, sizeof(image.sha256)) != 0)) {
+        OTA_LOGE(TAG, "Image %s %s does not match the announced release", image.project,
+                 image.version);
+        return false;
+    }
+    if (skipHeldImage())
+        return true;
+    if (appCheckSet && appCheck.slotSize && image.imageSize > appCheck.slotSize) {
+        OTA_LOGE(TAG, "Image of %u bytes does not fit the %u byte slot",
+                 (unsigned)image.imageSize, (unsigned)appCheck.slotSize);
+        return false;
+    }
+    if (appCheckSet && appCheck.version && strcmp(image.version, appCheck.version) == 0) {
+        OTA_LOGE(TAG, "Image %s is the running version", image.version);
+        return false;
+    }
+    OTA_LOGI(TAG, "Image %s %s: %u bytes", image.project, image.version,
+             (unsigned)image.imageSize);
+    if (imageDigest == nullptr)
+        imageDigest = new OtaSha256();
+    return true;
+}
+
+/// @brief ends the session when the device already holds the image of the
+/// header: running (nothing to do) or complete in the update slot from an
+/// earlier attempt (only the boot partition is switched).
+bool OtaSession::skipHeldImage() {
+    OtaSink::Held held = ctx.sink->holds(image.sha256, image.imageSize);
+    if (held == OtaSink::HELD_NONE)
+        return false;
+    if (held == OtaSink::HELD_RUNNING) {
+        OTA_LOGI(TAG, "Image %s %s is already running, nothing to do", image.project,
+                 image.version);
+        curState = CURRENT;
+    } else if (ctx.sink->activate()) {
+        OTA_LOGI(TAG, "Image %s %s is already in the update slot, boot partition switched",
+                 image.project, image.version);
+        m.slotReused = true;
+        curState = DONE;
+    } else {
+        curState = FAILED;
+    }
+    release();
+    return true;
+}
+
+/// @brief halves the slice when a step overran the budget, doubles it when
+/// the step used less than a quarter of it.
+static void adaptSlice(size_t &slice, int64_t tookUs, uint32_t budgetUs) {
+    if (tookUs > budgetUs && slice > OTA_SLICE_MIN_BYTES)
+        slice /= 2;
+    else if (tookUs * 4 < budgetUs && slice < DECOMPRESSED_BLOCK_SIZE)
+        slice *= 2;
+}
+
+void OtaSession::stepDecode() {
+    if (stepBudget == 0) {
+        decodedBytes = LZ4_decompress_safe_usingDict((const char *)cBuffer, (char *)dBuffer,
+                                                     blockSize, DECOMPRESSED_BLOCK_SIZE,
+                                                     (const char *)dictBuffer, dictSize);
+        if (decodedBytes < 0) {
+            OTA_LOGE(TAG, "LZ4 decompression failed with code %d", decodedBytes);
+            fail();
+            return;
+        }
+        blockDecoded = true;
+        curState = WRITE;
+        return;
+    }
+
+    // sliced decode: at most decodeSlice bytes, then flush them to flash
+    int64_t t0 = otaNowUs();
+    if (!sliceStarted) {
+        slicer.begin(cBuffer, blockSize, dBuffer, DECOMPRESSED_BLOCK_SIZE, dictBuffer,
+                     dictSize);
+        sliceStarted = true;
+    }
+    LZ4SliceDecoder::Result res = slicer.decode(decodeSlice);
+    if (res == LZ4SliceDecoder::ERROR) {
+        OTA_LOGE(TAG, "LZ4 decompression failed at byte %zu of block", slicer.produced());
+        fail();
+        return;
+    }
+    decodedBytes = slicer.produced();
+    blockDecoded = res == LZ4SliceDecoder::DONE;
+    adaptSlice(decodeSlice, otaNowUs() - t0, stepBudget);
+    curState = WRITE;
+}
+
+/// @brief before the first write: checks the application image header and
+/// only then prepares the slot, so a rejected image costs no erase. False
+/// when the session failed or more of the block must be decoded first.
+bool OtaSession::beginSink() {
+    if (appCheckSet) {
+        if (!blockDecoded && decodedBytes < OTA_APP_HEADER_BYTES) {
+            curState = DECODE;   // sliced decode: not enough of the header yet
+            return false;
+        }
+        OtaAppInfo info;
+        if (!info.parse(dBuffer, decodedBytes)) {
+            OTA_LOGE(TAG, "Image rejected: not an ESP-IDF application image");
+            fail();
+            return false;
+        }
+        OtaAppCheck check = appCheck;
+        check.version = nullptr;   // the running version is not an error, see below
+        if (const char *why = check.reject(info)) {
+            OTA_LOGE(TAG, "Image rejected: %s (%s %s, chip %u rev %u-%u)", why, info.project,
+                     info.version, info.chipId, info.minChipRev, info.maxChipRev);
+            fail();
+            return false;
+        }
+        if (appCheck.version && strcmp(info.version, appCheck.version) == 0) {
+            if (imageEnd == 0) {
+                // no header, so no digest to compare: the version is all there is
+                OTA_LOGI(TAG, "Image %s %s is already running, nothing to do", info.project,
+                         info.version);
+                curState = CURRENT;
+                release();
+                return false;
+            }
+            OTA_LOGE(TAG, "Image rejected: same version as the running app (%s %s)",
+                     info.project, info.version);
+            fail();
+            return false;
+        }
+        OTA_LOGI(TAG, "Image checked: %s %s, chip %u", info.project, info.version, info.chipId);
+    }
+    // sliced mode erases sector by sector while writing, not all up front
+    if (!ctx.sink->begin(stepBudget != 0)) {
+        fail();
+        return false;
+    }
+    sinkBegun = true;
+    return true;
+}
+
+void OtaSession::stepWrite() {
+    if (!sinkBegun && !beginSink())
+        return;
+    size_t n = decodedBytes - writtenInBlock;
+    if (stepBudget && n > writeSlice)
+        n = writeSlice;
+
+    int64_t t0 = otaNowUs();
+    if (!ctx.sink->write(dBuffer + writtenInBlock, n)) {
+        fail();
+        return;
+    }
+    if (imageDigest)
+        imageDigest->update(dBuffer + writtenInBlock, n);
+    writtenInBlock += n;
+    totalWritten += n;
+    if (stepBudget)
+        adaptSlice(writeSlice, otaNowUs() - t0, stepBudget);
+
+    if (writtenInBlock < (size_t)decodedBytes)
+        return;   // more of this slice to write
+    if (!blockDecoded) {
+        curState = DECODE;
+        return;
+    }
+
+    dictSize = windowAppend(dictBuffer, dictSize, LZ4_DICT_SIZE, dBuffer, decodedBytes);
+
+    headerFill = 0;
+    decodedBytes = 0;
+    writtenInBlock = 0;
+    blockDecoded = sliceStarted = false;
+    curState = FETCH;
+}
+
+void OtaSession::stepVerify() {
+    if (totalWritten == 0) {
+        OTA_LOGE(TAG, "No OTA data was written — aborting");
+        fail();
+        return;
+    }
+
+    // contentLength is the compressed size from HTTP header, block prefixes included
+    if (contentLength > 0 && totalCompressed != (size_t)contentLength) {
+        OTA_LOGE(TAG, "OTA size mismatch: expected %lld compressed bytes, got %zu",
+                 (long long)contentLength, totalCompressed);
+        fail();
+        return;
+    }
+
+    if (imageDigest) {
+        uint8_t digest[OTA_DIGEST_SIZE];
+        imageDigest->finish(digest);
+        if (totalWritten != image.imageSize || memcmp(digest, image.sha256, sizeof(digest)) != 0) {
+            OTA_LOGE(TAG, "Image digest mismatch: %zu of %u bytes written", totalWritten,
+                     (unsigned)image.imageSize);
+            fail();
+            return;
+        }
+    }
+
+    sinkBegun = false;   // finish() releases the image on any outcome
+    if (!ctx.sink->finish()) {
+        fail();
+        return;
+    }
+    OTA_LOGI(TAG, "OTA update successful: %zu bytes written", totalWritten);
+    curState = DONE;
+    release();
+}
+
+// ---------- helpers ----------
+
+bool OtaSession::openSource(const char *url) {
+    if (!ctx.source->open(url))
+        return false;
+    contentLength = ctx.source->contentLength();
+    return true;
+}
+
+void OtaSession::fail() {
+    curState = FAILED;
+    release();
+}
+
+void OtaSession::release() {
+    turbo.restore();
+    if (m.startUs != 0 && m.endUs == 0) {
+        m.endUs = otaNowUs();
+        m.compressedBytes = totalCompressed;
+        m.writtenBytes = totalWritten;
+        int64_t elapsed = m.endUs - m.startUs;
+        m.throughputBps = elapsed > 0 ? (uint32_t)(totalWritten * 1000000LL / elapsed) : 0;
+        m.throttledMs = (uint32_t)(governor.throttledUs() / 1000);
+        m.decodeBps = decodeUs > 0 ? (uint32_t)(totalWritten * 1000000LL / decodeUs) : 0;
+        m.fetchBps = fetchUs > 0 ? (uint32_t)(totalCompressed * 1000000LL / fetchUs) : 0;
+        m.writeBps = writeUs > 0 ? (uint32_t)(totalWritten * 1000000LL / writeUs) : 0;
+        m.iramDecode = ED_OTA_IRAM_DECODE;
+        m.dryRun = request.dryRun;
+        OTA_LOGI(TAG, "OTA metrics: %u bytes in %lld ms, %u B/s%s, throttled %u ms, "
+                      "worst step %u us in %s (budget %u us), decode %u B/s%s, fetch %u B/s, "
+                      "write %u B/s",
+                 (unsigned)m.writtenBytes, (long long)(elapsed / 1000),
+                 (unsigned)m.throughputBps, m.turbo ? " (turbo)" : "",
+                 (unsigned)m.throttledMs, (unsigned)m.stepMaxUs,
+                 stateName((State)m.stepMaxState), (unsigned)m.stepBudgetUs,
+                 (unsigned)m.decodeBps, m.iramDecode ? " (IRAM)" : "",
+                 (unsigned)m.fetchBps, (unsigned)m.writeBps);
+    }
+    if (sinkBegun)
+        ctx.sink->abort();
+    sinkBegun = false;
+    ctx.source->close();
+    if (curState == FAILED || curState == CANCELLED) {
+        // keep the scanner on success so targetFile() stays available; on
+        // failure only the file name is kept, for the caller's report
+        if (fwScanner && fwScanner->targetFwFile())
+            snprintf(failedFile, sizeof(failedFile), "%s", fwScanner->targetFwFile());
+        delete fwScanner;
+        fwScanner = nullptr;
+    }
+    free(cBuffer);
+    free(dBuffer);
+    free(dictBuffer);
+    cBuffer = dBuffer = dictBuffer = nullptr;
+    delete imageDigest;
+    imageDigest = nullptr;
+}
+
+// ---------- DigestSink ----------
+
+bool DigestSink::begin(bool sequentialErase) {
+    (void)sequentialErase;
+    delete sha;
+    sha = new OtaSha256();
+    total = 0;
+    return true;
+}
+
+bool DigestSink::write(const uint8_t *data, size_t len) {
+    if (sha == nullptr)
+        return false;
+    sha->update(data, len);
+    total += len;
+    return true;
+}
+
+bool DigestSink::finish() {
+    if (sha == nullptr)
+        return false;
+    sha->finish(result);
+    delete sha;
+    sha = nullptr;
+    OTA_LOGI(TAG, "Dry run: %zu bytes decoded, nothing written", total);
+    return true;
+}
+
+void DigestSink::abort() {
+    delete sha;
+    sha = nullptr;
+}
+
+} // namespace ED_OTA
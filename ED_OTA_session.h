@@ -0,0 +1,237 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_session.h
+ * @brief step-driven OTA engine: resolve, download, decode and flash one
+ * firmware image in bounded increments of work.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-04
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_core.h"
+#include "ED_OTA_governor.h"
+#include "ED_OTA_lz4slice.h"
+#include "ED_OTA_platform.h"
+#include "ED_OTA_turbo.h"
+#include <string>
+
+#define OTA_SLICE_MIN_BYTES 256  // smallest decode/write slice in sliced mode
+#define OTA_STEP_NONE 0xFF       // OtaMetrics::stepMaxState before a step was measured
+
+namespace ED_OTA {
+
+/// @brief per-session measurements. Plain data so it can be kept in RTC memory
+/// across the post-update reboot.
+struct OtaMetrics {
+  int64_t startUs;
+  int64_t endUs;
+  uint32_t compressedBytes;
+  uint32_t writtenBytes;
+  uint32_t throughputBps;  // decoded bytes per second over the whole session
+  bool turbo;
+  uint16_t cpuMhzBefore;
+  uint16_t cpuMhzDuring;
+  uint8_t priorityBefore;
+  uint8_t priorityDuring;
+  int8_t wifiPsBefore;         // wifi_ps_type_t, -1 when Wi-Fi was not queried
+  uint32_t prevThroughputBps;  // previous session, for before/after comparison
+  bool prevTurbo;
+  uint32_t throttledMs;        // time held back by the governor
+  uint32_t stepBudgetUs;       // sliced mode budget, 0 when not sliced
+  uint32_t stepMaxUs;          // worst FETCH/DECODE/WRITE step
+  uint8_t stepMaxState;        // OtaSession::State of that step, OTA_STEP_NONE = none measured
+  uint32_t decodeBps;          // decoded bytes per second of DECODE time
+  uint32_t fetchBps;           // compressed bytes per second of FETCH time (network waits included)
+  uint32_t writeBps;           // decoded bytes per second of WRITE time (erase included)
+  bool iramDecode;             // built with CONFIG_ED_OTA_IRAM_DECODE
+  bool dryRun;                 // decoded into a DigestSink, flash untouched
+  bool slotReused;             // the image was already in the slot: boot switched only
+  uint32_t stackSize;          // stack of the driving task, 0 when not known (poll())
+  uint32_t stackFreeMin;       // stack high-water mark of the driving task, bytes
+  uint32_t heapPeakBytes;      // largest drop of free heap during the session
+  uint32_t heapFreeMin;        // lowest free heap since boot
+  uint32_t heapLargestFree;    // largest free heap block when the session ended
+};
+
+/// @brief dry-run sink: hashes the decoded image instead of writing it, so a
+/// session exercises download, decode and the header checks with no erase,
+/// no flash wear and no boot partition switch.
+class DigestSink : public OtaSink {
+public:
+  ~DigestSink() { delete sha; }
+
+  bool begin(bool sequentialErase) override;
+  bool write(const uint8_t *data, size_t len) override;
+  bool finish() override;
+  void abort() override;
+
+  /// @brief SHA-256 of the image, valid after finish().
+  const uint8_t *digest() const { return result; }
+  size_t bytes() const { return total; }
+
+private:
+  OtaSha256 *sha = nullptr;
+  uint8_t result[OTA_DIGEST_SIZE] = {};
+  size_t total = 0;
+};
+
+/**
+ * @brief one OTA update, advanced by repeated calls to step() or poll().
+ *
+ * Every step performs a bounded amount of work (one listing chunk, one block
+ * read, one block decode or one flash write) and returns, so the session can
+ * be driven from an application loop without a dedicated task. Buffers live
+ * on the heap: the caller's stack only has to accommodate the HTTP/TLS calls.
+ *
+ * The session never reboots: once state() is DONE the sink holds the new
+ * boot image and the owner decides when to restart. All I/O goes through the
+ * HttpSource and OtaSink of the OtaContext, so the same engine runs on the
+ * device and on a workstation.
+ */
+class OtaSession {
+public:
+  enum State {
+    RESOLVE,  // scanning the firmware directory listing
+    CONNECT,  // opening the download and the OTA partition
+    FETCH,    // reading the next compressed block
+    DECODE,   // LZ4-decoding the block
+    WRITE,    // writing the decoded block to flash
+    VERIFY,   // closing the OTA image and switching boot partition
+    DONE,
+    FAILED,
+    CANCELLED,
+    CURRENT   // the image is already running: nothing was done
+  };
+
+  OtaSession(const OtaRequest &request, const char *storageUrl,
+             const char *fallbackUrl, const OtaContext &context);
+  ~OtaSession();
+
+  /// @brief advances the session by one bounded unit of work.
+  State step();
+  /// @brief runs steps until the session ends or budgetUs have elapsed
+  /// (at least one step is always performed).
+  State poll(uint32_t budgetUs);
+  /// @brief stops the session at the next step, aborting the OTA image.
+  void cancel() { cancelRequested = true; }
+  /// @brief applies profile when the session starts and restores the previous
+  /// settings when it ends, on every exit path. Call before the first step.
+  void setTurbo(const TurboProfile &profile);
+  /// @brief sliced mode: decode and flash writes are split so that each step
+  /// aims to stay under budgetUs (adaptive slice size, sector-by-sector erase).
+  /// 0 decodes and writes whole blocks. Call before the first step.
+  void setStepBudget(uint32_t budgetUs);
+  /// @brief pre-flight check: the image header (when the image has one) and
+  /// the first decoded bytes must match check, or the session fails before
+  /// the slot is erased or written. A headerless image of the running
+  /// version ends the session as CURRENT. A dry run accepts the running
+  /// version, so a rebuild of it can be checked. Call before the first step.
+  void setAppCheck(const OtaAppCheck &check) {
+    appCheck = check;
+    if (request.dryRun)
+      appCheck.version = nullptr;
+    appCheckSet = true;
+  }
+  /// @brief bounds bandwidth and CPU use of the session, see OtaGovernor.
+  void setLimits(const GovernorLimits &limits) { governor.configure(limits); }
+  /// @brief governor limits requested by an update request.
+  static GovernorLimits limitsFor(const OtaRequest &request);
+  /// @brief after a step that did no work because of the governor: how long
+  /// the driver should wait before stepping again (0 = step right away).
+  uint32_t waitHintUs() const { return waitUs; }
+
+  const OtaMetrics &metrics() const { return m; }
+  State state() const { return curState; }
+  bool finished() const { return curState >= DONE; }
+  const char *targetFile() const;
+  size_t compressedBytes() const { return totalCompressed; }
+  size_t writtenBytes() const { return totalWritten; }
+  /// @brief header of the image being fetched, nullptr when it has none (or
+  /// FETCH has not read it yet).
+  const OtaImageHeader *imageHeader() const { return imageEnd ? &image : nullptr; }
+  /// @brief also "none" for OTA_STEP_NONE.
+  static const char *stateName(State s);
+
+private:
+  static const int LZ4_DICT_SIZE = 16 * 1024;
+
+  OtaRequest request;
+  OtaContext ctx;
+  const char *urls[2];
+  int urlIndex = 0;  // 0 = storage, 1 = fallback
+  State curState = RESOLVE;
+  bool cancelRequested = false;
+  bool turboRequested = false;
+  TurboProfile turboProfile = {};
+  OtaTurbo turbo;
+  OtaMetrics m = {};
+  OtaGovernor governor;
+  uint32_t waitUs = 0;
+  size_t rxBytes = 0;  // every byte received, listings included
+  int64_t decodeUs = 0;
+  int64_t fetchUs = 0;
+  int64_t writeUs = 0;
+
+  FirmwareScanner *fwScanner = nullptr;
+  char failedFile[MAX_FILENAME_LEN] = "";  // targetFile() once release() dropped the scanner
+  std::string fullUrl;
+  bool releaseTried = false;  // the announced release was weighed against the scan rules
+  bool releaseUsed = false;   // fullUrl is the announced release, no listing read
+  int64_t contentLength = -1;
+  bool sinkBegun = false;
+
+  uint8_t *cBuffer = nullptr;
+  uint8_t *dBuffer = nullptr;
+  uint8_t *dictBuffer = nullptr;
+  int dictSize = 0;
+
+  uint32_t blockSize = 0;
+  size_t headerFill = 0;  // bytes of the block size prefix received so far
+  size_t blockFill = 0;   // bytes of the compressed block received so far
+  int decodedBytes = 0;
+  size_t writtenInBlock = 0;
+  bool blockDecoded = false;
+
+  OtaImageHeader image = {};
+  size_t imageFill = 0;              // bytes of the image header received so far
+  size_t imageEnd = 0;               // header bytes to receive, 0 = headerless image
+  OtaSha256 *imageDigest = nullptr;  // digest of the written image, with a header only
+
+  OtaAppCheck appCheck = {};
+  bool appCheckSet = false;
+
+  uint32_t stepBudget = 0;
+  LZ4SliceDecoder slicer;
+  bool sliceStarted = false;
+  size_t decodeSlice = 4096;
+  size_t writeSlice = 4096;
+  size_t totalCompressed = 0;
+  size_t totalWritten = 0;
+
+  void stepResolve();
+  bool resolveRelease();
+  bool dropRelease();
+  void stepConnect();
+  void stepFetch();
+  void stepDecode();
+  void stepWrite();
+  void stepVerify();
+
+  void fetchImageHeader();
+  bool checkImageHeader();
+  bool skipHeldImage();
+  bool beginSink();
+
+  bool openSource(const char *url);
+  void fail();
+  void release();
+
+  OtaSession(const OtaSession &) = delete;
+  OtaSession &operator=(const OtaSession &) = delete;
+};
+
+} // namespace ED_OTA
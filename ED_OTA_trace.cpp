@@ -0,0 +1,150 @@
+#include "ED_OTA_trace.h"
+#include <string.h>
+
+namespace ED_OTA {
+
+static const char *TAG = "ED_OTA";
+
+static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+// ---------- TraceRecorder ----------
+
+void TraceRecorder::record(uint8_t type, const uint64_t *fields, int count) {
+    if (!started || full || ended)
+        return;
+    if (fill + 1 + count * 10 > sizeof(buffer))
+        flush();
+    buffer[fill++] = type;
+    for (int i = 0; i < count; i++) {
+        uint64_t v = fields[i];
+        do {
+            buffer[fill++] = (uint8_t)((v & 0x7F) | (v > 0x7F ? 0x80 : 0));
+            v >>= 7;
+        } while (v);
+    }
+}
+
+void TraceRecorder::flush() {
+    if (fill == 0 || full)
+        return;
+    if (!out.write(buffer, fill)) {
+        OTA_LOGW(TAG, "trace output full, recording stopped after %u bytes", (unsigned)length);
+        full = true;
+    } else {
+        length += fill;
+    }
+    fill = 0;
+}
+
+bool TraceRecorder::open(const char *url) {
+    if (!started && !ended) {
+        started = true;
+        uint8_t header[OTA_TRACE_HEADER_SIZE] = {'E', 'D', 'T', 'R', OTA_TRACE_VERSION, 0, 0, 0,
+                                                 0xFF, 0xFF, 0xFF, 0xFF};
+        full = !out.begin() || !out.write(header, sizeof(header));
+        if (full)
+            OTA_LOGW(TAG, "trace output not available, transfer not recorded");
+    }
+    int64_t start = otaNowUs();
+    bool ok = inner.open(url);
+    lastUs = otaNowUs();
+    if (ok) {
+        uint64_t fields[] = {(uint64_t)(lastUs - start), (uint64_t)inner.status(),
+                             (uint64_t)(inner.contentLength() + 1)};
+        record('O', fields, 3);
+    } else {
+        uint64_t fields[] = {(uint64_t)(lastUs - start)};
+        record('F', fields, 1);
+    }
+    return ok;
+}
+
+int TraceRecorder::read(char *buf, size_t len) {
+    int64_t start = otaNowUs();
+    int n = inner.read(buf, len);
+    if (n == OTA_READ_AGAIN)
+        return n;   // folded into the idle time of the next record
+    int64_t now = otaNowUs();
+    uint64_t fields[] = {len, zigzag(n), (uint64_t)(start - lastUs), (uint64_t)(now - start)};
+    record('R', fields, 4);
+    lastUs = now;
+    return n;
+}
+
+void TraceRecorder::close() {
+    inner.close();
+    record('C', nullptr, 0);
+}
+
+void TraceRecorder::end() {
+    if (!started || ended)
+        return;
+    flush();
+    ended = true;
+    out.end(length);
+}
+
+// ---------- TraceReader ----------
+
+bool TraceReader::begin(const uint8_t *data, size_t len) {
+    if (len < OTA_TRACE_HEADER_SIZE || memcmp(data, OTA_TRACE_MAGIC, 4) != 0 ||
+        data[4] != OTA_TRACE_VERSION)
+        return false;
+    uint32_t length;
+    memcpy(&length, data + OTA_TRACE_LENGTH_OFFSET, sizeof(length));
+    p = data + OTA_TRACE_HEADER_SIZE;
+    end = data + len;
+    if (length != 0xFFFFFFFF && length < len - OTA_TRACE_HEADER_SIZE)
+        end = p + length;
+    return true;
+}
+
+bool TraceReader::field(uint64_t &value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        value |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool TraceReader::next(TraceEvent &event) {
+    if (p == nullptr || p >= end || *p == 0xFF)
+        return false;
+    event = {};
+    event.type = (char)*p++;
+    uint64_t v[4];
+    switch (event.type) {
+        case 'O':
+            if (!field(v[0]) || !field(v[1]) || !field(v[2]))
+                return false;
+            event.openUs = (uint32_t)v[0];
+            event.status = (int)v[1];
+            event.contentLength = (int64_t)v[2] - 1;
+            return true;
+        case 'F':
+            if (!field(v[0]))
+                return false;
+            event.openUs = (uint32_t)v[0];
+            return true;
+        case 'R':
+            for (uint64_t &f : v) {
+                if (!field(f))
+                    return false;
+            }
+            event.requested = (uint32_t)v[0];
+            event.result = (int)unzigzag(v[1]);
+            event.idleUs = (uint32_t)v[2];
+            event.waitUs = (uint32_t)v[3];
+            return true;
+        case 'C':
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace ED_OTA
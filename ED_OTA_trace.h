@@ -0,0 +1,108 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_trace.h
+ * @brief transfer traces: records the size and timing of every HttpSource
+ * call of a session, so a field transfer can be replayed on the host.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_platform.h"
+
+#define OTA_TRACE_MAGIC "EDTR"
+#define OTA_TRACE_VERSION 1
+#define OTA_TRACE_HEADER_SIZE 12
+#define OTA_TRACE_LENGTH_OFFSET 8
+#define OTA_TRACE_BUFFER 128
+
+namespace ED_OTA {
+
+/*
+ * Trace layout: "EDTR", version, 3 reserved bytes, uint32 LE length of the
+ * records (0xFFFFFFFF until the recording ends), then records made of a type
+ * byte and LEB128 fields:
+ *   'O' openUs status contentLength+1   open succeeded
+ *   'F' openUs                          open failed
+ *   'R' requested result idleUs waitUs  read; result zigzag-encoded, idleUs
+ *                                       since the previous call returned
+ *   'C'                                 close
+ * A 0xFF type byte (erased flash) also ends the records. Reads that returned
+ * OTA_READ_AGAIN are not recorded: their time is part of the next record.
+ */
+
+/// @brief where a recorder stores its trace.
+class TraceOutput {
+public:
+  virtual ~TraceOutput() {}
+  virtual bool begin() = 0;
+  virtual bool write(const uint8_t *data, size_t len) = 0;
+  /// @brief stores the final record length in the header.
+  virtual void end(uint32_t recordBytes) = 0;
+};
+
+/// @brief wraps an HttpSource and records every call into a TraceOutput.
+/// Recording stops quietly when the output is full.
+class TraceRecorder : public HttpSource {
+public:
+  TraceRecorder(HttpSource &inner, TraceOutput &output) : inner(inner), out(output) {}
+  ~TraceRecorder() { end(); }
+
+  bool open(const char *url) override;
+  int status() override { return inner.status(); }
+  int64_t contentLength() override { return inner.contentLength(); }
+  int read(char *buf, size_t len) override;
+  void close() override;
+
+  /// @brief flushes the records and finalizes the trace.
+  void end();
+  uint32_t recordBytes() const { return length; }
+  bool truncated() const { return full; }
+
+private:
+  HttpSource &inner;
+  TraceOutput &out;
+  uint8_t buffer[OTA_TRACE_BUFFER];
+  size_t fill = 0;
+  uint32_t length = 0;
+  int64_t lastUs = 0;
+  bool started = false;
+  bool ended = false;
+  bool full = false;
+
+  void record(uint8_t type, const uint64_t *fields, int count);
+  void flush();
+};
+
+/// @brief one decoded trace record.
+struct TraceEvent {
+  char type;   // 'O', 'F', 'R' or 'C'
+  uint32_t openUs;
+  int status;
+  int64_t contentLength;
+  uint32_t requested;
+  int result;
+  uint32_t idleUs;
+  uint32_t waitUs;
+};
+
+/// @brief iterates over the records of a trace held in memory.
+class TraceReader {
+public:
+  /// @brief false when data does not start with a valid trace header.
+  bool begin(const uint8_t *data, size_t len);
+  /// @brief next record; false at the end or on a malformed record.
+  bool next(TraceEvent &event);
+
+private:
+  const uint8_t *p = nullptr;
+  const uint8_t *end = nullptr;
+
+  bool field(uint64_t &value);
+};
+
+} // namespace ED_OTA
@@ -0,0 +1,56 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_turbo.h
+ * @brief temporary CPU, power-management and Wi-Fi tuning for the duration
+ * of an OTA session.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-06
+ */
+// #endregion
+
+#pragma once
+
+#include <stdint.h>
+
+namespace ED_OTA {
+
+struct OtaMetrics;
+
+/// @brief what the turbo profile changes while a session runs.
+struct TurboProfile {
+  bool cpuFreqMax;  // hold an ESP_PM_CPU_FREQ_MAX lock
+  bool apbFreqMax;  // hold an ESP_PM_APB_FREQ_MAX lock
+  bool wifiNoPs;    // switch Wi-Fi power save off
+  int priority;     // priority of the stepping task, -1 to leave it unchanged
+};
+
+/**
+ * @brief applies a TurboProfile and restores the previous settings.
+ * restore() is idempotent and undoes only what apply() changed, so it can be
+ * called from every exit path. Implemented by each platform; the POSIX
+ * build leaves the system untouched.
+ */
+class OtaTurbo {
+public:
+  ~OtaTurbo() { restore(); }
+
+  void apply(const TurboProfile &profile, OtaMetrics &metrics);
+  void restore();
+  bool active() const { return applied; }
+
+  /// @brief current CPU frequency in MHz, 0 when unknown.
+  static uint32_t cpuMhz();
+
+private:
+  bool applied = false;
+  void *cpuLock = nullptr;  // esp_pm_lock_handle_t
+  void *apbLock = nullptr;
+  bool psChanged = false;
+  int savedPs = 0;          // wifi_ps_type_t
+  void *task = nullptr;     // TaskHandle_t
+  unsigned savedPriority = 0;
+};
+
+} // namespace ED_OTA
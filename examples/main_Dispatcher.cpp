@@ -53,6 +53,7 @@ struct GIT_fwInfo {
 #include <map>
 #include <esp_log.h>
 #include <esp_ota_ops.h>
+#include <mqtt_client.h>
 
 using namespace ED_JSON;
 using namespace ED_SYSINFO;
@@ -84,6 +85,33 @@ ESP_LOGI(TAG,"Step_ funcpointer is null? %d",sdpiCmd.funcPointer==nullptr);
 
 // ED_MQTT_dispatcher::CommandRegistry TestCmdReceiver::registry;
 
+// FWRA announcements are retained on the project's release topic, which the
+// dispatcher does not read: a client of its own subscribes to it and hands
+// the messages to the OTA manager.
+#define RELEASE_BROKER_URI "mqtts://raspi00:8883"
+static char releaseTopic[64];
+
+static void release_event(void *arg, esp_event_base_t base, int32_t id, void *data) {
+  ED_OTA::OTAmanager *ota = (ED_OTA::OTAmanager *)arg;
+  esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)data;
+  if (id == MQTT_EVENT_CONNECTED)
+    esp_mqtt_client_subscribe(event->client, releaseTopic, 1);
+  else if (id == MQTT_EVENT_DATA && event->data_len == event->total_data_len)
+    ota->onReleaseMessage(event->data, event->data_len);
+}
+
+static void start_release_client(ED_OTA::OTAmanager *ota) {
+  static esp_mqtt_client_handle_t client = nullptr;
+  if (client != nullptr || !ED_OTA::OTAmanager::releaseTopic(releaseTopic, sizeof(releaseTopic)))
+    return;
+  esp_mqtt_client_config_t cfg = {};
+  cfg.broker.address.uri = RELEASE_BROKER_URI;
+  cfg.broker.verification.certificate = (const char *)ca_crt_start;
+  client = esp_mqtt_client_init(&cfg);
+  esp_mqtt_client_register_event(client, MQTT_EVENT_ANY, release_event, ota);
+  esp_mqtt_client_start(client);
+}
+
 void check_ota_state_on_boot() {
     const esp_partition_t *running = esp_ota_get_running_partition();
     esp_ota_img_states_t ota_state;
@@ -154,7 +182,10 @@ ED_wifi::WiFiService::subscribeToIPReady([&]() {
     ED_MQTT_dispatcher::MQTTdispatcher::initialize();
 
     ED_MQTT_dispatcher::MQTTdispatcher::subscribe(&crec);
+    // OTA commands
     ED_MQTT_dispatcher::MQTTdispatcher::subscribe(&otaUpdater);
+    // retained FWRA release announcements, on fware/<project>/release
+    start_release_client(&otaUpdater);
   });
   ED_wifi::WiFiService::launch();
 
@@ -0,0 +1,428 @@
+// #region StdManifest
+/**
+ * @file bench_decode.cpp
+ * @brief decode-path benchmark: repacks firmware images with different block
+ * and window sizes and replays them through the decode loop of OtaSession
+ * (fetch into the block buffer, LZ4 decode, sink write, window upkeep),
+ * reporting throughput, cycles per byte, memory traffic and buffer memory as
+ * JSON.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-16
+ */
+// #endregion
+
+#include "ED_OTA_session.h"
+#include "lz4pack.h"
+#include "memio.h"
+#include <algorithm>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#else
+#define BENCH_HAVE_TSC 0
+#endif
+
+#ifndef ED_OTA_GIT_REV
+#define ED_OTA_GIT_REV "unknown"
+#endif
+
+using namespace ED_OTA;
+
+namespace {
+
+enum Variant {
+    CONTINUE_COPY,   // LZ4_setStreamDecode + safe_continue, copied window
+    DICT_COPY,       // LZ4_decompress_safe_usingDict, copied window (device default)
+    CONTINUE_RING,   // safe_continue into a ring buffer, no window copies
+    SLICED_COPY,     // LZ4SliceDecoder in fixed slices, copied window (sliced mode)
+    SESSION,         // the whole OtaSession over an in-memory source and sink
+    VARIANT_COUNT
+};
+
+const char *const variantNames[VARIANT_COUNT] = {"continue-copy", "dict-copy", "continue-ring",
+                                                 "sliced-copy", "session"};
+
+struct Run {
+    double seconds = 0;
+    uint64_t cycles = 0;
+    uint64_t traffic = 0;       // bytes copied by the loop, LZ4 match copies excluded
+    size_t bufferBytes = 0;     // decode buffers the variant allocates
+    bool correct = false;
+};
+
+inline uint64_t cycleCount() {
+#if BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+inline uint32_t le32(const uint8_t *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/// @brief bytes read and written by windowAppend() for one block.
+uint64_t windowTraffic(int used, int window, int len) {
+    if (len >= window)
+        return 2ull * window;
+    if (used + len <= window)
+        return 2ull * len;
+    return 2ull * (window - len) + 2ull * len;
+}
+
+/// @brief the unsliced or sliced decode loop of OtaSession on packed data.
+Run runLoop(Variant variant, const std::vector<uint8_t> &packed, const std::vector<uint8_t> &image,
+            const PackParams &params, size_t slice) {
+    Run r;
+    const int window = (int)params.window;
+    const int maxBlock = (int)params.maxBlock;
+    std::vector<uint8_t> out(image.size());
+    std::vector<uint8_t> cBuffer(params.maxCompressed);
+    std::vector<uint8_t> dBuffer(variant == CONTINUE_RING ? 0 : maxBlock);
+    std::vector<uint8_t> dict(variant == CONTINUE_RING ? 0 : window);
+    // matches reach window + maxBlock back from the end of a block, and the
+    // block being decoded must not overwrite them: two blocks beside the window
+    std::vector<uint8_t> ring(variant == CONTINUE_RING ? window + 2 * maxBlock : 0);
+    LZ4_streamDecode_t *stream = LZ4_createStreamDecode();
+    LZ4SliceDecoder slicer;
+    r.bufferBytes = cBuffer.size() + dBuffer.size() + dict.size() + ring.size() +
+                    sizeof(LZ4_streamDecode_t) + (variant == SLICED_COPY ? sizeof(slicer) : 0);
+
+    int dictSize = 0;
+    size_t ringPos = 0, pos = 0, written = 0;
+    bool ok = true;
+    LZ4_setStreamDecode(stream, nullptr, 0);
+    int64_t t0 = otaNowUs();
+    uint64_t c0 = cycleCount();
+    while (ok && pos + 4 <= packed.size()) {
+        uint32_t blockSize = le32(&packed[pos]);
+        pos += 4;
+        if (blockSize > params.maxCompressed || blockSize > packed.size() - pos) {
+            ok = false;
+            break;
+        }
+        memcpy(cBuffer.data(), &packed[pos], blockSize);   // FETCH
+        pos += blockSize;
+        r.traffic += 4 + 2ull * blockSize;
+
+        int decoded = -1;
+        switch (variant) {
+            case CONTINUE_COPY:
+                LZ4_setStreamDecode(stream, (const char *)dict.data(), dictSize);
+                decoded = LZ4_decompress_safe_continue(stream, (const char *)cBuffer.data(),
+                                                       (char *)dBuffer.data(), blockSize, maxBlock);
+                break;
+            case DICT_COPY:
+                decoded = LZ4_decompress_safe_usingDict((const char *)cBuffer.data(),
+                                                        (char *)dBuffer.data(), blockSize,
+                                                        maxBlock, (const char *)dict.data(),
+                                                        dictSize);
+                break;
+            case CONTINUE_RING:
+                if (ringPos + maxBlock > ring.size())
+                    ringPos = 0;
+                decoded = LZ4_decompress_safe_continue(stream, (const char *)cBuffer.data(),
+                                                       (char *)&ring[ringPos], blockSize, maxBlock);
+                break;
+            case SLICED_COPY: {
+                // decode a slice, write it, until the block is done
+                slicer.begin(cBuffer.data(), blockSize, dBuffer.data(), maxBlock, dict.data(),
+                             dictSize);
+                size_t flushed = 0;
+                LZ4SliceDecoder::Result res;
+                do {
+                    res = slicer.decode(slice);
+                    size_t n = slicer.produced() - flushed;
+                    if (res != LZ4SliceDecoder::ERROR && written + n <= out.size()) {
+                        memcpy(&out[written], &dBuffer[flushed], n);
+                        written += n;
+                        flushed += n;
+                    } else {
+                        res = LZ4SliceDecoder::ERROR;
+                    }
+                } while (res == LZ4SliceDecoder::MORE);
+                decoded = res == LZ4SliceDecoder::DONE ? (int)flushed : -1;
+                break;
+            }
+            default:
+                break;
+        }
+        if (decoded < 0) {
+            ok = false;
+            break;
+        }
+        r.traffic += blockSize + (uint64_t)decoded;   // decoder input and output
+
+        // WRITE (the sliced loop wrote while decoding)
+        const uint8_t *block = variant == CONTINUE_RING ? &ring[ringPos] : dBuffer.data();
+        if (variant != SLICED_COPY) {
+            if (written + decoded > out.size()) {
+                ok = false;
+                break;
+            }
+            memcpy(&out[written], block, decoded);
+            written += decoded;
+        }
+        r.traffic += 2ull * decoded;
+
+        if (variant == CONTINUE_RING) {
+            ringPos += decoded;
+        } else {
+            r.traffic += windowTraffic(dictSize, window, decoded);
+            dictSize = windowAppend(dict.data(), dictSize, window, block, decoded);
+        }
+    }
+    r.cycles = cycleCount() - c0;
+    r.seconds = (otaNowUs() - t0) / 1e6;
+    LZ4_freeStreamDecode(stream);
+    r.correct = ok && pos == packed.size() && written == image.size() &&
+                memcmp(out.data(), image.data(), image.size()) == 0;
+    return r;
+}
+
+/// @brief the full step loop of OtaSession; only for the device geometry.
+Run runSession(const std::vector<uint8_t> &packed, const std::vector<uint8_t> &image,
+               size_t stepBudgetUs) {
+    Run r;
+    MemorySource source("BENCH_v1.0.0-0.bin.lz4", packed);
+    MemorySink sink(image.size());
+    OtaContext ctx = {&source, &sink, "BENCH", "v0.0.0-0"};
+    OtaRequest request = {};
+    int64_t t0 = otaNowUs();
+    uint64_t c0 = cycleCount();
+    {
+        OtaSession session(request, "mem://fware/", nullptr, ctx);
+        session.setStepBudget((uint32_t)stepBudgetUs);
+        while (!session.finished())
+            session.step();
+        r.correct = session.state() == OtaSession::DONE;
+    }
+    r.cycles = cycleCount() - c0;
+    r.seconds = (otaNowUs() - t0) / 1e6;
+    r.correct = r.correct && sink.used == image.size() &&
+                memcmp(sink.image.data(), image.data(), image.size()) == 0;
+    r.bufferBytes = COMPRESSED_BLOCK_SIZE + DECOMPRESSED_BLOCK_SIZE + 16 * 1024 +
+                    sizeof(LZ4_streamDecode_t) + sizeof(OtaSession);
+    return r;
+}
+
+std::vector<size_t> parseList(const char *arg) {
+    std::vector<size_t> values;
+    for (const char *p = arg; *p;) {
+        char *end;
+        unsigned long v = strtoul(p, &end, 0);
+        if (end == p)
+            break;
+        values.push_back((size_t)v);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+std::string cpuModel() {
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    std::string model = "unknown";
+    if (f == nullptr)
+        return model;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "model name", 10) == 0) {
+            const char *v = strchr(line, ':');
+            if (v) {
+                model = v + 2;
+                model.erase(model.find_last_not_of("\r\n") + 1);
+            }
+            break;
+        }
+    }
+    fclose(f);
+    return model;
+}
+
+std::string jsonString(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c >= 0x20)
+            out += c;
+    }
+    return out + "\"";
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] <image>...\n"
+            "  images are raw .bin files or packed .lz4 device images (unpacked first)\n"
+            "      --blocks LIST     compressed block limits (default 1024,2048,4096;\n"
+            "                        decoded block limit is 4x)\n"
+            "      --windows LIST    dictionary windows (default 4096,8192,16384,32768,65536)\n"
+            "      --variants LIST   continue-copy,dict-copy,continue-ring,sliced-copy,session\n"
+            "      --slice BYTES     sliced-copy slice size (default 2048)\n"
+            "      --step-us US      session step budget, 0 = unsliced (default 0)\n"
+            "      --accel N         LZ4 acceleration used to pack (default 1)\n"
+            "      --reps N          runs per case, best and median reported (default 5)\n"
+            "      --label TEXT      stored in the report, e.g. a branch name\n"
+            "  -o, --out FILE        JSON report (default stdout)\n",
+            prog);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"blocks", required_argument, nullptr, 'b'},
+        {"windows", required_argument, nullptr, 'w'},
+        {"variants", required_argument, nullptr, 'V'},
+        {"slice", required_argument, nullptr, 's'},
+        {"step-us", required_argument, nullptr, 'S'},
+        {"accel", required_argument, nullptr, 'a'},
+        {"reps", required_argument, nullptr, 'r'},
+        {"label", required_argument, nullptr, 'l'},
+        {"out", required_argument, nullptr, 'o'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    std::vector<size_t> blocks = {1024, 2048, 4096};
+    std::vector<size_t> windows = {4096, 8192, 16384, 32768, 65536};
+    bool enabled[VARIANT_COUNT] = {true, true, true, true, true};
+    size_t slice = 2048, stepUs = 0;
+    int accel = 1, reps = 5;
+    std::string label;
+    const char *outPath = nullptr;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:h", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'b': blocks = parseList(optarg); break;
+            case 'w': windows = parseList(optarg); break;
+            case 'V': {
+                std::fill(enabled, enabled + VARIANT_COUNT, false);
+                std::string list = std::string(optarg) + ",";
+                for (size_t start = 0, comma; (comma = list.find(',', start)) != std::string::npos;
+                     start = comma + 1) {
+                    std::string name = list.substr(start, comma - start);
+                    int v = 0;
+                    while (v < VARIANT_COUNT && name != variantNames[v])
+                        v++;
+                    if (v == VARIANT_COUNT) {
+                        fprintf(stderr, "unknown variant: %s\n", name.c_str());
+                        return 2;
+                    }
+                    enabled[v] = true;
+                }
+                break;
+            }
+            case 's': slice = (size_t)atol(optarg); break;
+            case 'S': stepUs = (size_t)atol(optarg); break;
+            case 'a': accel = atoi(optarg); break;
+            case 'r': reps = std::max(1, atoi(optarg)); break;
+            case 'l': label = optarg; break;
+            case 'o': outPath = optarg; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind >= argc || blocks.empty() || windows.empty() || slice == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    otaLogLevel = 'E';
+
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (out == nullptr) {
+        perror(outPath);
+        return 1;
+    }
+    fprintf(out, "{\n  \"tool\": \"ota_bench_decode\",\n  \"rev\": %s,\n  \"label\": %s,\n"
+                 "  \"cpu\": %s,\n  \"tsc\": %s,\n  \"reps\": %d,\n  \"results\": [",
+            jsonString(ED_OTA_GIT_REV).c_str(), jsonString(label).c_str(),
+            jsonString(cpuModel()).c_str(), BENCH_HAVE_TSC ? "true" : "false", reps);
+
+    bool allCorrect = true, first = true;
+    for (int i = optind; i < argc; i++) {
+        std::vector<uint8_t> file, image;
+        if (!readFile(argv[i], file)) {
+            fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+        size_t nameLen = strlen(argv[i]);
+        if (nameLen > 4 && strcmp(argv[i] + nameLen - 4, ".lz4") == 0) {
+            if (!lz4UnpackImage(file.data(), file.size(), PackParams(), image)) {
+                fprintf(stderr, "%s: not a valid packed image\n", argv[i]);
+                return 1;
+            }
+        } else {
+            image.swap(file);
+        }
+
+        for (size_t block : blocks) {
+            for (size_t window : windows) {
+                PackParams params;
+                params.maxCompressed = block;
+                params.maxBlock = 4 * block;
+                params.window = window;
+                params.acceleration = accel;
+                std::vector<uint8_t> packed;
+                if (!lz4PackImage(image.data(), image.size(), params, packed)) {
+                    fprintf(stderr, "%s: cannot pack with block %zu\n", argv[i], block);
+                    continue;
+                }
+                bool deviceGeometry = block == COMPRESSED_BLOCK_SIZE &&
+                                      params.maxBlock == DECOMPRESSED_BLOCK_SIZE &&
+                                      window == 16 * 1024;
+                for (int v = 0; v < VARIANT_COUNT; v++) {
+                    if (!enabled[v] || (v == SESSION && !deviceGeometry))
+                        continue;
+                    std::vector<Run> runs;
+                    for (int rep = 0; rep < reps; rep++)
+                        runs.push_back(v == SESSION
+                                           ? runSession(packed, image, stepUs)
+                                           : runLoop((Variant)v, packed, image, params, slice));
+                    std::sort(runs.begin(), runs.end(),
+                              [](const Run &a, const Run &b) { return a.seconds < b.seconds; });
+                    const Run &best = runs.front(), &median = runs[runs.size() / 2];
+                    bool correct = std::all_of(runs.begin(), runs.end(),
+                                               [](const Run &r) { return r.correct; });
+                    allCorrect = allCorrect && correct;
+                    double mb = image.size() / 1e6;
+                    char traffic[32] = "null";   // not tracked through the session
+                    if (v != SESSION && !image.empty())
+                        snprintf(traffic, sizeof(traffic), "%.3f",
+                                 (double)best.traffic / image.size());
+                    fprintf(out,
+                            "%s\n    {\"image\": %s, \"imageBytes\": %zu, \"packedBytes\": %zu, "
+                            "\"block\": %zu, \"maxBlock\": %zu, \"window\": %zu, "
+                            "\"variant\": \"%s\", \"slice\": %zu, "
+                            "\"bestMBps\": %.2f, \"medianMBps\": %.2f, \"cyclesPerByte\": %.2f, "
+                            "\"trafficPerByte\": %s, \"bufferBytes\": %zu, \"correct\": %s}",
+                            first ? "" : ",", jsonString(argv[i]).c_str(), image.size(),
+                            packed.size(), block, params.maxBlock, window, variantNames[v],
+                            v == SLICED_COPY ? slice : v == SESSION ? stepUs : 0,
+                            best.seconds > 0 ? mb / best.seconds : 0,
+                            median.seconds > 0 ? mb / median.seconds : 0,
+                            image.empty() ? 0.0 : (double)best.cycles / image.size(),
+                            traffic,
+                            best.bufferBytes, correct ? "true" : "false");
+                    first = false;
+                }
+            }
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(out, "\n  ],\n  \"maxRssKB\": %ld,\n  \"allCorrect\": %s\n}\n", usage.ru_maxrss,
+            allCorrect ? "true" : "false");
+    if (out != stdout)
+        fclose(out);
+    return allCorrect ? 0 : 1;
+}
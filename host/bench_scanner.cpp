@@ -0,0 +1,515 @@
+// #region StdManifest
+/**
+ * @file bench_scanner.cpp
+ * @brief FirmwareScanner benchmark: generates nginx and Apache style
+ * directory listings of configurable size and name distribution, feeds them
+ * through file_scanner_parse_chunk in chunks as the session does, and reports
+ * entries per second, heap allocations and whether the expected file was
+ * selected, as JSON.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-16
+ */
+// #endregion
+
+#include "ED_OTA_core.h"
+#include "ED_OTA_platform.h"
+#include <algorithm>
+#include <getopt.h>
+#include <malloc.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifndef ED_OTA_GIT_REV
+#define ED_OTA_GIT_REV "unknown"
+#endif
+
+// ---------- allocation counting ----------
+// glibc lets the executable interpose malloc; the counters only run while a
+// measurement is active, so the generator and the report are not counted.
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+namespace {
+
+struct AllocStats {
+    size_t calls = 0;
+    size_t bytes = 0;
+    long live = 0;
+    long peak = 0;
+};
+
+bool counting = false;
+AllocStats allocStats;
+
+void countAlloc(void *ptr) {
+    if (!counting || ptr == nullptr)
+        return;
+    size_t size = malloc_usable_size(ptr);
+    allocStats.calls++;
+    allocStats.bytes += size;
+    allocStats.live += (long)size;
+    allocStats.peak = std::max(allocStats.peak, allocStats.live);
+}
+
+void countFree(void *ptr) {
+    if (counting && ptr != nullptr)
+        allocStats.live -= (long)malloc_usable_size(ptr);
+}
+
+AllocStats startCounting() {
+    allocStats = AllocStats();
+    counting = true;
+    return allocStats;
+}
+
+AllocStats stopCounting() {
+    counting = false;
+    return allocStats;
+}
+
+} // namespace
+
+extern "C" void *malloc(size_t size) {
+    void *p = __libc_malloc(size);
+    countAlloc(p);
+    return p;
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+    void *p = __libc_calloc(n, size);
+    countAlloc(p);
+    return p;
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    countFree(ptr);
+    void *p = __libc_realloc(ptr, size);
+    countAlloc(p);
+    return p;
+}
+
+extern "C" void free(void *ptr) {
+    countFree(ptr);
+    __libc_free(ptr);
+}
+
+using namespace ED_OTA;
+
+namespace {
+
+// ---------- listing generator ----------
+
+enum Style { NGINX, APACHE };
+
+struct Entry {
+    std::string name;
+    int version[4];
+};
+
+struct Listing {
+    std::string html;
+    std::vector<Entry> entries;   // target project candidates only
+};
+
+struct GenParams {
+    size_t entries = 1000;
+    int projects = 40;
+    const char *project = "P029";
+    uint32_t seed = 1;
+};
+
+/// @brief file names: every project gets a share of unique versions; most are
+/// .bin.lz4, some .bin or without build number, some are decoys (.sha256,
+/// .elf, other projects sharing the prefix) that must not be selected.
+std::vector<std::string> generateNames(const GenParams &p, std::vector<Entry> &candidates) {
+    std::mt19937 rng(p.seed);
+    std::vector<std::string> names;
+    std::vector<std::string> seen;
+    int targetIndex = atoi(p.project + 1);
+    for (size_t i = 0; i < p.entries; i++) {
+        int proj = (int)(rng() % p.projects);
+        bool target = proj == 0;
+        char prj[16];
+        if (target)
+            snprintf(prj, sizeof(prj), "%s", p.project);
+        else
+            snprintf(prj, sizeof(prj), "P%03d", (targetIndex + proj) % 1000);
+        int v[4] = {(int)(rng() % 4), (int)(rng() % 20), (int)(rng() % 30), (int)(rng() % 200)};
+        unsigned kind = rng() % 100;
+        bool noBuild = kind >= 80 && kind < 85;
+        if (noBuild)
+            v[3] = 0;
+        char key[64];
+        snprintf(key, sizeof(key), "%s %d.%d.%d-%d", prj, v[0], v[1], v[2], v[3]);
+        if (std::find(seen.begin(), seen.end(), key) != seen.end())
+            continue;   // one file per version keeps the expected result unique
+        seen.push_back(key);
+
+        char name[MAX_FILENAME_LEN];
+        const char *ext = kind < 70 ? ".bin.lz4" : kind < 80 ? ".bin" : kind < 85 ? ".bin.lz4"
+                        : kind < 92 ? ".bin.lz4.sha256" : ".elf";
+        bool candidate = target && kind < 85;
+        if (noBuild)
+            snprintf(name, sizeof(name), "%s_v%d.%d.%d%s", prj, v[0], v[1], v[2], ext);
+        else
+            snprintf(name, sizeof(name), "%s_v%d.%d.%d-%d%s", prj, v[0], v[1], v[2], v[3], ext);
+        names.push_back(name);
+        if (candidate)
+            candidates.push_back({name, {v[0], v[1], v[2], v[3]}});
+    }
+    // a decoy whose project only shares the prefix of the target
+    names.push_back(std::string(p.project) + "X_v9.9.9-9.bin.lz4");
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+Listing generateListing(Style style, const GenParams &p) {
+    Listing l;
+    std::vector<std::string> names = generateNames(p, l.entries);
+    const char *date = style == NGINX ? "14-Oct-2025 10:22" : "2025-10-14 10:22";
+    std::string &h = l.html;
+    if (style == NGINX) {
+        h = "<html>\r\n<head><title>Index of /fware/</title></head>\r\n<body>\r\n"
+            "<h1>Index of /fware/</h1><hr><pre><a href=\"../\">../</a>\r\n";
+        h += "<a href=\"obs/\">obs/</a>" + std::string(46, ' ') + date + "                   -\r\n";
+        for (const std::string &name : names) {
+            std::string shown = name.size() > 50 ? name.substr(0, 47) + "..&gt;" : name;
+            char line[256];
+            snprintf(line, sizeof(line), "%*s%s %19u\r\n", (int)(51 - std::min<size_t>(shown.size(), 50)),
+                     "", date, (unsigned)(100000 + name.size() * 997));
+            h += "<a href=\"" + name + "\">" + shown + "</a>" + line;
+        }
+        h += "</pre><hr></body>\r\n</html>\r\n";
+    } else {
+        h = "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 3.2 Final//EN\">\n<html>\n <head>\n"
+            "  <title>Index of /fware</title>\n </head>\n <body>\n<h1>Index of /fware</h1>\n"
+            "  <table>\n   <tr><th valign=\"top\"><img src=\"/icons/blank.gif\" alt=\"[ICO]\"></th>"
+            "<th><a href=\"?C=N;O=D\">Name</a></th><th><a href=\"?C=M;O=A\">Last modified</a></th>"
+            "<th><a href=\"?C=S;O=A\">Size</a></th><th><a href=\"?C=D;O=A\">Description</a></th></tr>\n"
+            "   <tr><th colspan=\"5\"><hr></th></tr>\n"
+            "<tr><td valign=\"top\"><img src=\"/icons/back.gif\" alt=\"[PARENTDIR]\"></td>"
+            "<td><a href=\"/\">Parent Directory</a></td><td>&nbsp;</td><td align=\"right\">  - </td>"
+            "<td>&nbsp;</td></tr>\n";
+        h += "<tr><td valign=\"top\"><img src=\"/icons/folder.gif\" alt=\"[DIR]\"></td>"
+             "<td><a href=\"obs/\">obs/</a></td><td align=\"right\">" + std::string(date) +
+             "  </td><td align=\"right\">  - </td><td>&nbsp;</td></tr>\n";
+        for (const std::string &name : names) {
+            std::string shown = name.size() > 23 ? name.substr(0, 20) + "..&gt;" : name;
+            h += "<tr><td valign=\"top\"><img src=\"/icons/unknown.gif\" alt=\"[   ]\"></td>"
+                 "<td><a href=\"" + name + "\">" + shown + "</a></td><td align=\"right\">" + date +
+                 "  </td><td align=\"right\">124K</td><td>&nbsp;</td></tr>\n";
+        }
+        h += "   <tr><th colspan=\"5\"><hr></th></tr>\n</table>\n"
+             "<address>Apache/2.4.57 (Debian) Server at fw.local Port 80</address>\n</body></html>\n";
+    }
+    return l;
+}
+
+/// @brief the file the scanner should pick: the highest candidate above
+/// current (latest), or the highest matching the given parts of the target.
+std::string expectedFile(const std::vector<Entry> &entries, const int ref[4], const bool locked[4],
+                         bool specific) {
+    const Entry *best = nullptr;
+    for (const Entry &e : entries) {
+        bool ok = true;
+        for (int i = 0; specific && i < 4; i++)
+            ok = ok && (!locked[i] || e.version[i] == ref[i]);
+        if (!ok)
+            continue;
+        const int *floor = best ? best->version : ref;
+        bool higher = std::lexicographical_compare(floor, floor + 4, e.version, e.version + 4);
+        if ((specific && best == nullptr) || higher)
+            best = &e;
+    }
+    return best ? best->name : "";
+}
+
+// ---------- chunking ----------
+
+enum ChunkMode { FIXED, SPLIT_HREF, RANDOM };
+
+/// @brief chunk lengths covering the listing; SPLIT_HREF cuts inside every
+/// file name, RANDOM uses uniform sizes in [1, size].
+std::vector<size_t> chunkPlan(const std::string &html, ChunkMode mode, size_t size, uint32_t seed) {
+    std::vector<size_t> plan;
+    size_t pos = 0;
+    std::mt19937 rng(seed);
+    std::vector<size_t> cuts;
+    if (mode == SPLIT_HREF) {
+        for (size_t at = html.find("href=\""); at != std::string::npos; at = html.find("href=\"", at + 1))
+            cuts.push_back(at + 6 + (at % 11));   // somewhere in the first characters of the name
+    }
+    size_t next = 0;
+    while (pos < html.size()) {
+        size_t n = size;
+        if (mode == RANDOM)
+            n = 1 + rng() % size;
+        if (mode == SPLIT_HREF) {
+            while (next < cuts.size() && cuts[next] <= pos)
+                next++;
+            if (next < cuts.size())
+                n = std::min(n, cuts[next] - pos);
+        }
+        n = std::min(n, html.size() - pos);
+        plan.push_back(n);
+        pos += n;
+    }
+    return plan;
+}
+
+// ---------- run ----------
+
+struct Result {
+    double seconds;
+    AllocStats setup;   // constructor (pattern compilation)
+    AllocStats scan;    // all parse calls
+    std::string selected;
+};
+
+Result runScanner(const std::string &html, const std::vector<size_t> &plan, const char *project,
+                  const char *version, FirmwareScanner::UpdateType mode) {
+    Result r;
+    // the session reads at most COMPRESSED_BLOCK_SIZE - 1 bytes and terminates them
+    static char chunk[COMPRESSED_BLOCK_SIZE];
+    int64_t t0 = otaNowUs();
+    startCounting();
+    FirmwareScanner *scanner = new FirmwareScanner(project, version, mode);
+    r.setup = stopCounting();
+    startCounting();
+    size_t pos = 0;
+    for (size_t n : plan) {
+        memcpy(chunk, html.data() + pos, n);
+        chunk[n] = '\0';
+        scanner->file_scanner_parse_chunk(chunk, n);
+        pos += n;
+    }
+    r.scan = stopCounting();
+    r.seconds = (otaNowUs() - t0) / 1e6;
+    r.selected = scanner->targetFwFile() ? scanner->targetFwFile() : "";
+    delete scanner;
+    return r;
+}
+
+std::vector<size_t> parseList(const char *arg) {
+    std::vector<size_t> values;
+    for (const char *p = arg; *p;) {
+        char *end;
+        unsigned long v = strtoul(p, &end, 0);
+        if (end == p)
+            break;
+        values.push_back((size_t)v);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+std::string jsonString(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c >= 0x20)
+            out += c;
+    }
+    return out + "\"";
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "      --entries LIST    listing sizes (default 100,1000,10000)\n"
+            "      --projects N      projects sharing the directory (default 40)\n"
+            "      --project NAME    project being updated (default P029)\n"
+            "      --style S         nginx, apache or both (default both)\n"
+            "      --chunks LIST     fixed chunk sizes, at most %d (default 64,512,1436,%d)\n"
+            "      --current V       running version for the latest search (default v1.5.0-0)\n"
+            "      --target V        version prefix for the specific search (default: the\n"
+            "                        major.minor of a generated candidate)\n"
+            "      --seed N          generator seed (default 1)\n"
+            "      --reps N          runs per case, best reported (default 5)\n"
+            "      --dump FILE       write the generated listing of the first case and exit\n"
+            "      --label TEXT      stored in the report\n"
+            "  -o, --out FILE        JSON report (default stdout)\n",
+            prog, COMPRESSED_BLOCK_SIZE - 1, COMPRESSED_BLOCK_SIZE - 1);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"entries", required_argument, nullptr, 'e'},
+        {"projects", required_argument, nullptr, 'P'},
+        {"project", required_argument, nullptr, 'p'},
+        {"style", required_argument, nullptr, 's'},
+        {"chunks", required_argument, nullptr, 'c'},
+        {"current", required_argument, nullptr, 'C'},
+        {"target", required_argument, nullptr, 't'},
+        {"seed", required_argument, nullptr, 'S'},
+        {"reps", required_argument, nullptr, 'r'},
+        {"dump", required_argument, nullptr, 'd'},
+        {"label", required_argument, nullptr, 'l'},
+        {"out", required_argument, nullptr, 'o'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    std::vector<size_t> entryCounts = {100, 1000, 10000};
+    std::vector<size_t> chunkSizes = {64, 512, 1436, COMPRESSED_BLOCK_SIZE - 1};
+    GenParams gen;
+    bool styles[2] = {true, true};
+    const char *current = "v1.5.0-0", *target = nullptr, *dumpPath = nullptr, *outPath = nullptr;
+    std::string label;
+    int reps = 5;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:h", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'e': entryCounts = parseList(optarg); break;
+            case 'P': gen.projects = std::max(1, atoi(optarg)); break;
+            case 'p': gen.project = optarg; break;
+            case 's':
+                styles[NGINX] = strcmp(optarg, "apache") != 0;
+                styles[APACHE] = strcmp(optarg, "nginx") != 0;
+                break;
+            case 'c': chunkSizes = parseList(optarg); break;
+            case 'C': current = optarg; break;
+            case 't': target = optarg; break;
+            case 'S': gen.seed = (uint32_t)strtoul(optarg, nullptr, 0); break;
+            case 'r': reps = std::max(1, atoi(optarg)); break;
+            case 'd': dumpPath = optarg; break;
+            case 'l': label = optarg; break;
+            case 'o': outPath = optarg; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    for (size_t size : chunkSizes) {
+        if (size == 0 || size >= COMPRESSED_BLOCK_SIZE) {
+            fprintf(stderr, "chunk sizes must be 1..%d\n", COMPRESSED_BLOCK_SIZE - 1);
+            return 2;
+        }
+    }
+    if (optind != argc || entryCounts.empty() || chunkSizes.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    otaLogLevel = 'E';
+
+    if (dumpPath) {
+        gen.entries = entryCounts[0];
+        Listing l = generateListing(styles[NGINX] ? NGINX : APACHE, gen);
+        FILE *f = fopen(dumpPath, "w");
+        if (f == nullptr || fwrite(l.html.data(), 1, l.html.size(), f) != l.html.size()) {
+            perror(dumpPath);
+            return 1;
+        }
+        fclose(f);
+        return 0;
+    }
+
+    // reference versions, parsed the way the scanner documents them
+    int curV[4] = {};
+    bool curP[4] = {};
+    auto parse = [](const char *s, int v[4], bool present[4]) {
+        const char *p = s + (*s == 'v');
+        for (int i = 0; i < 4 && *p; i++) {
+            char *end;
+            v[i] = (int)strtol(p, &end, 10);
+            if (end == p)
+                break;
+            present[i] = true;
+            p = end + (*end == '.' || *end == '-');
+        }
+    };
+    parse(current, curV, curP);
+
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (out == nullptr) {
+        perror(outPath);
+        return 1;
+    }
+    fprintf(out, "{\n  \"tool\": \"ota_bench_scanner\",\n  \"rev\": %s,\n  \"label\": %s,\n"
+                 "  \"engine\": \"FirmwareScanner\",\n  \"seed\": %u,\n  \"reps\": %d,\n  \"results\": [",
+            jsonString(ED_OTA_GIT_REV).c_str(), jsonString(label).c_str(), (unsigned)gen.seed, reps);
+
+    bool allCorrect = true, first = true;
+    for (int style = NGINX; style <= APACHE; style++) {
+        if (!styles[style])
+            continue;
+        for (size_t count : entryCounts) {
+            gen.entries = count;
+            Listing listing = generateListing((Style)style, gen);
+            std::string targetVersion = target ? target : "v0.0";
+            if (!target && !listing.entries.empty()) {
+                const Entry &mid = listing.entries[listing.entries.size() / 2];
+                targetVersion = "v" + std::to_string(mid.version[0]) + "." +
+                                std::to_string(mid.version[1]);
+            }
+            int tgtV[4] = {};
+            bool tgtP[4] = {};
+            parse(targetVersion.c_str(), tgtV, tgtP);
+            size_t hrefs = 0;
+            for (size_t at = listing.html.find("href=\""); at != std::string::npos;
+                 at = listing.html.find("href=\"", at + 1))
+                hrefs++;
+
+            struct Case {
+                ChunkMode mode;
+                size_t size;
+            };
+            std::vector<Case> cases;
+            for (size_t size : chunkSizes)
+                cases.push_back({FIXED, size});
+            cases.push_back({SPLIT_HREF, COMPRESSED_BLOCK_SIZE - 1});
+            cases.push_back({RANDOM, COMPRESSED_BLOCK_SIZE - 1});
+
+            for (const Case &c : cases) {
+                std::vector<size_t> plan = chunkPlan(listing.html, c.mode, c.size, gen.seed);
+                for (int specific = 0; specific <= 1; specific++) {
+                    const char *version = specific ? targetVersion.c_str() : current;
+                    std::string expected = specific
+                                               ? expectedFile(listing.entries, tgtV, tgtP, true)
+                                               : expectedFile(listing.entries, curV, curP, false);
+                    std::vector<Result> runs;
+                    for (int rep = 0; rep < reps; rep++)
+                        runs.push_back(runScanner(listing.html, plan, gen.project, version,
+                                                  specific ? FirmwareScanner::UPDATE_TO_SPECIFIC
+                                                           : FirmwareScanner::UPDATE_TO_LATEST));
+                    std::sort(runs.begin(), runs.end(),
+                              [](const Result &a, const Result &b) { return a.seconds < b.seconds; });
+                    const Result &best = runs.front();
+                    bool correct = best.selected == expected;
+                    allCorrect = allCorrect && correct;
+                    static const char *const modeNames[] = {"fixed", "split-href", "random"};
+                    fprintf(out,
+                            "%s\n    {\"style\": \"%s\", \"entries\": %zu, \"hrefs\": %zu, "
+                            "\"listingBytes\": %zu, \"chunking\": \"%s\", \"chunkSize\": %zu, "
+                            "\"chunks\": %zu, \"search\": \"%s\", \"version\": %s, "
+                            "\"entriesPerSec\": %.0f, \"MBps\": %.2f, "
+                            "\"setupAllocs\": %zu, \"setupAllocBytes\": %zu, "
+                            "\"scanAllocs\": %zu, \"scanAllocBytes\": %zu, \"scanPeakHeap\": %ld, "
+                            "\"selected\": %s, \"expected\": %s, \"correct\": %s}",
+                            first ? "" : ",", style == NGINX ? "nginx" : "apache", count, hrefs,
+                            listing.html.size(), modeNames[c.mode], c.size, plan.size(),
+                            specific ? "specific" : "latest", jsonString(version).c_str(),
+                            best.seconds > 0 ? hrefs / best.seconds : 0,
+                            best.seconds > 0 ? listing.html.size() / 1e6 / best.seconds : 0,
+                            best.setup.calls, best.setup.bytes, best.scan.calls, best.scan.bytes,
+                            best.scan.peak, jsonString(best.selected).c_str(),
+                            jsonString(expected).c_str(), correct ? "true" : "false");
+                    first = false;
+                }
+            }
+        }
+    }
+    fprintf(out, "\n  ],\n  \"allCorrect\": %s\n}\n", allCorrect ? "true" : "false");
+    if (out != stdout)
+        fclose(out);
+    return allCorrect ? 0 : 1;
+}
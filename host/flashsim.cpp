@@ -0,0 +1,237 @@
+#include "flashsim.h"
+#include <algorithm>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace ED_OTA {
+
+static const char *TAG = "ED_OTA";
+
+// W25Q32-class datasheet figures: tSE, tBE1, tBP1, tBP2 (typical and maximum)
+static const FlashTiming timings[] = {
+    {"typical", 45000, 150000, 30, 2.5f, 64},
+    {"worst", 400000, 2000000, 50, 12, 64},
+};
+
+const FlashTiming *flashTiming(const char *name) {
+    for (const FlashTiming &t : timings) {
+        if (strcmp(t.name, name) == 0)
+            return &t;
+    }
+    return nullptr;
+}
+
+FlashSimSink::FlashSimSink(size_t partitionSize, const FlashTiming &timing,
+                           const FlashPolicy &p, OtaSink *mirrorSink)
+    : t(timing), policy(p), mirror(mirrorSink),
+      flash((partitionSize + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE),
+      wear(flash.size() / FLASH_SECTOR_SIZE), erased(wear.size()) {
+    t.programChunk = std::max<uint16_t>(1, std::min<uint16_t>(t.programChunk, FLASH_PAGE_SIZE));
+    // stale content of the slot, so a missing erase shows up
+    for (size_t i = 0; i < flash.size(); i++)
+        flash[i] = (uint8_t)(i * 131 + (i >> 12));
+}
+
+/// @brief waits for the chip until us, counted as time blocked on flash.
+void FlashSimSink::waitUntil(int64_t us) {
+    int64_t now = otaNowUs();
+    while (now < us) {
+        otaSleepUs((uint32_t)std::min<int64_t>(us - now, UINT32_MAX));
+        int64_t then = otaNowUs();
+        st.blockedUs += then - now;
+        now = then;
+    }
+}
+
+/// @brief returns once at most allowedBytes of programming are still queued.
+void FlashSimSink::waitQueue(size_t allowedBytes) {
+    int64_t now = otaNowUs();
+    size_t queued = 0;
+    while (!queue.empty() && queue.front().endUs <= now)
+        queue.pop_front();
+    for (const Op &op : queue)
+        queued += op.bytes;
+    while (queued > allowedBytes) {
+        waitUntil(queue.front().endUs);
+        queued -= queue.front().bytes;
+        queue.pop_front();
+    }
+}
+
+/// @brief one flash operation: the cache is off for its whole duration.
+void FlashSimSink::operation(float us, size_t bytes) {
+    int64_t now = otaNowUs();
+    int64_t start = std::max(now, chipFreeUs);
+    chipFreeUs = start + (int64_t)us;
+    st.busyUs += (int64_t)us;
+    st.cacheOffUs += (int64_t)us;
+    st.maxCacheOffUs = std::max(st.maxCacheOffUs, (int64_t)us);
+    if (policy.queueBytes == 0) {
+        waitUntil(chipFreeUs);
+        return;
+    }
+    queue.push_back({chipFreeUs, bytes});
+    waitQueue(policy.queueBytes);
+}
+
+void FlashSimSink::eraseSector(size_t sector) {
+    memset(&flash[sector * FLASH_SECTOR_SIZE], 0xFF, FLASH_SECTOR_SIZE);
+    erased[sector] = true;
+    st.maxWear = std::max(st.maxWear, ++wear[sector]);
+    st.sectorErases++;
+    operation(t.sectorEraseUs, 0);
+}
+
+void FlashSimSink::eraseBlock(size_t block) {
+    size_t perBlock = FLASH_BLOCK_SIZE / FLASH_SECTOR_SIZE;
+    memset(&flash[block * FLASH_BLOCK_SIZE], 0xFF, FLASH_BLOCK_SIZE);
+    for (size_t s = block * perBlock; s < (block + 1) * perBlock; s++) {
+        erased[s] = true;
+        st.maxWear = std::max(st.maxWear, ++wear[s]);
+    }
+    st.blockErases++;
+    operation(t.blockEraseUs, 0);
+}
+
+bool FlashSimSink::begin(bool sequentialErase) {
+    if (mirror && !mirror->begin(sequentialErase))
+        return false;
+    uint32_t maxWear = 0;
+    for (uint32_t w : wear)
+        maxWear = std::max(maxWear, w);
+    st = {};
+    st.maxWear = maxWear;
+    queue.clear();
+    pending.clear();
+    chipFreeUs = 0;
+    written = 0;
+    sequential = sequentialErase;
+    active = true;
+    std::fill(erased.begin(), erased.end(), false);
+    if (!sequential) {
+        // esp_ota_begin(OTA_SIZE_UNKNOWN) erases the whole slot up front
+        for (size_t off = 0; off < flash.size();) {
+            if (off % FLASH_BLOCK_SIZE == 0 && flash.size() - off >= FLASH_BLOCK_SIZE) {
+                eraseBlock(off / FLASH_BLOCK_SIZE);
+                off += FLASH_BLOCK_SIZE;
+            } else {
+                eraseSector(off / FLASH_SECTOR_SIZE);
+                off += FLASH_SECTOR_SIZE;
+            }
+        }
+    }
+    return true;
+}
+
+bool FlashSimSink::program(const uint8_t *data, size_t len) {
+    if (written + len > flash.size()) {
+        OTA_LOGE(TAG, "Failed to write OTA chunk: image exceeds the %u byte partition",
+                 (unsigned)flash.size());
+        return false;
+    }
+    if (sequential) {
+        // OTA_WITH_SEQUENTIAL_WRITES erases each sector as writing reaches it;
+        // erase-ahead keeps the next sectors ready
+        size_t first = written / FLASH_SECTOR_SIZE;
+        size_t last = (written + len - 1) / FLASH_SECTOR_SIZE + policy.eraseAhead;
+        last = std::min(last, erased.size() - 1);
+        for (size_t s = first; s <= last; s++) {
+            if (!erased[s])
+                eraseSector(s);
+        }
+    }
+    bool ok = true;
+    while (len > 0) {
+        size_t pageLeft = FLASH_PAGE_SIZE - written % FLASH_PAGE_SIZE;
+        size_t n = std::min({len, pageLeft, (size_t)t.programChunk});
+        for (size_t i = 0; i < n; i++) {
+            uint8_t &cell = flash[written + i];
+            if ((cell & data[i]) != data[i])
+                ok = false;
+            cell &= data[i];   // NOR programming only clears bits
+        }
+        st.programOps++;
+        st.programBytes += n;
+        operation(t.programFirstUs + (n - 1) * t.programNextUs, n);
+        written += n;
+        data += n;
+        len -= n;
+    }
+    if (!ok) {
+        st.unerasedWrites++;
+        OTA_LOGE(TAG, "Failed to write OTA chunk: programmed over unerased flash at 0x%x",
+                 (unsigned)written);
+    }
+    return ok;
+}
+
+bool FlashSimSink::write(const uint8_t *data, size_t len) {
+    if (!active)
+        return false;
+    if (mirror && !mirror->write(data, len))
+        return false;
+    if (policy.coalesce == 0)
+        return program(data, len);
+    pending.insert(pending.end(), data, data + len);
+    if (pending.size() < policy.coalesce)
+        return true;
+    bool ok = program(pending.data(), pending.size());
+    pending.clear();
+    return ok;
+}
+
+bool FlashSimSink::finish() {
+    if (!active)
+        return false;
+    bool ok = pending.empty() || program(pending.data(), pending.size());
+    pending.clear();
+    waitUntil(chipFreeUs);
+    queue.clear();
+    active = false;
+    if (ok && written == 0) {
+        OTA_LOGE(TAG, "Failed to complete OTA: empty image");
+        ok = false;
+    }
+    if (mirror) {
+        if (ok)
+            ok = mirror->finish();
+        else
+            mirror->abort();
+    }
+    return ok;
+}
+
+void FlashSimSink::abort() {
+    if (!active)
+        return;
+    pending.clear();
+    queue.clear();
+    active = false;
+    if (mirror)
+        mirror->abort();
+}
+
+bool FlashSimSink::loadWear(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == nullptr)
+        return errno == ENOENT;   // first run: no wear yet
+    unsigned count;
+    for (size_t s = 0; s < wear.size() && fscanf(f, "%u", &count) == 1; s++)
+        wear[s] = count;
+    fclose(f);
+    return true;
+}
+
+bool FlashSimSink::saveWear(const char *path) const {
+    FILE *f = fopen(path, "w");
+    if (f == nullptr) {
+        OTA_LOGE(TAG, "cannot write %s: %s", path, strerror(errno));
+        return false;
+    }
+    for (uint32_t w : wear)
+        fprintf(f, "%u\n", (unsigned)w);
+    return fclose(f) == 0;
+}
+
+} // namespace ED_OTA
@@ -0,0 +1,127 @@
+// #region StdManifest
+/**
+ * @file flashsim.h
+ * @brief simulated NOR flash OTA partition for the host harness: an OtaSink
+ * with sector/block erase and page program timing, cache-disable windows,
+ * NOR program semantics and optional wear counters.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_platform.h"
+#include <deque>
+#include <vector>
+
+#define FLASH_SECTOR_SIZE 4096
+#define FLASH_BLOCK_SIZE 65536
+#define FLASH_PAGE_SIZE 256
+
+namespace ED_OTA {
+
+/// @brief SPI NOR timing, in microseconds. A program transaction of n bytes
+/// (within one page, at most programChunk) takes
+/// programFirstUs + (n - 1) * programNextUs.
+struct FlashTiming {
+  const char *name;
+  float sectorEraseUs;   // 4 KB sector erase
+  float blockEraseUs;    // 64 KB block erase
+  float programFirstUs;  // first byte of a program transaction
+  float programNextUs;   // every further byte of the same transaction
+  uint16_t programChunk; // bytes per transaction (SPI host limit, 64 on ESP32)
+};
+
+/// @brief "typical" and "worst" (datasheet maximum) timings of a common
+/// 32 Mbit SPI NOR part; nullptr for unknown names.
+const FlashTiming *flashTiming(const char *name);
+
+/// @brief how the sink drives the simulated chip.
+struct FlashPolicy {
+  size_t queueBytes = 0;   // 0: every operation blocks (esp_ota_write);
+                           // else writes return while the chip works through
+                           // up to queueBytes of queued programming
+  int eraseAhead = 0;      // sequential erase: sectors erased ahead of writing
+  size_t coalesce = 0;     // buffer writes until this many bytes, 0 = off
+};
+
+struct FlashStats {
+  uint32_t sectorErases;
+  uint32_t blockErases;
+  uint32_t programOps;      // page program transactions
+  uint64_t programBytes;
+  int64_t busyUs;           // time the chip was erasing or programming
+  int64_t blockedUs;        // time write()/finish() waited for the chip
+  int64_t cacheOffUs;       // sum of cache-disable windows (one per operation)
+  int64_t maxCacheOffUs;    // longest single window
+  uint32_t maxWear;         // highest erase count of any sector
+  uint32_t unerasedWrites;  // program attempts over bits that were not erased
+};
+
+/**
+ * @brief OtaSink writing into an in-memory NOR partition.
+ *
+ * begin(false) erases the whole partition like esp_ota_begin with
+ * OTA_SIZE_UNKNOWN (64 KB blocks where aligned, 4 KB sectors elsewhere);
+ * begin(true) erases each sector when writing first reaches it, like
+ * OTA_WITH_SEQUENTIAL_WRITES. Programming can only clear bits: writing over
+ * a byte that was not erased is reported and fails the write. Operation
+ * times are spent with otaSleepUs(), so the virtual clock applies.
+ */
+class FlashSimSink : public OtaSink {
+public:
+  /// @brief mirror, when given, receives the same begin/write/finish/abort
+  /// calls (e.g. a FileSink keeping the image on disk).
+  FlashSimSink(size_t partitionSize, const FlashTiming &timing,
+               const FlashPolicy &policy = FlashPolicy(), OtaSink *mirror = nullptr);
+
+  /// @brief the mirror's answer: the simulated slot keeps no image between runs.
+  Held holds(const uint8_t *digest, size_t imageSize) override {
+    return mirror ? mirror->holds(digest, imageSize) : HELD_NONE;
+  }
+  bool activate() override { return mirror && mirror->activate(); }
+  bool begin(bool sequentialErase) override;
+  bool write(const uint8_t *data, size_t len) override;
+  bool finish() override;
+  void abort() override;
+
+  /// @brief the image written by the last session (finish() keeps it).
+  const uint8_t *image() const { return flash.data(); }
+  size_t imageSize() const { return written; }
+  const FlashStats &stats() const { return st; }
+  /// @brief erase counts per sector; loadWear/saveWear keep them across runs.
+  bool loadWear(const char *path);
+  bool saveWear(const char *path) const;
+
+private:
+  struct Op {
+    int64_t endUs;
+    size_t bytes;   // programmed bytes, 0 for erases
+  };
+
+  FlashTiming t;
+  FlashPolicy policy;
+  OtaSink *mirror;
+  std::vector<uint8_t> flash;
+  std::vector<uint32_t> wear;
+  std::vector<bool> erased;   // erased since begin()
+  std::vector<uint8_t> pending;
+  std::deque<Op> queue;
+  int64_t chipFreeUs = 0;     // when the chip finishes its queued operations
+  size_t written = 0;
+  bool sequential = false;
+  bool active = false;
+  FlashStats st = {};
+
+  void eraseSector(size_t sector);
+  void eraseBlock(size_t block);
+  bool program(const uint8_t *data, size_t len);
+  void operation(float us, size_t bytes);
+  void waitQueue(size_t allowedBytes);
+  void waitUntil(int64_t us);
+};
+
+} // namespace ED_OTA
@@ -0,0 +1,362 @@
+// #region StdManifest
+/**
+ * @file footprint.cpp
+ * @brief memory and stack footprint of the OTA session: runs full
+ * scan-download-verify cycles on a painted thread stack with the allocator
+ * interposed and reports peak heap, allocation count, largest allocation and
+ * peak stack as JSON. Soak mode repeats the cycle to expose leaks and heap
+ * fragmentation.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "ED_OTA_posix.h"
+#include "ED_OTA_session.h"
+#include <algorithm>
+#include <getopt.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+
+#ifndef ED_OTA_GIT_REV
+#define ED_OTA_GIT_REV "unknown"
+#endif
+
+#define STACK_PAINT 0xA5
+
+// ---------- allocation counting ----------
+// glibc lets the executable interpose malloc; the counters only run while a
+// session thread exists, see runOnPaintedStack().
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+namespace {
+
+struct AllocStats {
+    size_t calls = 0;
+    size_t bytes = 0;
+    size_t largest = 0;
+    long live = 0;
+    long peak = 0;
+};
+
+bool counting = false;
+AllocStats allocStats;
+
+void countAlloc(void *ptr) {
+    if (!counting || ptr == nullptr)
+        return;
+    size_t size = malloc_usable_size(ptr);
+    allocStats.calls++;
+    allocStats.bytes += size;
+    allocStats.largest = std::max(allocStats.largest, size);
+    allocStats.live += (long)size;
+    allocStats.peak = std::max(allocStats.peak, allocStats.live);
+}
+
+void countFree(void *ptr) {
+    if (counting && ptr != nullptr)
+        allocStats.live -= (long)malloc_usable_size(ptr);
+}
+
+} // namespace
+
+extern "C" void *malloc(size_t size) {
+    void *p = __libc_malloc(size);
+    countAlloc(p);
+    return p;
+}
+
+extern "C" void *calloc(size_t n, size_t size) {
+    void *p = __libc_calloc(n, size);
+    countAlloc(p);
+    return p;
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    countFree(ptr);
+    void *p = __libc_realloc(ptr, size);
+    countAlloc(p);
+    return p;
+}
+
+extern "C" void free(void *ptr) {
+    countFree(ptr);
+    __libc_free(ptr);
+}
+
+using namespace ED_OTA;
+
+namespace {
+
+/// @brief discards the image but keeps its size and an FNV-1a digest, so
+/// every soak cycle can be checked against the first one without file I/O.
+class DigestSink : public OtaSink {
+public:
+    bool begin(bool) override {
+        size = 0;
+        digest = 1469598103934665603ull;
+        return true;
+    }
+    bool write(const uint8_t *data, size_t len) override {
+        for (size_t i = 0; i < len; i++)
+            digest = (digest ^ data[i]) * 1099511628211ull;
+        size += len;
+        return true;
+    }
+    bool finish() override { return size > 0; }
+    void abort() override {}
+
+    size_t size = 0;
+    uint64_t digest = 0;
+};
+
+struct Config {
+    const char *project = nullptr;
+    const char *current = "v0.0.0-0";
+    OtaRequest request = {};
+    const char *storage = nullptr;
+    const char *fallback = nullptr;
+};
+
+struct Cycle {
+    bool done = false;
+    size_t written = 0;
+    uint64_t digest = 0;
+    AllocStats alloc;
+    int64_t us = 0;
+};
+
+struct ThreadJob {
+    const Config *config;   // nullptr: empty thread, measures the baseline
+    Cycle cycle;
+};
+
+/// @brief one full session, driven like the device worker drives it.
+void *sessionThread(void *arg) {
+    ThreadJob *job = (ThreadJob *)arg;
+    if (job->config == nullptr)
+        return nullptr;
+    const Config &c = *job->config;
+    int64_t t0 = otaNowUs();
+    {
+        PosixHttpSource source;
+        DigestSink sink;
+        OtaContext ctx = {&source, &sink, c.project, c.current};
+        OtaSession session(c.request, c.storage, c.fallback, ctx);
+        session.setLimits(OtaSession::limitsFor(c.request));
+        session.setStepBudget(c.request.stepBudgetUs);
+        while (!session.finished()) {
+            session.step();
+            if (uint32_t waitUs = session.waitHintUs())
+                otaSleepUs(waitUs);
+        }
+        job->cycle.done = session.state() == OtaSession::DONE;
+        job->cycle.written = sink.size;
+        job->cycle.digest = sink.digest;
+    }
+    job->cycle.us = otaNowUs() - t0;
+    return nullptr;
+}
+
+/// @brief runs job on a freshly painted stack; returns the bytes of stack
+/// the thread touched, or 0 when the thread could not be started.
+size_t runOnPaintedStack(uint8_t *stack, size_t stackSize, ThreadJob &job) {
+    memset(stack, STACK_PAINT, stackSize);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, stackSize);
+    pthread_t thread;
+    // counted from before the thread is created until it has been joined, so
+    // thread bookkeeping and exit handlers (e.g. TLS error state) balance out
+    allocStats = AllocStats();
+    counting = true;
+    bool started = pthread_create(&thread, &attr, sessionThread, &job) == 0;
+    pthread_attr_destroy(&attr);
+    if (!started) {
+        counting = false;
+        return 0;
+    }
+    pthread_join(thread, nullptr);
+    counting = false;
+    job.cycle.alloc = allocStats;
+    // the stack grows down: the lowest overwritten byte marks the peak
+    size_t untouched = 0;
+    while (untouched < stackSize && stack[untouched] == STACK_PAINT)
+        untouched++;
+    return stackSize - untouched;
+}
+
+std::string jsonString(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c >= 0x20)
+            out += c;
+    }
+    return out + "\"";
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] <storage-url> [fallback-url]\n"
+            "  -p, --project NAME     firmware project (required)\n"
+            "  -c, --current VERSION  running version (default v0.0.0-0)\n"
+            "  -t, --target VERSION   target version (prefix), default latest\n"
+            "      --slice US         sliced mode step budget\n"
+            "      --cycles N         consecutive sessions, soak mode above 1 (default 1)\n"
+            "      --stack KB         painted thread stack (default 256)\n"
+            "      --max-stack BYTES  fail when the session stack exceeds BYTES\n"
+            "      --max-heap BYTES   fail when the session heap peak exceeds BYTES\n"
+            "      --label TEXT       stored in the report\n"
+            "  -o, --out FILE         JSON report (default stdout)\n",
+            prog);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"project", required_argument, nullptr, 'p'},
+        {"current", required_argument, nullptr, 'c'},
+        {"target", required_argument, nullptr, 't'},
+        {"slice", required_argument, nullptr, 'S'},
+        {"cycles", required_argument, nullptr, 'n'},
+        {"stack", required_argument, nullptr, 'k'},
+        {"max-stack", required_argument, nullptr, 'K'},
+        {"max-heap", required_argument, nullptr, 'H'},
+        {"label", required_argument, nullptr, 'l'},
+        {"out", required_argument, nullptr, 'o'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    Config config;
+    int cycles = 1;
+    size_t stackSize = 256 * 1024;
+    size_t maxStack = 0, maxHeap = 0;
+    const char *outPath = nullptr;
+    std::string label;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:c:t:o:h", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'p': config.project = optarg; break;
+            case 'c': config.current = optarg; break;
+            case 't':
+                if (!config.request.setTarget(optarg)) {
+                    fprintf(stderr, "version target too long: %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'S': config.request.stepBudgetUs = (uint32_t)atoi(optarg); break;
+            case 'n': cycles = std::max(1, atoi(optarg)); break;
+            case 'k': stackSize = std::max(64, atoi(optarg)) * (size_t)1024; break;
+            case 'K': maxStack = (size_t)atol(optarg); break;
+            case 'H': maxHeap = (size_t)atol(optarg); break;
+            case 'l': label = optarg; break;
+            case 'o': outPath = optarg; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (config.project == nullptr || optind >= argc || argc - optind > 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    std::string storage = argv[optind];
+    std::string fallback = optind + 1 < argc ? argv[optind + 1] : "";
+    for (std::string *url : {&storage, &fallback})
+        if (!url->empty() && url->back() != '/')
+            *url += '/';
+    config.storage = storage.c_str();
+    config.fallback = fallback.empty() ? nullptr : fallback.c_str();
+    otaLogLevel = 'E';
+    otaSetVirtualClock(true);   // governor waits cost no wall time
+
+    void *mem = mmap(nullptr, stackSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    uint8_t *stack = (uint8_t *)mem;
+
+    // thread start-up and TLS live on the same stack: measured once, subtracted
+    ThreadJob idle = {nullptr, {}};
+    size_t baseline = runOnPaintedStack(stack, stackSize, idle);
+
+    Cycle first;
+    size_t stackPeak = 0, heapPeak = 0, largest = 0, callsMax = 0;
+    long retainedFirst = 0, leaked = 0, leakedMax = 0;
+    size_t arenaFirst = 0, arenaLast = 0, freeFirst = 0, freeLast = 0;
+    int failures = 0, mismatches = 0;
+    int64_t totalUs = 0;
+    for (int i = 0; i < cycles; i++) {
+        ThreadJob job = {&config, {}};
+        size_t used = runOnPaintedStack(stack, stackSize, job);
+        if (used == 0 || used >= stackSize) {
+            fprintf(stderr, "session thread %s\n", used ? "overflowed its stack" : "not started");
+            return 1;
+        }
+        const Cycle &c = job.cycle;
+        struct mallinfo2 mi = mallinfo2();
+        if (i == 0) {
+            first = c;
+            retainedFirst = c.alloc.live;   // one-time state, e.g. a TLS context
+            arenaFirst = mi.arena;
+            freeFirst = mi.fordblks;
+        } else {
+            leaked += c.alloc.live;
+            leakedMax = std::max(leakedMax, c.alloc.live);
+            if (c.done && (c.written != first.written || c.digest != first.digest))
+                mismatches++;
+        }
+        arenaLast = mi.arena;
+        freeLast = mi.fordblks;
+        failures += !c.done;
+        stackPeak = std::max(stackPeak, used - std::min(used, baseline));
+        heapPeak = std::max(heapPeak, (size_t)c.alloc.peak);
+        largest = std::max(largest, c.alloc.largest);
+        callsMax = std::max(callsMax, c.alloc.calls);
+        totalUs += c.us;
+    }
+    munmap(mem, stackSize);
+
+    bool ok = failures == 0 && mismatches == 0 && leaked == 0 &&
+              (maxStack == 0 || stackPeak <= maxStack) && (maxHeap == 0 || heapPeak <= maxHeap);
+    FILE *out = outPath ? fopen(outPath, "w") : stdout;
+    if (out == nullptr) {
+        perror(outPath);
+        return 1;
+    }
+    fprintf(out,
+            "{\n  \"tool\": \"ota_footprint\",\n  \"rev\": %s,\n  \"label\": %s,\n"
+            "  \"project\": %s,\n  \"storage\": %s,\n  \"sliceUs\": %u,\n  \"cycles\": %d,\n"
+            "  \"written\": %u,\n  \"sessionObjectBytes\": %u,\n"
+            "  \"stackPeakBytes\": %u,\n  \"stackBaselineBytes\": %u,\n"
+            "  \"heapPeakBytes\": %u,\n  \"allocCalls\": %u,\n  \"allocBytes\": %u,\n"
+            "  \"largestAllocBytes\": %u,\n  \"retainedFirstCycleBytes\": %ld,\n"
+            "  \"leakedBytes\": %ld,\n  \"leakedMaxPerCycle\": %ld,\n"
+            "  \"arenaBytes\": [%u, %u],\n  \"arenaFreeBytes\": [%u, %u],\n"
+            "  \"failedCycles\": %d,\n  \"mismatchedCycles\": %d,\n  \"secondsPerCycle\": %.4f,\n"
+            "  \"limits\": {\"stack\": %u, \"heap\": %u},\n  \"pass\": %s\n}\n",
+            jsonString(ED_OTA_GIT_REV).c_str(), jsonString(label).c_str(),
+            jsonString(config.project).c_str(), jsonString(storage).c_str(),
+            (unsigned)config.request.stepBudgetUs, cycles, (unsigned)first.written,
+            (unsigned)sizeof(OtaSession), (unsigned)stackPeak, (unsigned)baseline,
+            (unsigned)heapPeak, (unsigned)callsMax, (unsigned)first.alloc.bytes,
+            (unsigned)largest, retainedFirst, leaked, leakedMax, (unsigned)arenaFirst,
+            (unsigned)arenaLast, (unsigned)freeFirst, (unsigned)freeLast, failures, mismatches,
+            totalUs / 1e6 / cycles, (unsigned)maxStack, (unsigned)maxHeap, ok ? "true" : "false");
+    if (out != stdout)
+        fclose(out);
+    return ok ? 0 : 1;
+}
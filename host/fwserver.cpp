@@ -0,0 +1,585 @@
+// #region StdManifest
+/**
+ * @file fwserver.cpp
+ * @brief local stand-in for the firmware server: serves a directory with
+ * nginx-style autoindex listings, Range, ETag/304, chunked transfer and
+ * optional TLS, with injectable bandwidth caps, latency, mid-stream
+ * disconnects and 503/Retry-After.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-15
+ */
+// #endregion
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <string>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#ifdef ED_OTA_HOST_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+namespace {
+
+struct Config {
+    std::string root;
+    std::string bind = "127.0.0.1";
+    int port = 8080;
+    size_t chunkSize = 0;        // 0 = Content-Length bodies
+    uint32_t bandwidthBps = 0;   // 0 = unlimited
+    uint32_t latencyMs = 0;      // before the response headers
+    int64_t dropAfter = -1;      // close file bodies after this many bytes
+    int dropCount = -1;          // how many file bodies to cut, -1 = all
+    int unavailable = 0;         // answer the first N requests with 503
+    int retryAfter = 1;
+    std::string cert, key;
+    bool quiet = false;
+};
+
+Config cfg;
+std::atomic<int> requestCount{0};
+std::atomic<int> dropped{0};
+#ifdef ED_OTA_HOST_TLS
+SSL_CTX *tlsCtx = nullptr;
+#endif
+
+/// @brief one client connection, plain or TLS.
+class Connection {
+public:
+    explicit Connection(int fd) : fd(fd) {}
+    ~Connection() {
+#ifdef ED_OTA_HOST_TLS
+        if (ssl) {
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+        }
+#endif
+        close(fd);
+    }
+
+    bool handshake() {
+#ifdef ED_OTA_HOST_TLS
+        if (tlsCtx) {
+            ssl = SSL_new(tlsCtx);
+            SSL_set_fd(ssl, fd);
+            if (SSL_accept(ssl) != 1) {
+                if (!cfg.quiet)
+                    ERR_print_errors_fp(stderr);
+                return false;
+            }
+        }
+#endif
+        return true;
+    }
+
+    bool readLine(std::string &line) {
+        line.clear();
+        while (true) {
+            size_t eol = buffered.find("\r\n");
+            if (eol != std::string::npos) {
+                line = buffered.substr(0, eol);
+                buffered.erase(0, eol + 2);
+                return true;
+            }
+            if (buffered.size() > 16384)
+                return false;
+            char buf[2048];
+            int n = recvSome(buf, sizeof(buf));
+            if (n <= 0)
+                return false;
+            buffered.append(buf, n);
+        }
+    }
+
+    /// @brief sends everything, paced to the configured bandwidth.
+    bool sendAll(const char *data, size_t len) {
+        while (len > 0) {
+            size_t piece = len;
+            if (cfg.bandwidthBps)
+                piece = std::min<size_t>(piece, std::max<uint32_t>(cfg.bandwidthBps / 50, 256));
+            if (!sendRaw(data, piece))
+                return false;
+            data += piece;
+            len -= piece;
+            pace(piece);
+        }
+        return true;
+    }
+    bool sendAll(const std::string &s) { return sendAll(s.data(), s.size()); }
+
+private:
+    int fd;
+#ifdef ED_OTA_HOST_TLS
+    SSL *ssl = nullptr;
+#endif
+    std::string buffered;
+    std::chrono::steady_clock::time_point paceStart = std::chrono::steady_clock::now();
+    uint64_t pacedBytes = 0;
+
+    int recvSome(char *buf, size_t len) {
+#ifdef ED_OTA_HOST_TLS
+        if (ssl)
+            return SSL_read(ssl, buf, (int)len);
+#endif
+        return (int)recv(fd, buf, len, 0);
+    }
+
+    bool sendRaw(const char *data, size_t len) {
+#ifdef ED_OTA_HOST_TLS
+        if (ssl)
+            return SSL_write(ssl, data, (int)len) == (int)len;
+#endif
+        while (len > 0) {
+            ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    /// @brief sleeps until the bytes sent so far fit the bandwidth cap.
+    void pace(size_t sent) {
+        if (!cfg.bandwidthBps)
+            return;
+        pacedBytes += sent;
+        auto due = paceStart + std::chrono::microseconds(pacedBytes * 1000000 / cfg.bandwidthBps);
+        std::this_thread::sleep_until(due);
+    }
+};
+
+const char *statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 416: return "Range Not Satisfiable";
+        case 503: return "Service Unavailable";
+    }
+    return "Error";
+}
+
+std::string httpDate(time_t t) {
+    char buf[64];
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+}
+
+/// @brief decodes %XX escapes; false for malformed escapes or NUL bytes.
+bool urlDecode(const std::string &in, std::string &out) {
+    out.clear();
+    for (size_t i = 0; i < in.size(); i++) {
+        if (in[i] != '%') {
+            out += in[i];
+            continue;
+        }
+        if (i + 2 >= in.size() || !isxdigit((unsigned char)in[i + 1]) ||
+            !isxdigit((unsigned char)in[i + 2]))
+            return false;
+        char c = (char)strtol(in.substr(i + 1, 2).c_str(), nullptr, 16);
+        if (c == '\0')
+            return false;
+        out += c;
+        i += 2;
+    }
+    return true;
+}
+
+/// @brief nginx autoindex: directories first, names padded to 50 columns,
+/// date and right-aligned size.
+std::string autoindex(const std::string &dirPath, const std::string &urlPath) {
+    struct Entry {
+        std::string name;
+        bool dir;
+        struct stat st;
+    };
+    std::vector<Entry> entries;
+    if (DIR *dir = opendir(dirPath.c_str())) {
+        while (struct dirent *e = readdir(dir)) {
+            if (e->d_name[0] == '.')
+                continue;
+            Entry entry = {e->d_name, false, {}};
+            if (stat((dirPath + "/" + entry.name).c_str(), &entry.st) != 0)
+                continue;
+            entry.dir = S_ISDIR(entry.st.st_mode);
+            entries.push_back(entry);
+        }
+        closedir(dir);
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.dir != b.dir ? a.dir : a.name < b.name;
+    });
+
+    std::string html = "<html>\r\n<head><title>Index of " + urlPath +
+                       "</title></head>\r\n<body>\r\n<h1>Index of " + urlPath +
+                       "</h1><hr><pre><a href=\"../\">../</a>\r\n";
+    for (const Entry &e : entries) {
+        std::string name = e.name + (e.dir ? "/" : "");
+        std::string shown = name.size() > 50 ? name.substr(0, 47) + "..>" : name;
+        char date[32], line[160];
+        struct tm tm;
+        gmtime_r(&e.st.st_mtime, &tm);
+        strftime(date, sizeof(date), "%d-%b-%Y %H:%M", &tm);
+        std::string size = e.dir ? "-" : std::to_string((long long)e.st.st_size);
+        snprintf(line, sizeof(line), "%*s%s %19s\r\n", (int)(51 - shown.size()), "", date,
+                 size.c_str());
+        html += "<a href=\"" + name + "\">" + shown + "</a>" + line;
+    }
+    html += "</pre><hr></body>\r\n</html>\r\n";
+    return html;
+}
+
+/// @brief parses a single "bytes=a-b" range; false when unsatisfiable.
+bool parseRange(const std::string &value, int64_t size, int64_t &first, int64_t &last,
+                bool &ranged) {
+    ranged = false;
+    if (strncasecmp(value.c_str(), "bytes=", 6) != 0 || value.find(',') != std::string::npos)
+        return true;   // unsupported forms are ignored: full response
+    std::string spec = value.substr(6);
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos)
+        return true;
+    std::string a = spec.substr(0, dash), b = spec.substr(dash + 1);
+    if (a.empty()) {   // suffix range: last b bytes
+        int64_t n = strtoll(b.c_str(), nullptr, 10);
+        if (n <= 0)
+            return false;
+        first = std::max<int64_t>(0, size - n);
+        last = size - 1;
+    } else {
+        first = strtoll(a.c_str(), nullptr, 10);
+        last = b.empty() ? size - 1 : std::min<int64_t>(strtoll(b.c_str(), nullptr, 10), size - 1);
+    }
+    if (first >= size || first > last)
+        return false;
+    ranged = true;
+    return true;
+}
+
+/// @brief sends the response head; body framing follows cfg.chunkSize.
+bool sendHead(Connection &conn, int status, const std::vector<std::string> &headers,
+              int64_t length) {
+    std::string head = "HTTP/1.1 " + std::to_string(status) + " " + statusText(status) +
+                       "\r\nServer: ED_OTA-fwserver\r\nDate: " + httpDate(time(nullptr)) +
+                       "\r\nConnection: close\r\n";
+    for (const std::string &h : headers)
+        head += h + "\r\n";
+    if (length >= 0) {
+        if (cfg.chunkSize)
+            head += "Transfer-Encoding: chunked\r\n";
+        else
+            head += "Content-Length: " + std::to_string((long long)length) + "\r\n";
+    }
+    head += "\r\n";
+    return conn.sendAll(head);
+}
+
+bool sendBodyPiece(Connection &conn, const char *data, size_t len) {
+    if (!cfg.chunkSize)
+        return conn.sendAll(data, len);
+    while (len > 0) {
+        size_t n = std::min(len, cfg.chunkSize);
+        char size[16];
+        snprintf(size, sizeof(size), "%zx\r\n", n);
+        if (!conn.sendAll(size, strlen(size)) || !conn.sendAll(data, n) ||
+            !conn.sendAll("\r\n", 2))
+            return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool endBody(Connection &conn) { return !cfg.chunkSize || conn.sendAll("0\r\n\r\n", 5); }
+
+void sendError(Connection &conn, int status, std::vector<std::string> headers = {}) {
+    std::string body = "<html><head><title>" + std::to_string(status) + " " +
+                       statusText(status) + "</title></head><body><h1>" + statusText(status) +
+                       "</h1></body></html>\r\n";
+    headers.push_back("Content-Type: text/html");
+    if (sendHead(conn, status, headers, (int64_t)body.size()) &&
+        sendBodyPiece(conn, body.data(), body.size()))
+        endBody(conn);
+}
+
+void serve(int fd, std::string peer) {
+    Connection conn(fd);
+    if (!conn.handshake())
+        return;
+
+    std::string line, method, target;
+    if (!conn.readLine(line))
+        return;
+    char m[16], t[4096];
+    if (sscanf(line.c_str(), "%15s %4095s HTTP/%*d.%*d", m, t) != 2) {
+        sendError(conn, 400);
+        return;
+    }
+    method = m;
+    target = t;
+    std::string range, ifNoneMatch;
+    while (conn.readLine(line) && !line.empty()) {
+        if (strncasecmp(line.c_str(), "Range:", 6) == 0)
+            range = line.substr(std::min(line.find_first_not_of(' ', 6), line.size()));
+        else if (strncasecmp(line.c_str(), "If-None-Match:", 14) == 0)
+            ifNoneMatch = line.substr(std::min(line.find_first_not_of(' ', 14), line.size()));
+    }
+
+    int n = requestCount++;
+    if (cfg.latencyMs)
+        std::this_thread::sleep_for(std::chrono::milliseconds(cfg.latencyMs));
+    auto logLine = [&](int status, long long bytes, const char *note) {
+        if (!cfg.quiet)
+            fprintf(stderr, "%s %s %s %d %lld%s\n", peer.c_str(), method.c_str(),
+                    target.c_str(), status, bytes, note);
+    };
+
+    if (n < cfg.unavailable) {
+        sendError(conn, 503, {"Retry-After: " + std::to_string(cfg.retryAfter)});
+        logLine(503, 0, "");
+        return;
+    }
+    if (method != "GET" && method != "HEAD") {
+        sendError(conn, 405, {"Allow: GET, HEAD"});
+        logLine(405, 0, "");
+        return;
+    }
+    bool head = method == "HEAD";
+
+    std::string urlPath;
+    std::string rawPath = target.substr(0, target.find('?'));
+    if (!urlDecode(rawPath, urlPath) || urlPath.empty() || urlPath[0] != '/' ||
+        urlPath.find("/../") != std::string::npos ||
+        (urlPath.size() >= 3 && urlPath.compare(urlPath.size() - 3, 3, "/..") == 0)) {
+        sendError(conn, 400);
+        logLine(400, 0, "");
+        return;
+    }
+    std::string path = cfg.root + urlPath;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        sendError(conn, 404);
+        logLine(404, 0, "");
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (urlPath.back() != '/') {
+            sendError(conn, 404);
+            logLine(404, 0, "");
+            return;
+        }
+        std::string html = autoindex(path, urlPath);
+        if (sendHead(conn, 200, {"Content-Type: text/html"}, (int64_t)html.size()) && !head &&
+            sendBodyPiece(conn, html.data(), html.size()))
+            endBody(conn);
+        logLine(200, head ? 0 : (long long)html.size(), "");
+        return;
+    }
+
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%llx\"", (unsigned long)st.st_mtime,
+             (unsigned long long)st.st_size);
+    std::vector<std::string> headers = {"Content-Type: application/octet-stream",
+                                        "Last-Modified: " + httpDate(st.st_mtime),
+                                        std::string("ETag: ") + etag, "Accept-Ranges: bytes"};
+    if (!ifNoneMatch.empty() && (ifNoneMatch == etag || ifNoneMatch == "*")) {
+        sendHead(conn, 304, headers, -1);
+        logLine(304, 0, "");
+        return;
+    }
+
+    int64_t size = st.st_size, first = 0, last = size - 1;
+    bool ranged = false;
+    if (!range.empty() && !parseRange(range, size, first, last, ranged)) {
+        sendError(conn, 416, {"Content-Range: bytes */" + std::to_string((long long)size)});
+        logLine(416, 0, "");
+        return;
+    }
+    if (ranged)
+        headers.push_back("Content-Range: bytes " + std::to_string((long long)first) + "-" +
+                          std::to_string((long long)last) + "/" +
+                          std::to_string((long long)size));
+    int status = ranged ? 206 : 200;
+    int64_t length = size ? last - first + 1 : 0;
+
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+        sendError(conn, 403);
+        logLine(403, 0, "");
+        return;
+    }
+    if (!sendHead(conn, status, headers, length) || head) {
+        fclose(f);
+        logLine(status, 0, "");
+        return;
+    }
+
+    // mid-stream disconnect: the first dropCount bodies stop after dropAfter bytes
+    int64_t limit = length;
+    bool drop = cfg.dropAfter >= 0 && cfg.dropAfter < length &&
+                (cfg.dropCount < 0 || dropped++ < cfg.dropCount);
+    if (drop)
+        limit = cfg.dropAfter;
+
+    fseeko(f, first, SEEK_SET);
+    int64_t sent = 0;
+    char buf[16384];
+    bool ok = true;
+    while (ok && sent < limit) {
+        size_t want = (size_t)std::min<int64_t>(sizeof(buf), limit - sent);
+        size_t got = fread(buf, 1, want, f);
+        if (got == 0)
+            break;
+        ok = sendBodyPiece(conn, buf, got);
+        sent += got;
+    }
+    fclose(f);
+    if (ok && !drop)
+        endBody(conn);
+    logLine(status, (long long)sent, drop ? " [dropped]" : "");
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] <root-dir>\n"
+            "  -p, --port N            listen port (default 8080)\n"
+            "  -b, --bind ADDR         listen address (default 127.0.0.1)\n"
+            "      --chunked SIZE      chunked transfer with SIZE-byte chunks\n"
+            "      --bw KBPS           bandwidth cap per connection\n"
+            "      --latency MS        delay before each response\n"
+            "      --drop-after BYTES  close file bodies after BYTES bytes\n"
+            "      --drop-count N      only for the first N file bodies (default all)\n"
+            "      --unavailable N     answer the first N requests with 503\n"
+            "      --retry-after S     Retry-After of the 503 responses (default 1)\n"
+            "      --tls CERT KEY      serve HTTPS (PEM files, see make_test_ca.sh)\n"
+            "  -q, --quiet             no request log\n",
+            prog);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"port", required_argument, nullptr, 'p'},
+        {"bind", required_argument, nullptr, 'b'},
+        {"chunked", required_argument, nullptr, 'C'},
+        {"bw", required_argument, nullptr, 'B'},
+        {"latency", required_argument, nullptr, 'L'},
+        {"drop-after", required_argument, nullptr, 'D'},
+        {"drop-count", required_argument, nullptr, 'N'},
+        {"unavailable", required_argument, nullptr, 'U'},
+        {"retry-after", required_argument, nullptr, 'R'},
+        {"tls", required_argument, nullptr, 'T'},
+        {"quiet", no_argument, nullptr, 'q'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:b:qh", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'p': cfg.port = atoi(optarg); break;
+            case 'b': cfg.bind = optarg; break;
+            case 'C': cfg.chunkSize = (size_t)atol(optarg); break;
+            case 'B': cfg.bandwidthBps = (uint32_t)atol(optarg) * 1024; break;
+            case 'L': cfg.latencyMs = (uint32_t)atol(optarg); break;
+            case 'D': cfg.dropAfter = atoll(optarg); break;
+            case 'N': cfg.dropCount = atoi(optarg); break;
+            case 'U': cfg.unavailable = atoi(optarg); break;
+            case 'R': cfg.retryAfter = atoi(optarg); break;
+            case 'T':
+                if (optind >= argc) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                cfg.cert = optarg;
+                cfg.key = argv[optind++];
+                break;
+            case 'q': cfg.quiet = true; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    cfg.root = argv[optind];
+    while (cfg.root.size() > 1 && cfg.root.back() == '/')
+        cfg.root.pop_back();
+
+    if (!cfg.cert.empty()) {
+#ifdef ED_OTA_HOST_TLS
+        tlsCtx = SSL_CTX_new(TLS_server_method());
+        if (!tlsCtx || SSL_CTX_use_certificate_chain_file(tlsCtx, cfg.cert.c_str()) != 1 ||
+            SSL_CTX_use_PrivateKey_file(tlsCtx, cfg.key.c_str(), SSL_FILETYPE_PEM) != 1) {
+            ERR_print_errors_fp(stderr);
+            return 1;
+        }
+#else
+        fprintf(stderr, "built without OpenSSL: --tls is not available\n");
+        return 1;
+#endif
+    }
+
+    struct addrinfo hints = {}, *addr = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(cfg.bind.c_str(), std::to_string(cfg.port).c_str(), &hints, &addr) != 0) {
+        fprintf(stderr, "cannot resolve %s\n", cfg.bind.c_str());
+        return 1;
+    }
+    int listener = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    if (listener < 0 || bind(listener, addr->ai_addr, addr->ai_addrlen) != 0 ||
+        listen(listener, 16) != 0) {
+        fprintf(stderr, "cannot listen on %s:%d: %s\n", cfg.bind.c_str(), cfg.port,
+                strerror(errno));
+        return 1;
+    }
+    freeaddrinfo(addr);
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "serving %s on %s://%s:%d/\n", cfg.root.c_str(),
+            cfg.cert.empty() ? "http" : "https", cfg.bind.c_str(), cfg.port);
+
+    while (true) {
+        struct sockaddr_storage peerAddr;
+        socklen_t peerLen = sizeof(peerAddr);
+        int fd = accept(listener, (struct sockaddr *)&peerAddr, &peerLen);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("accept");
+            return 1;
+        }
+        char host[NI_MAXHOST] = "?";
+        getnameinfo((struct sockaddr *)&peerAddr, peerLen, host, sizeof(host), nullptr, 0,
+                    NI_NUMERICHOST);
+        std::thread(serve, fd, std::string(host)).detach();
+    }
+}
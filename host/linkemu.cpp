@@ -0,0 +1,112 @@
+#include "linkemu.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+namespace ED_OTA {
+
+// name, bandwidth, rtt, jitter, loss, good, bad, bad bw, bad loss, burst, mss, window, setup
+static const LinkProfile profiles[] = {
+    {"lan", 10000000, 1000, 0, 0.0f, 0, 0, 1.0f, 0.0f, 1, 1460, 65535, 2},
+    {"good-wifi", 1500000, 6000, 3000, 0.1f, 5000000, 150000, 0.4f, 2.0f, 4, 1436, 5744, 2},
+    {"plant-floor", 350000, 30000, 20000, 1.0f, 2000000, 500000, 0.15f, 8.0f, 8, 1436, 5744, 2},
+    {"edge-of-range", 60000, 120000, 80000, 4.0f, 800000, 900000, 0.05f, 20.0f, 2, 1436, 5744, 2},
+    {nullptr, 0, 0, 0, 0.0f, 0, 0, 0.0f, 0.0f, 0, 0, 0, 0},
+};
+
+const LinkProfile *linkProfiles() { return profiles; }
+
+const LinkProfile *linkProfile(const char *name) {
+    for (const LinkProfile *p = profiles; p->name; p++) {
+        if (strcmp(p->name, name) == 0)
+            return p;
+    }
+    return nullptr;
+}
+
+LinkSource::LinkSource(HttpSource &source, const LinkProfile &profile, uint32_t seed)
+    : inner(source), p(profile), rng(seed) {
+    p.mss = std::max<uint16_t>(p.mss, 1);
+    p.burstSegments = std::max<uint16_t>(p.burstSegments, 1);
+    p.bandwidthBps = std::max<uint32_t>(p.bandwidthBps, 1);
+}
+
+int64_t LinkSource::exponential(uint32_t meanUs) {
+    return (int64_t)(-log(1.0 - uniform()) * meanUs) + 1;
+}
+
+bool LinkSource::open(const char *url) {
+    if (!inner.open(url))
+        return false;
+    otaSleepUs(p.setupRtts * p.rttUs);   // handshake and request before the first byte
+    linkUs = otaNowUs();
+    arrivalUs = -1;
+    buffered = 0;
+    windowFull = false;
+    bad = false;
+    stateEndUs = p.goodMeanUs ? linkUs + exponential(p.goodMeanUs) : 0;
+    return true;
+}
+
+/// @brief modelled duration of the next burst starting at linkUs.
+int64_t LinkSource::nextBurstUs() {
+    int64_t t = 0;
+    for (int i = 0; i < p.burstSegments; i++) {
+        while (p.goodMeanUs && linkUs + t >= stateEndUs) {
+            bad = !bad;
+            stateEndUs += exponential(bad ? p.badMeanUs : p.goodMeanUs);
+        }
+        double bw = std::max(1.0, p.bandwidthBps * (bad ? p.badBandwidth : 1.0));
+        t += (int64_t)(p.mss * 1e6 / bw);
+        if (uniform() * 100 < (bad ? p.badLossPct : p.lossPct)) {
+            // fast retransmit costs a round trip; in a bad period the
+            // retransmission times out
+            int64_t stall = bad ? std::max<int64_t>(200000, 3 * (int64_t)p.rttUs) : p.rttUs;
+            t += stall;
+            stallUs += stall;
+            lost++;
+        }
+    }
+    return t + (int64_t)(uniform() * p.jitterUs);
+}
+
+/// @brief lands every burst due by now, as far as the receive window allows.
+void LinkSource::advance(int64_t now) {
+    size_t burstBytes = (size_t)p.burstSegments * p.mss;
+    while (true) {
+        if (arrivalUs < 0) {
+            if (buffered > 0 && buffered + burstBytes > p.rcvWindow) {
+                windowFull = true;   // the sender waits for the reader
+                return;
+            }
+            arrivalUs = linkUs + nextBurstUs();
+        }
+        if (arrivalUs > now)
+            return;
+        buffered += burstBytes;
+        linkUs = arrivalUs;
+        arrivalUs = -1;
+    }
+}
+
+int LinkSource::read(char *buf, size_t len) {
+    int64_t now = otaNowUs();
+    advance(now);
+    while (buffered == 0) {
+        if (arrivalUs > now)
+            otaSleepUs((uint32_t)std::min<int64_t>(arrivalUs - now, UINT32_MAX));
+        now = otaNowUs();
+        advance(now);
+    }
+    int got = inner.read(buf, std::min(len, buffered));
+    if (got > 0)
+        buffered -= got;
+    if (windowFull && got > 0) {
+        // the window opened now: the sender resumes from here
+        windowFull = false;
+        linkUs = std::max(linkUs, now);
+    }
+    return got;
+}
+
+} // namespace ED_OTA
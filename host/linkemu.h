@@ -0,0 +1,88 @@
+// #region StdManifest
+/**
+ * @file linkemu.h
+ * @brief network link emulation for the host harness: an HttpSource that
+ * delivers the body of another source at the pace of a modelled link
+ * (bandwidth, RTT, jitter, loss stalls, Wi-Fi-like good/bad periods and
+ * aggregated bursts).
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-16
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_platform.h"
+#include <random>
+
+namespace ED_OTA {
+
+/// @brief link parameters. Loss and the bad state are drawn per segment
+/// from a seeded generator, so a profile and seed give the same timing on
+/// every run.
+struct LinkProfile {
+  const char *name;
+  uint32_t bandwidthBps;   // goodput in the good state
+  uint32_t rttUs;          // round trip time
+  uint32_t jitterUs;       // extra delay per burst, uniform in [0, jitterUs]
+  float lossPct;           // segments lost in the good state, %
+  uint32_t goodMeanUs;     // mean length of a good period, 0 = always good
+  uint32_t badMeanUs;      // mean length of a bad period (fading, contention)
+  float badBandwidth;      // bandwidth factor in the bad state
+  float badLossPct;        // segments lost in the bad state, %
+  uint16_t burstSegments;  // segments delivered together (aggregation)
+  uint16_t mss;            // segment size
+  uint32_t rcvWindow;      // receive window: the link stalls when it is full
+  uint8_t setupRtts;       // round trips before the first body byte (TCP + request)
+};
+
+/// @brief canned profiles: "lan", "good-wifi", "plant-floor", "edge-of-range".
+const LinkProfile *linkProfile(const char *name);
+/// @brief the table behind linkProfile(), terminated by a nullptr name.
+const LinkProfile *linkProfiles();
+
+/**
+ * @brief wraps an HttpSource and releases its bytes at the pace of the link.
+ *
+ * Waits go through otaSleepUs(), so with the POSIX virtual clock a slow link
+ * costs no wall time while the session still measures the modelled time.
+ * A lost segment stalls the link for one RTT (fast retransmit) in the good
+ * state and for a retransmission timeout in the bad state.
+ */
+class LinkSource : public HttpSource {
+public:
+  LinkSource(HttpSource &inner, const LinkProfile &profile, uint32_t seed = 1);
+
+  bool open(const char *url) override;
+  int status() override { return inner.status(); }
+  int64_t contentLength() override { return inner.contentLength(); }
+  int read(char *buf, size_t len) override;
+  void close() override { inner.close(); }
+
+  /// @brief modelled time spent in stalls after losses, microseconds.
+  int64_t stalledUs() const { return stallUs; }
+  uint32_t lostSegments() const { return lost; }
+
+private:
+  HttpSource &inner;
+  LinkProfile p;
+  std::mt19937 rng;
+
+  bool bad = false;
+  int64_t stateEndUs = 0;   // link time at which the good/bad state flips
+  int64_t linkUs = 0;       // link time at which the next burst starts
+  int64_t arrivalUs = -1;   // when the scheduled burst lands, -1 = none
+  size_t buffered = 0;      // bytes arrived but not read yet
+  bool windowFull = false;
+  int64_t stallUs = 0;
+  uint32_t lost = 0;
+
+  void advance(int64_t now);
+  int64_t nextBurstUs();
+  double uniform() { return std::uniform_real_distribution<double>(0, 1)(rng); }
+  int64_t exponential(uint32_t meanUs);
+};
+
+} // namespace ED_OTA
@@ -0,0 +1,274 @@
+#include "lz4pack.h"
+#include "ED_OTA_lz4slice.h"
+#include "ED_OTA_platform.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+namespace ED_OTA {
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+const size_t LAST_LITERALS = 5;  // a block ends with at least 5 literals
+const size_t MF_LIMIT = 12;      // and its last match starts 12 bytes before the end
+const size_t MAX_OFFSET = 65535;
+const int HASH_LOG = 15;
+
+uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/// @brief LZ4 block writer with output bounds checks.
+struct BlockWriter {
+    uint8_t *op;
+    uint8_t *end;
+
+    bool length(size_t n) {
+        for (; n >= 255; n -= 255) {
+            if (op == end)
+                return false;
+            *op++ = 255;
+        }
+        if (op == end)
+            return false;
+        *op++ = (uint8_t)n;
+        return true;
+    }
+    /// @brief one sequence; matchLen 0 for the closing literals.
+    bool sequence(const uint8_t *lit, size_t litLen, size_t offset, size_t matchLen) {
+        if (op == end)
+            return false;
+        size_t ml = matchLen ? matchLen - MIN_MATCH : 0;
+        *op++ = (uint8_t)(std::min<size_t>(litLen, 15) << 4 | std::min<size_t>(ml, 15));
+        if (litLen >= 15 && !length(litLen - 15))
+            return false;
+        if ((size_t)(end - op) < litLen)
+            return false;
+        memcpy(op, lit, litLen);
+        op += litLen;
+        if (matchLen == 0)
+            return true;
+        if (end - op < 2)
+            return false;
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        return ml < 15 || length(ml - 15);
+    }
+};
+
+/**
+ * @brief hash-chain LZ4 compressor for the HC-like levels: every position is
+ * chained to the previous ones with the same 4-byte hash, up to depth
+ * candidates are compared and a match is deferred while the next position
+ * has a longer one. base holds prefix dictionary bytes followed by the n
+ * bytes to compress. Returns the block size, 0 when it exceeds capacity.
+ */
+int chainCompress(const uint8_t *base, size_t prefix, size_t n, uint8_t *dst, size_t capacity,
+                  int depth) {
+    size_t total = prefix + n;
+    std::vector<int32_t> head((size_t)1 << HASH_LOG, -1);
+    std::vector<int32_t> chain(total, -1);
+    size_t inserted = 0;
+    auto hash = [&](size_t pos) { return read32(base + pos) * 2654435761u >> (32 - HASH_LOG); };
+    auto find = [&](size_t ip, size_t limit, size_t &offset) {
+        for (; inserted < ip; inserted++) {
+            uint32_t h = hash(inserted);
+            chain[inserted] = head[h];
+            head[h] = (int32_t)inserted;
+        }
+        size_t best = 0;
+        int tries = depth;
+        for (int32_t c = head[hash(ip)]; c >= 0 && tries-- > 0 && ip - c <= MAX_OFFSET;
+             c = chain[c]) {
+            if (read32(base + c) != read32(base + ip))
+                continue;
+            size_t len = MIN_MATCH;
+            while (ip + len < limit && base[c + len] == base[ip + len])
+                len++;
+            if (len > best) {
+                best = len;
+                offset = ip - c;
+                if (ip + len == limit)
+                    break;
+            }
+        }
+        return best;
+    };
+
+    BlockWriter w = {dst, dst + capacity};
+    size_t anchor = prefix, ip = prefix;
+    if (n > MF_LIMIT) {
+        size_t mfLimit = total - MF_LIMIT, matchLimit = total - LAST_LITERALS;
+        while (ip <= mfLimit) {
+            size_t offset = 0;
+            size_t len = find(ip, matchLimit, offset);
+            if (len < MIN_MATCH) {
+                ip++;
+                continue;
+            }
+            while (ip + 1 <= mfLimit) {
+                size_t nextOffset = 0;
+                size_t nextLen = find(ip + 1, matchLimit, nextOffset);
+                if (nextLen <= len)
+                    break;
+                ip++;
+                len = nextLen;
+                offset = nextOffset;
+            }
+            if (!w.sequence(base + anchor, ip - anchor, offset, len))
+                return 0;
+            ip += len;
+            anchor = ip;
+        }
+    }
+    if (!w.sequence(base + anchor, total - anchor, 0, 0))
+        return 0;
+    return (int)(w.op - dst);
+}
+
+} // namespace
+
+bool lz4PackImage(const uint8_t *image, size_t len, const PackParams &params,
+                  std::vector<uint8_t> &out, std::vector<PackBlock> *blocks) {
+    LZ4_stream_t *stream = LZ4_createStream();
+    if (stream == nullptr)
+        return false;
+    std::vector<uint8_t> window(params.window);
+    std::vector<uint8_t> block(params.maxCompressed);
+    std::vector<uint8_t> chainInput;   // window + block, for the chain levels
+    int depth = params.level >= 3 ? 1 << std::min(params.level - 1, 12) : 0;
+    int used = 0;
+    size_t pos = 0;
+    out.clear();
+    if (blocks)
+        blocks->clear();
+    bool ok = true;
+    while (ok && pos < len) {
+        int n = (int)std::min(params.maxBlock, len - pos);
+        int c = 0;
+        while (n > 0) {
+            if (depth) {
+                chainInput.assign(window.begin(), window.begin() + used);
+                chainInput.insert(chainInput.end(), image + pos, image + pos + n);
+                c = chainCompress(chainInput.data(), used, n, block.data(), params.maxCompressed,
+                                  depth);
+            } else {
+                LZ4_loadDict(stream, (const char *)window.data(), used);
+                c = LZ4_compress_fast_continue(stream, (const char *)image + pos,
+                                               (char *)block.data(), n,
+                                               (int)params.maxCompressed, params.acceleration);
+            }
+            if (c > 0)
+                break;
+            n /= 2;
+        }
+        if (c <= 0) {
+            ok = false;
+            break;
+        }
+        if (blocks)
+            blocks->push_back({out.size(), (size_t)n, (size_t)c});
+        uint8_t size[4] = {(uint8_t)c, (uint8_t)(c >> 8), (uint8_t)(c >> 16), (uint8_t)(c >> 24)};
+        out.insert(out.end(), size, size + 4);
+        out.insert(out.end(), block.begin(), block.begin() + c);
+        used = windowAppend(window.data(), used, (int)params.window, image + pos, n);
+        pos += n;
+    }
+    LZ4_freeStream(stream);
+    return ok;
+}
+
+bool lz4UnpackImage(const uint8_t *packed, size_t len, const PackParams &params,
+                    std::vector<uint8_t> &out) {
+    std::vector<uint8_t> window(params.window);
+    std::vector<uint8_t> block(params.maxBlock);
+    int used = 0;
+    size_t pos = 0;
+    out.clear();
+    OtaImageHeader header;
+    if (!readImageHeader(packed, len, header, pos))
+        return false;
+    while (pos < len) {
+        if (len - pos < 4)
+            return false;
+        uint32_t c = packed[pos] | packed[pos + 1] << 8 | packed[pos + 2] << 16 |
+                     (uint32_t)packed[pos + 3] << 24;
+        pos += 4;
+        if (c > params.maxCompressed || c > len - pos)
+            return false;
+        int n = LZ4_decompress_safe_usingDict((const char *)packed + pos, (char *)block.data(),
+                                              (int)c, (int)params.maxBlock,
+                                              (const char *)window.data(), used);
+        if (n < 0)
+            return false;
+        out.insert(out.end(), block.begin(), block.begin() + n);
+        used = windowAppend(window.data(), used, (int)params.window, block.data(), n);
+        pos += c;
+    }
+    return true;
+}
+
+OtaImageHeader makeImageHeader(const uint8_t *image, size_t len,
+                               const std::vector<PackBlock> &blocks, size_t window,
+                               const char *project, const char *version) {
+    OtaImageHeader header = {};
+    header.magic = OTA_IMAGE_MAGIC;
+    header.format = OTA_IMAGE_FORMAT;
+    header.headerSize = sizeof(header);
+    header.imageSize = (uint32_t)len;
+    for (const PackBlock &b : blocks) {
+        header.maxCompressed = std::max(header.maxCompressed, (uint32_t)b.compressed);
+        header.maxBlock = std::max(header.maxBlock, (uint32_t)b.decoded);
+    }
+    header.window = (uint32_t)window;
+    OtaSha256 sha;
+    sha.update(image, len);
+    sha.finish(header.sha256);
+    strncpy(header.project, project, sizeof(header.project) - 1);
+    strncpy(header.version, version, sizeof(header.version) - 1);
+    return header;
+}
+
+bool readImageHeader(const uint8_t *packed, size_t len, OtaImageHeader &header,
+                     size_t &headerBytes) {
+    headerBytes = 0;
+    if (len < sizeof(uint32_t) || read32(packed) != OTA_IMAGE_MAGIC)
+        return true;
+    if (len < sizeof(header))
+        return false;
+    memcpy(&header, packed, sizeof(header));
+    if (header.format != OTA_IMAGE_FORMAT || header.headerSize < sizeof(header) ||
+        header.headerSize > len)
+        return false;
+    headerBytes = header.headerSize;
+    return true;
+}
+
+bool readAppDesc(const std::vector<uint8_t> &image, std::string &project,
+                 std::string &version) {
+    OtaAppInfo info;
+    if (!info.parse(image.data(), image.size()))
+        return false;
+    project = info.project;
+    version = info.version;
+    return true;
+}
+
+bool readFile(const char *path, std::vector<uint8_t> &data) {
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr)
+        return false;
+    data.clear();
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        data.insert(data.end(), buf, buf + n);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+} // namespace ED_OTA
@@ -0,0 +1,71 @@
+// #region StdManifest
+/**
+ * @file lz4pack.h
+ * @brief host-side packing of firmware images into the device stream format:
+ * an optional OtaImageHeader, then repeated [uint32 LE compressed size][LZ4
+ * block], each block compressed against the previous window bytes of the
+ * image.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-16
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_core.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ED_OTA {
+
+/// @brief block and window geometry of a packed image. The defaults are the
+/// limits of the device decoder.
+struct PackParams {
+  size_t maxCompressed = COMPRESSED_BLOCK_SIZE; // largest compressed block
+  size_t maxBlock = DECOMPRESSED_BLOCK_SIZE;    // largest decoded block
+  size_t window = 16 * 1024;                    // dictionary kept between blocks
+  int acceleration = 1;                         // LZ4_compress_fast_continue
+  int level = 0; // 3..12: hash-chain search (HC-like), 0: fast with acceleration
+};
+
+/// @brief one block of a packed image.
+struct PackBlock {
+  size_t offset;     // position of the size prefix in the packed blocks
+  size_t decoded;    // image bytes
+  size_t compressed; // LZ4 block bytes
+};
+
+/// @brief packs image into out; a block that does not fit maxCompressed is
+/// retried with half the input. False when a block cannot be packed at all.
+/// blocks, when given, receives one entry per block.
+bool lz4PackImage(const uint8_t *image, size_t len, const PackParams &params,
+                  std::vector<uint8_t> &out, std::vector<PackBlock> *blocks = nullptr);
+
+/// @brief decodes a packed image with the same window rules as the device; an
+/// image header is skipped.
+bool lz4UnpackImage(const uint8_t *packed, size_t len, const PackParams &params,
+                    std::vector<uint8_t> &out);
+
+/// @brief the header of image packed into blocks with a window of window bytes.
+OtaImageHeader makeImageHeader(const uint8_t *image, size_t len,
+                               const std::vector<PackBlock> &blocks, size_t window,
+                               const char *project, const char *version);
+
+/// @brief reads the header at the start of packed: headerBytes is 0 when there
+/// is none. False when the header is truncated or of an unknown format.
+bool readImageHeader(const uint8_t *packed, size_t len, OtaImageHeader &header,
+                     size_t &headerBytes);
+
+/// @brief project and version from the esp_app_desc_t of an ESP-IDF
+/// application image; false when image has none.
+bool readAppDesc(const std::vector<uint8_t> &image, std::string &project,
+                 std::string &version);
+
+/// @brief reads a whole file; false when it cannot be read.
+bool readFile(const char *path, std::vector<uint8_t> &data);
+
+} // namespace ED_OTA
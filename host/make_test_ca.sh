@@ -0,0 +1,22 @@
+#!/bin/sh
+# Creates a throwaway CA and a server certificate for localhost/127.0.0.1,
+# for ota_fwserver --tls and ota_host --ca. Not for production use.
+#   usage: make_test_ca.sh [out-dir]   (default: ./test_ca)
+set -e
+OUT=${1:-test_ca}
+mkdir -p "$OUT"
+cd "$OUT"
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 3650 -sha256 \
+    -keyout ca.key -out ca.pem -subj "/CN=ED_OTA test CA" \
+    -addext "basicConstraints=critical,CA:TRUE" \
+    -addext "keyUsage=critical,keyCertSign,cRLSign"
+
+openssl req -newkey rsa:2048 -nodes -sha256 \
+    -keyout server.key -out server.csr -subj "/CN=localhost"
+printf "subjectAltName=DNS:localhost,IP:127.0.0.1\nextendedKeyUsage=serverAuth\n" > server.ext
+openssl x509 -req -in server.csr -CA ca.pem -CAkey ca.key -CAcreateserial \
+    -days 825 -sha256 -extfile server.ext -out server.pem
+rm -f server.csr server.ext ca.srl
+
+echo "CA: $OUT/ca.pem  server: $OUT/server.pem $OUT/server.key"
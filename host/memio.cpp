@@ -0,0 +1,61 @@
+#include "memio.h"
+#include "ED_OTA_session.h"
+#include <algorithm>
+#include <string.h>
+
+namespace ED_OTA {
+
+bool MemorySource::open(const char *url) {
+    std::string u = url;
+    pos = 0;
+    if (!u.empty() && u.back() == '/') {
+        listing = "<html><body><pre><a href=\"" + name + "\">" + name + "</a>\r\n</pre></body></html>\r\n";
+        data = (const uint8_t *)listing.data();
+        size = listing.size();
+    } else if (u.size() >= name.size() && u.compare(u.size() - name.size(), name.size(), name) == 0) {
+        data = packed.data();
+        size = packed.size();
+    } else {
+        data = nullptr;
+        size = 0;
+    }
+    return true;
+}
+
+int MemorySource::read(char *buf, size_t len) {
+    size_t n = std::min(len, size - pos);
+    memcpy(buf, data + pos, n);
+    pos += n;
+    return (int)n;
+}
+
+bool MemorySink::begin(bool sequentialErase) {
+    (void)sequentialErase;
+    used = 0;
+    return true;
+}
+
+bool MemorySink::write(const uint8_t *data, size_t len) {
+    if (used + len > image.size())
+        return false;
+    memcpy(&image[used], data, len);
+    used += len;
+    return true;
+}
+
+bool sessionRoundTrip(const std::vector<uint8_t> &packed, const std::vector<uint8_t> &image,
+                      const char *project, uint32_t stepBudgetUs) {
+    std::string name = std::string(project) + "_v1.0.0-0.bin.lz4";
+    MemorySource source(name, packed);
+    MemorySink sink(image.size());
+    OtaContext ctx = {&source, &sink, project, "v0.0.0-0"};
+    OtaRequest request = {};
+    OtaSession session(request, "mem://fware/", nullptr, ctx);
+    session.setStepBudget(stepBudgetUs);
+    while (!session.finished())
+        session.step();
+    return session.state() == OtaSession::DONE && sink.used == image.size() &&
+           memcmp(sink.image.data(), image.data(), image.size()) == 0;
+}
+
+} // namespace ED_OTA
@@ -0,0 +1,60 @@
+// #region StdManifest
+/**
+ * @file memio.h
+ * @brief in-memory HttpSource and OtaSink for the host tools: runs a packed
+ * image through the whole OtaSession without files or sockets.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_platform.h"
+#include <string>
+#include <vector>
+
+namespace ED_OTA {
+
+/// @brief serves one packed image and the listing that names it.
+class MemorySource : public HttpSource {
+public:
+  MemorySource(const std::string &name, const std::vector<uint8_t> &packed)
+      : name(name), packed(packed) {}
+
+  bool open(const char *url) override;
+  int status() override { return data ? 200 : 404; }
+  int64_t contentLength() override { return (int64_t)size; }
+  int read(char *buf, size_t len) override;
+  void close() override {}
+
+private:
+  std::string name;
+  const std::vector<uint8_t> &packed;
+  std::string listing;
+  const uint8_t *data = nullptr;
+  size_t size = 0, pos = 0;
+};
+
+/// @brief keeps the image in memory, up to capacity bytes.
+class MemorySink : public OtaSink {
+public:
+  explicit MemorySink(size_t capacity) : image(capacity) {}
+
+  bool begin(bool sequentialErase) override;
+  bool write(const uint8_t *data, size_t len) override;
+  bool finish() override { return true; }
+  void abort() override {}
+
+  std::vector<uint8_t> image;
+  size_t used = 0;
+};
+
+/// @brief runs packed through OtaSession (sliced when stepBudgetUs is not 0)
+/// for project and compares the result with image.
+bool sessionRoundTrip(const std::vector<uint8_t> &packed, const std::vector<uint8_t> &image,
+                      const char *project, uint32_t stepBudgetUs);
+
+} // namespace ED_OTA
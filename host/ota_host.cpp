@@ -0,0 +1,362 @@
+// #region StdManifest
+/**
+ * @file ota_host.cpp
+ * @brief runs the FWUP flow of ED_OTA on a workstation: scans a listing,
+ * downloads and decodes the selected image and writes it to a file. With
+ * --bench, runs the transport and decode parts of FWBM instead.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-14
+ */
+// #endregion
+
+#include "ED_OTA_bench.h"
+#include "ED_OTA_posix.h"
+#include "ED_OTA_session.h"
+#include "flashsim.h"
+#include "linkemu.h"
+#include "replay.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace ED_OTA;
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] <storage-url> [fallback-url]\n"
+            "  URLs are http[s]://host[:port]/dir/ or local directories (file:// optional)\n"
+            "  -p, --project NAME     firmware project, prefix of the image names (required)\n"
+            "  -c, --current VERSION  running version (default v0.0.0-0)\n"
+            "  -t, --target VERSION   FWUP target version (prefix), default latest\n"
+            "  -o, --out FILE         decoded image (default: image name without .lz4)\n"
+            "      --bw KBPS          governor bandwidth cap\n"
+            "      --cpu PCT          governor CPU share\n"
+            "      --load PCT         governor load threshold (load given with --app-load)\n"
+            "      --app-load PCT     application load reported to the governor\n"
+            "      --slice US         sliced mode step budget\n"
+            "      --turbo            request the turbo profile\n"
+            "      --dry-run          decode into a digest only, no image written\n"
+            "      --running APP.bin  pre-flight check against this image as the running app\n"
+            "                         (chip, project, version; slot size with --flash)\n"
+            "                         and skip an image it, or the --out file, already is\n"
+            "      --release URL[,VERSION,SIZE,SHA256]\n"
+            "                         announced release (FWRA): fetched without the listing\n"
+            "                         when the scan would pick it\n"
+            "      --ca FILE          PEM CA bundle for https:// (default: system store)\n"
+            "      --link PROFILE     emulate a link: lan, good-wifi, plant-floor, edge-of-range\n"
+            "      --link-bw KBPS     override the link bandwidth\n"
+            "      --link-rtt MS      override the link round trip time\n"
+            "      --link-loss PCT    override the segment loss of the good state\n"
+            "      --seed N           link model seed (default 1)\n"
+            "      --virtual-clock    waits advance the clock instead of sleeping\n"
+            "      --flash TIMING     write through a simulated NOR slot: typical, worst\n"
+            "      --flash-size KB    simulated slot size (default 1920)\n"
+            "      --flash-queue KB   program asynchronously, up to KB queued (default 0: blocking)\n"
+            "      --erase-ahead N    sequential erase: sectors erased ahead of the writes\n"
+            "      --coalesce BYTES   gather writes into programs of at least BYTES\n"
+            "      --wear FILE        per-sector erase counts, loaded and saved across runs\n"
+            "      --record FILE      record the transfer timing into a trace file\n"
+            "      --replay FILE      replay the timing of a recorded trace (device or --record)\n"
+            "      --bench[=KB]       FWBM benchmark: download KB of the latest image (default\n"
+            "                         %d) and decode a sample, JSON on stdout\n"
+            "  -v, --verbose          debug log (twice: verbose)\n"
+            "  -q, --quiet            errors only\n",
+            prog, OTA_BENCH_TRANSPORT_BYTES / 1024);
+}
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"project", required_argument, nullptr, 'p'},
+        {"current", required_argument, nullptr, 'c'},
+        {"target", required_argument, nullptr, 't'},
+        {"out", required_argument, nullptr, 'o'},
+        {"bw", required_argument, nullptr, 'B'},
+        {"cpu", required_argument, nullptr, 'C'},
+        {"load", required_argument, nullptr, 'L'},
+        {"app-load", required_argument, nullptr, 'A'},
+        {"slice", required_argument, nullptr, 'S'},
+        {"turbo", no_argument, nullptr, 'T'},
+        {"dry-run", no_argument, nullptr, 'D'},
+        {"running", required_argument, nullptr, 'a'},
+        {"release", required_argument, nullptr, 'N'},
+        {"ca", required_argument, nullptr, 'K'},
+        {"link", required_argument, nullptr, 'l'},
+        {"link-bw", required_argument, nullptr, 'W'},
+        {"link-rtt", required_argument, nullptr, 'R'},
+        {"link-loss", required_argument, nullptr, 'X'},
+        {"seed", required_argument, nullptr, 's'},
+        {"virtual-clock", no_argument, nullptr, 'V'},
+        {"flash", required_argument, nullptr, 'F'},
+        {"flash-size", required_argument, nullptr, 'Z'},
+        {"flash-queue", required_argument, nullptr, 'Q'},
+        {"erase-ahead", required_argument, nullptr, 'E'},
+        {"coalesce", required_argument, nullptr, 'G'},
+        {"wear", required_argument, nullptr, 'w'},
+        {"record", required_argument, nullptr, 'r'},
+        {"replay", required_argument, nullptr, 'P'},
+        {"bench", optional_argument, nullptr, 'b'},
+        {"verbose", no_argument, nullptr, 'v'},
+        {"quiet", no_argument, nullptr, 'q'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    const char *project = nullptr;
+    const char *current = "v0.0.0-0";
+    const char *outPath = nullptr;
+    const char *caFile = nullptr;
+    const LinkProfile *link = nullptr;
+    LinkProfile linkCustom = {};
+    int linkBw = -1, linkRtt = -1;
+    float linkLoss = -1;
+    uint32_t seed = 1;
+    const FlashTiming *flashProfile = nullptr;
+    size_t flashSize = 1920 * 1024;
+    FlashPolicy flashPolicy;
+    const char *wearPath = nullptr;
+    const char *recordPath = nullptr;
+    const char *replayPath = nullptr;
+    int appLoad = -1;
+    int benchKB = -1;
+    const char *runningPath = nullptr;
+    OtaRequest request = {};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "p:c:t:o:vqh", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'p': project = optarg; break;
+            case 'c': current = optarg; break;
+            case 't':
+                if (!request.setTarget(optarg)) {
+                    fprintf(stderr, "version target too long: %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'o': outPath = optarg; break;
+            case 'B': request.bwKBps = (uint16_t)atoi(optarg); break;
+            case 'C': request.cpuPct = (uint8_t)atoi(optarg); break;
+            case 'L': request.maxLoadPct = (uint8_t)atoi(optarg); break;
+            case 'A': appLoad = atoi(optarg); break;
+            case 'S': request.stepBudgetUs = (uint32_t)atoi(optarg); break;
+            case 'T': request.turbo = true; break;
+            case 'D': request.dryRun = true; break;
+            case 'a': runningPath = optarg; break;
+            case 'N': {
+                // URL,VERSION,SIZE,SHA256 as in the FWRA parameters
+                std::vector<std::string> f;
+                for (const char *p = optarg;; p++) {
+                    const char *comma = strchr(p, ',');
+                    f.push_back(comma ? std::string(p, comma) : std::string(p));
+                    if (comma == nullptr)
+                        break;
+                    p = comma;
+                }
+                f.resize(4);
+                const char *error = request.release.set(f[0].c_str(), f[1].c_str(),
+                                                        f[2].c_str(), f[3].c_str(), nullptr);
+                if (error) {
+                    fprintf(stderr, "bad release: %s\n", error);
+                    return 2;
+                }
+                break;
+            }
+            case 'K': caFile = optarg; break;
+            case 'l':
+                link = linkProfile(optarg);
+                if (link == nullptr) {
+                    fprintf(stderr, "unknown link profile: %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'W': linkBw = atoi(optarg); break;
+            case 'R': linkRtt = atoi(optarg); break;
+            case 'X': linkLoss = (float)atof(optarg); break;
+            case 's': seed = (uint32_t)strtoul(optarg, nullptr, 0); break;
+            case 'V': otaSetVirtualClock(true); break;
+            case 'F':
+                flashProfile = flashTiming(optarg);
+                if (flashProfile == nullptr) {
+                    fprintf(stderr, "unknown flash timing: %s\n", optarg);
+                    return 2;
+                }
+                break;
+            case 'Z': flashSize = (size_t)atoi(optarg) * 1024; break;
+            case 'Q': flashPolicy.queueBytes = (size_t)atoi(optarg) * 1024; break;
+            case 'E': flashPolicy.eraseAhead = atoi(optarg); break;
+            case 'G': flashPolicy.coalesce = (size_t)atoi(optarg); break;
+            case 'w': wearPath = optarg; break;
+            case 'r': recordPath = optarg; break;
+            case 'P': replayPath = optarg; break;
+            case 'b': benchKB = optarg ? atoi(optarg) : OTA_BENCH_TRANSPORT_BYTES / 1024; break;
+            case 'v': otaLogLevel = otaLogLevel == 'D' ? 'V' : 'D'; break;
+            case 'q': otaLogLevel = 'E'; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (project == nullptr || optind >= argc || argc - optind > 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    std::string storageUrl = argv[optind];
+    std::string fallbackUrl = optind + 1 < argc ? argv[optind + 1] : "";
+    // the session appends the image name to the listing URL
+    for (std::string *url : {&storageUrl, &fallbackUrl})
+        if (!url->empty() && url->back() != '/')
+            *url += '/';
+
+    PosixHttpSource httpSource;
+    httpSource.setCaFile(caFile);
+    if (link == nullptr && (linkBw >= 0 || linkRtt >= 0 || linkLoss >= 0))
+        link = linkProfile("lan");
+    if (link && replayPath) {
+        fprintf(stderr, "--replay and --link both pace the transfer, use one\n");
+        return 2;
+    }
+    if (link) {
+        linkCustom = *link;
+        if (linkBw >= 0)
+            linkCustom.bandwidthBps = linkBw * 1024u;
+        if (linkRtt >= 0)
+            linkCustom.rttUs = linkRtt * 1000u;
+        if (linkLoss >= 0)
+            linkCustom.lossPct = linkLoss;
+    }
+    LinkSource linkSource(httpSource, linkCustom, seed);
+    ReplaySource replaySource(httpSource);
+    if (replayPath) {
+        std::vector<uint8_t> trace;
+        if (!readTraceFile(replayPath, trace) || !replaySource.load(trace)) {
+            fprintf(stderr, "cannot read trace: %s\n", replayPath);
+            return 2;
+        }
+    }
+    HttpSource &paced = link ? (HttpSource &)linkSource
+                        : replayPath ? (HttpSource &)replaySource : httpSource;
+    FileTraceOutput traceFile(recordPath ? recordPath : "");
+    TraceRecorder recorder(paced, traceFile);
+    HttpSource &source = recordPath ? (HttpSource &)recorder : paced;
+    if (benchKB >= 0) {
+        // the device reply without the chip and flash parts
+        TransportBench transport = {};
+        DecodeBench decode = {};
+        std::string url;
+        bool fetched = (benchResolve(source, storageUrl.c_str(), project, url) ||
+                        (!fallbackUrl.empty() &&
+                         benchResolve(source, fallbackUrl.c_str(), project, url))) &&
+                       benchTransport(source, url.c_str(), (size_t)benchKB * 1024,
+                                      OTA_BENCH_TRANSPORT_US, transport);
+        bool decoded = benchDecode(OTA_BENCH_DECODE_BYTES, decode);
+        recorder.end();
+        printf("{\"project\": \"%s\", \"version\": \"%s\", \"chip\": null, \"url\": \"%s\", "
+               "\"transport\": %s, \"decode\": %s, \"flash\": null}\n",
+               project, current, url.c_str(), fetched ? benchJson(transport).c_str() : "null",
+               decoded ? benchJson(decode).c_str() : "null");
+        return fetched && decoded ? 0 : 1;
+    }
+    std::string imagePath = outPath ? outPath : "";
+    FileSink sink(imagePath.c_str());   // without --out, named once the image is known
+    if (flashProfile == nullptr && (flashPolicy.queueBytes || flashPolicy.eraseAhead ||
+                                    flashPolicy.coalesce || wearPath))
+        flashProfile = flashTiming("typical");
+    FlashSimSink flashSink(flashProfile ? flashSize : 0,
+                           flashProfile ? *flashProfile : *flashTiming("typical"), flashPolicy,
+                           &sink);
+    if (wearPath && !flashSink.loadWear(wearPath)) {
+        fprintf(stderr, "cannot read wear counters: %s\n", wearPath);
+        return 2;
+    }
+    DigestSink digestSink;
+    OtaSink *target = request.dryRun ? (OtaSink *)&digestSink
+                      : flashProfile ? (OtaSink *)&flashSink : &sink;
+    OtaContext ctx = {&source, target, project, current};
+    OtaSession session(request, storageUrl.c_str(),
+                       fallbackUrl.empty() ? nullptr : fallbackUrl.c_str(), ctx);
+    if (request.turbo)
+        session.setTurbo({true, true, true, -1});
+    session.setLimits(OtaSession::limitsFor(request));
+    session.setStepBudget(request.stepBudgetUs);
+    if (appLoad >= 0)
+        OtaGovernor::reportLoad((uint8_t)appLoad);
+    OtaAppInfo running;
+    if (runningPath) {
+        uint8_t head[OTA_APP_HEADER_BYTES];
+        FILE *f = fopen(runningPath, "rb");
+        bool read = f && fread(head, 1, sizeof(head), f) == sizeof(head);
+        if (f)
+            fclose(f);
+        if (!read || !running.parse(head, sizeof(head))) {
+            fprintf(stderr, "%s: not an ESP-IDF application image\n", runningPath);
+            return 2;
+        }
+        session.setAppCheck({running.chipId, -1, flashProfile ? (uint32_t)flashSize : 0,
+                             running.project, running.version});
+        sink.setRunning(runningPath);
+    }
+
+    while (!session.finished()) {
+        OtaSession::State state = session.step();
+        if (state == OtaSession::CONNECT && imagePath.empty() && !request.dryRun) {
+            imagePath = session.targetFile();
+            if (imagePath.size() > 4 && imagePath.compare(imagePath.size() - 4, 4, ".lz4") == 0)
+                imagePath.resize(imagePath.size() - 4);
+            sink.setPath(imagePath.c_str());
+        }
+        if (uint32_t waitUs = session.waitHintUs()) {
+            if (appLoad >= 0)
+                OtaGovernor::reportLoad((uint8_t)appLoad);   // keep the report fresh
+            otaSleepUs(waitUs);
+        }
+    }
+
+    recorder.end();
+    const OtaMetrics &m = session.metrics();
+    double seconds = (m.endUs - m.startUs) / 1e6;
+    printf("result      %s\n", OtaSession::stateName(session.state()));
+    printf("image       %s -> %s\n", session.targetFile() ? session.targetFile() : "-",
+           session.state() != OtaSession::DONE ? "-"
+           : request.dryRun                    ? "(dry run)"
+           : m.slotReused                      ? (imagePath + " (already there)").c_str()
+                                               : imagePath.c_str());
+    if (request.dryRun && session.state() == OtaSession::DONE) {
+        printf("sha256      ");
+        for (int i = 0; i < OTA_DIGEST_SIZE; i++)
+            printf("%02x", digestSink.digest()[i]);
+        printf("%s\n", session.imageHeader() ? " (verified against the image header)" : "");
+    }
+    printf("compressed  %u bytes\n", (unsigned)m.compressedBytes);
+    printf("written     %u bytes in %.3f s, %u B/s\n", (unsigned)m.writtenBytes, seconds,
+           (unsigned)m.throughputBps);
+    printf("decode      %u B/s, fetch %u B/s, write %u B/s\n", (unsigned)m.decodeBps,
+           (unsigned)m.fetchBps, (unsigned)m.writeBps);
+    printf("worst step  %u us in %s (budget %u us)\n", (unsigned)m.stepMaxUs,
+           OtaSession::stateName((OtaSession::State)m.stepMaxState),
+           (unsigned)m.stepBudgetUs);
+    printf("throttled   %u ms\n", (unsigned)m.throttledMs);
+    if (link)
+        printf("link        %s: %u segments lost, %.3f s stalled\n", linkCustom.name,
+               linkSource.lostSegments(), linkSource.stalledUs() / 1e6);
+    if (replayPath)
+        printf("replay      %u of %u recorded reads, %u untimed calls, %.3f s waiting\n",
+               (unsigned)replaySource.replayedReads(), (unsigned)replaySource.recordedReads(),
+               (unsigned)replaySource.untimedCalls(), replaySource.waitedUs() / 1e6);
+    if (recordPath)
+        printf("trace       %s: %u bytes%s\n", recordPath, (unsigned)recorder.recordBytes(),
+               recorder.truncated() ? " (truncated)" : "");
+    if (flashProfile) {
+        const FlashStats &f = flashSink.stats();
+        printf("flash       %s: %u sector + %u block erases, %u programs, busy %.3f s, "
+               "blocked %.3f s\n",
+               flashProfile->name, (unsigned)f.sectorErases, (unsigned)f.blockErases,
+               (unsigned)f.programOps, f.busyUs / 1e6, f.blockedUs / 1e6);
+        printf("cache off   %.3f s total, %u us longest\n", f.cacheOffUs / 1e6,
+               (unsigned)f.maxCacheOffUs);
+        if (wearPath) {
+            printf("wear        %u erases on the most worn sector\n", (unsigned)f.maxWear);
+            flashSink.saveWear(wearPath);
+        }
+    }
+    return session.state() == OtaSession::DONE || session.state() == OtaSession::CURRENT ? 0 : 1;
+}
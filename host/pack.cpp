@@ -0,0 +1,198 @@
+// #region StdManifest
+/**
+ * @file pack.cpp
+ * @brief ota_pack: packs an ESP-IDF application image (.bin) into the stream
+ * the device decodes (OtaImageHeader, then [uint32 LE size][LZ4 block]
+ * repeated), with fast or hash-chain levels, selectable block and window
+ * sizes and per-block statistics, and checks the result through OtaSession.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "lz4pack.h"
+#include "memio.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace ED_OTA;
+
+namespace {
+
+const size_t SLICED_CHECK_US = 2000;   // step budget of the sliced round trip
+
+std::string hex(const uint8_t *data, size_t len) {
+    std::string s;
+    char b[3];
+    for (size_t i = 0; i < len; i++) {
+        snprintf(b, sizeof(b), "%02x", data[i]);
+        s += b;
+    }
+    return s;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] IMAGE.bin\n"
+            "  -o, --out FILE        packed image (default PROJECT_VERSION.bin.lz4 next to IMAGE)\n"
+            "  -l, --level N         1-2 fast, 3-12 hash-chain search of 2^(N-1) candidates\n"
+            "                        (default 9)\n"
+            "      --fast[=N]        fast level with LZ4 acceleration N (default 1)\n"
+            "  -b, --block BYTES     largest compressed block (default %d)\n"
+            "      --max-block BYTES largest decoded block (default %d)\n"
+            "  -w, --window BYTES    dictionary kept between blocks (default 16384)\n"
+            "  -p, --project NAME    header project (default: from the app descriptor)\n"
+            "  -v, --version VER     header version (default: from the app descriptor)\n"
+            "      --no-header       headerless stream, as read by older devices\n"
+            "  -s, --stats           per-block statistics on stdout\n"
+            "      --no-verify       skip the round trip through OtaSession\n",
+            prog, COMPRESSED_BLOCK_SIZE, DECOMPRESSED_BLOCK_SIZE);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"out", required_argument, nullptr, 'o'},
+        {"level", required_argument, nullptr, 'l'},
+        {"fast", optional_argument, nullptr, 'f'},
+        {"block", required_argument, nullptr, 'b'},
+        {"max-block", required_argument, nullptr, 'B'},
+        {"window", required_argument, nullptr, 'w'},
+        {"project", required_argument, nullptr, 'p'},
+        {"version", required_argument, nullptr, 'v'},
+        {"no-header", no_argument, nullptr, 'H'},
+        {"stats", no_argument, nullptr, 's'},
+        {"no-verify", no_argument, nullptr, 'N'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    PackParams params;
+    params.level = 9;
+    std::string outPath, project, version;
+    bool header = true, stats = false, verify = true;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:l:b:w:p:v:sh", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'o': outPath = optarg; break;
+            case 'l':
+                params.level = atoi(optarg);
+                if (params.level < 1 || params.level > 12) {
+                    fprintf(stderr, "level must be 1-12\n");
+                    return 2;
+                }
+                if (params.level < 3)
+                    params.level = 0;
+                break;
+            case 'f':
+                params.level = 0;
+                params.acceleration = optarg ? atoi(optarg) : 1;
+                break;
+            case 'b': params.maxCompressed = (size_t)atol(optarg); break;
+            case 'B': params.maxBlock = (size_t)atol(optarg); break;
+            case 'w': params.window = (size_t)atol(optarg); break;
+            case 'p': project = optarg; break;
+            case 'v': version = optarg; break;
+            case 'H': header = false; break;
+            case 's': stats = true; break;
+            case 'N': verify = false; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1 || params.maxCompressed < 16 || params.maxBlock == 0 ||
+        params.acceleration < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    const char *inPath = argv[optind];
+    std::vector<uint8_t> image;
+    if (!readFile(inPath, image) || image.empty()) {
+        fprintf(stderr, "cannot read %s\n", inPath);
+        return 1;
+    }
+
+    std::string descProject, descVersion;
+    if (readAppDesc(image, descProject, descVersion)) {
+        if (project.empty())
+            project = descProject;
+        if (version.empty())
+            version = descVersion;
+    } else if (header && (project.empty() || version.empty())) {
+        fprintf(stderr, "%s: no ESP-IDF app descriptor, give --project and --version\n", inPath);
+        return 1;
+    }
+    if (outPath.empty()) {
+        std::string dir = inPath;
+        size_t slash = dir.rfind('/');
+        dir = slash == std::string::npos ? "" : dir.substr(0, slash + 1);
+        outPath = dir + project + "_" + version + ".bin.lz4";
+    }
+
+    std::vector<uint8_t> blocksOut;
+    std::vector<PackBlock> blocks;
+    if (!lz4PackImage(image.data(), image.size(), params, blocksOut, &blocks)) {
+        fprintf(stderr, "%s: a block does not fit %zu bytes\n", inPath, params.maxCompressed);
+        return 1;
+    }
+    std::vector<uint8_t> packed;
+    OtaImageHeader h = makeImageHeader(image.data(), image.size(), blocks, params.window,
+                                       project.c_str(), version.c_str());
+    if (header)
+        packed.insert(packed.end(), (const uint8_t *)&h, (const uint8_t *)&h + sizeof(h));
+    packed.insert(packed.end(), blocksOut.begin(), blocksOut.end());
+
+    if (stats) {
+        size_t base = header ? sizeof(h) : 0;
+        printf("block   offset  decoded  compressed  ratio\n");
+        for (size_t i = 0; i < blocks.size(); i++)
+            printf("%5zu %8zu %8zu %11zu %6.3f\n", i, base + blocks[i].offset, blocks[i].decoded,
+                   blocks[i].compressed, (double)blocks[i].compressed / blocks[i].decoded);
+    }
+
+    bool deviceFit = h.maxCompressed <= COMPRESSED_BLOCK_SIZE &&
+                     h.maxBlock <= DECOMPRESSED_BLOCK_SIZE && params.window <= 16 * 1024;
+    const char *checked = "not verified";
+    if (verify) {
+        std::vector<uint8_t> unpacked;
+        if (!lz4UnpackImage(packed.data(), packed.size(), params, unpacked) || unpacked != image) {
+            fprintf(stderr, "%s: packed image does not unpack to the input\n", inPath);
+            return 1;
+        }
+        checked = "unpacked";
+        if (deviceFit) {
+            otaLogLevel = 'E';
+            if (!sessionRoundTrip(packed, image, project.c_str(), 0) ||
+                !sessionRoundTrip(packed, image, project.c_str(), SLICED_CHECK_US)) {
+                fprintf(stderr, "%s: OtaSession does not decode the packed image\n", inPath);
+                return 1;
+            }
+            checked = "session round trip";
+        }
+    }
+    if (!deviceFit)
+        fprintf(stderr, "warning: blocks %u/%u bytes, window %zu exceed the device decoder\n",
+                (unsigned)h.maxCompressed, (unsigned)h.maxBlock, params.window);
+
+    FILE *out = fopen(outPath.c_str(), "wb");
+    if (out == nullptr || fwrite(packed.data(), 1, packed.size(), out) != packed.size() ||
+        fclose(out) != 0) {
+        perror(outPath.c_str());
+        return 1;
+    }
+    char level[16];
+    snprintf(level, sizeof(level), params.level ? "%d" : "fast=%d",
+             params.level ? params.level : params.acceleration);
+    printf("%s: %s %s, %zu -> %zu bytes (%.1f%%), %zu blocks, level %s, block %u/%u, "
+           "window %zu, sha256 %s, %s\n",
+           outPath.c_str(), project.c_str(), version.c_str(), image.size(), packed.size(),
+           100.0 * packed.size() / image.size(), blocks.size(), level,
+           (unsigned)h.maxCompressed, (unsigned)h.maxBlock, params.window,
+           hex(h.sha256, sizeof(h.sha256)).c_str(), checked);
+    return 0;
+}
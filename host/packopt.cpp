@@ -0,0 +1,439 @@
+// #region StdManifest
+/**
+ * @file packopt.cpp
+ * @brief ota_packopt: packs a firmware image with every combination of
+ * level, block size and window that fits the device, predicts the update
+ * time of each on a link profile and a device profile calibrated from the
+ * device's own metrics, and writes the fastest one with the predicted
+ * breakdown.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "linkemu.h"
+#include "lz4pack.h"
+#include "memio.h"
+#include <algorithm>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifndef ED_OTA_GIT_REV
+#define ED_OTA_GIT_REV "unknown"
+#endif
+
+using namespace ED_OTA;
+
+namespace {
+
+const size_t DEVICE_WINDOW = 16 * 1024;
+
+/// @brief what the device spends per decoded byte and per block.
+struct DeviceProfile {
+  uint32_t decodeBps = 0;   // LZ4 decode, decoded bytes per second
+  uint32_t writeBps = 0;    // esp_ota_write, decoded bytes per second (erase included)
+  uint32_t fetchBps = 0;    // measured FETCH rate, 0 = unknown
+  uint32_t blockUs = 0;     // fixed cost per block (HTTP read call, step overhead)
+  size_t ramBytes = COMPRESSED_BLOCK_SIZE + DECOMPRESSED_BLOCK_SIZE + DEVICE_WINDOW;
+};
+
+/// @brief predicted update time of one packing, microseconds.
+struct Prediction {
+  double setupUs = 0;      // request round trips before the first byte
+  double transferUs = 0;   // link busy delivering the packed image
+  double waitUs = 0;       // device waiting for the network
+  double decodeUs = 0;
+  double writeUs = 0;
+  double totalUs = 0;      // first request to last flash write
+};
+
+struct Candidate {
+  int level;   // 1-2 fast, 3-12 hash chain
+  size_t block, maxBlock, window;
+  size_t packedBytes;
+  std::vector<PackBlock> blocks;
+  Prediction p;
+};
+
+/// @brief expected link time per body byte: the harmonic mean of the good
+/// and bad states weighted by their durations, loss stalls as LinkSource
+/// charges them (a round trip in the good state, a retransmission timeout in
+/// the bad one) and half the jitter of every burst.
+double linkUsPerByte(const LinkProfile &l) {
+    double mss = std::max<uint16_t>(l.mss, 1);
+    double bw = std::max<uint32_t>(l.bandwidthBps, 1);
+    double goodSeg = mss * 1e6 / bw + l.lossPct / 100 * l.rttUs;
+    double badSeg = mss * 1e6 / std::max(1.0, bw * l.badBandwidth) +
+                    l.badLossPct / 100 * std::max(200000.0, 3.0 * l.rttUs);
+    double seg = goodSeg;
+    if (l.goodMeanUs)
+        seg = (double)(l.goodMeanUs + l.badMeanUs) /
+              (l.goodMeanUs / goodSeg + l.badMeanUs / badSeg);
+    seg += l.jitterUs / 2.0 / std::max<uint16_t>(l.burstSegments, 1);
+    return seg / mss;
+}
+
+/**
+ * @brief replays the block sequence of the session against a fluid link: the
+ * device reads a block (waiting when it has not arrived), then decodes and
+ * writes it while the link keeps filling the receive window.
+ */
+Prediction predict(const std::vector<PackBlock> &blocks, size_t headerBytes,
+                   const LinkProfile &link, const DeviceProfile &dev) {
+    Prediction p;
+    double bpt = linkUsPerByte(link);
+    double window = std::max<uint32_t>(link.rcvWindow, 1);
+    p.setupUs = (double)link.setupRtts * link.rttUs;
+    double t = p.setupUs, sent = 0, consumed = 0;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        double need = consumed + 4 + blocks[i].compressed + (i == 0 ? headerBytes : 0);
+        if (sent < need) {
+            double wait = (need - sent) * bpt;
+            p.waitUs += wait;
+            t += wait;
+            sent = need;
+        }
+        consumed = need;
+        double decode = blocks[i].decoded * 1e6 / dev.decodeBps;
+        double write = blocks[i].decoded * 1e6 / dev.writeBps;
+        double busy = decode + write + dev.blockUs;
+        p.decodeUs += decode;
+        p.writeUs += write + dev.blockUs;
+        sent = std::min(sent + busy / bpt, consumed + window);
+        t += busy;
+    }
+    p.transferUs = consumed * bpt;
+    p.totalUs = t;
+    return p;
+}
+
+/// @brief "KEY N B/s" in a FWQS reply or in ota_host output.
+bool findRate(const std::string &text, const char *key, uint32_t &out) {
+    for (size_t at = text.find(key); at != std::string::npos; at = text.find(key, at + 1)) {
+        const char *p = text.c_str() + at + strlen(key);
+        while (*p == ' ')
+            p++;
+        char *end;
+        unsigned long v = strtoul(p, &end, 10);
+        if (end != p && strncmp(end, " B/s", 4) == 0) {
+            out = (uint32_t)v;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief "KEYBps": N in a FWBM reply or in ota_host --bench output.
+bool findJsonRate(const std::string &text, const char *key, uint32_t &out) {
+    std::string field = std::string("\"") + key + "Bps\":";
+    size_t at = text.find(field);
+    if (at == std::string::npos)
+        return false;
+    const char *p = text.c_str() + at + field.size();
+    char *end;
+    unsigned long v = strtoul(p, &end, 10);
+    if (end == p)
+        return false;
+    out = (uint32_t)v;
+    return true;
+}
+
+/// @brief decode, write and fetch rates from device metrics (the FWQS reply
+/// of a previous update, a FWBM reply, or ota_host output).
+bool calibrate(const char *path, DeviceProfile &dev) {
+    std::vector<uint8_t> data;
+    if (!readFile(path, data))
+        return false;
+    std::string text(data.begin(), data.end());
+    bool ok = true;
+    for (const char *key : {"decode", "write", "fetch"}) {
+        uint32_t &rate = key[0] == 'd' ? dev.decodeBps : key[0] == 'w' ? dev.writeBps
+                                                                     : dev.fetchBps;
+        if (!findRate(text, key, rate) && !findJsonRate(text, key, rate) && key[0] != 'f')
+            ok = false;
+    }
+    return ok && dev.decodeBps && dev.writeBps;
+}
+
+std::vector<size_t> parseList(const char *arg) {
+    std::vector<size_t> values;
+    for (const char *p = arg; *p;) {
+        char *end;
+        unsigned long v = strtoul(p, &end, 0);
+        if (end == p)
+            break;
+        values.push_back((size_t)v);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+
+std::string jsonString(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c >= 0x20)
+            out += c;
+    }
+    return out + "\"";
+}
+
+std::string candidateJson(const Candidate &c) {
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\"level\": %d, \"block\": %zu, \"maxBlock\": %zu, \"window\": %zu, "
+             "\"packedBytes\": %zu, \"blocks\": %zu, \"setupMs\": %.1f, \"transferMs\": %.1f, "
+             "\"waitMs\": %.1f, \"decodeMs\": %.1f, \"writeMs\": %.1f, \"totalMs\": %.1f}",
+             c.level, c.block, c.maxBlock, c.window, c.packedBytes, c.blocks.size(),
+             c.p.setupUs / 1e3, c.p.transferUs / 1e3, c.p.waitUs / 1e3, c.p.decodeUs / 1e3,
+             c.p.writeUs / 1e3, c.p.totalUs / 1e3);
+    return buf;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [options] IMAGE.bin\n"
+            "  -o, --out FILE        packed image (default PROJECT_VERSION.bin.lz4 next to IMAGE)\n"
+            "  -p, --project NAME    header project (default: from the app descriptor)\n"
+            "  -v, --version VER     header version (default: from the app descriptor)\n"
+            "  -c, --calibrate FILE  device metrics: FWQS or FWBM reply, or ota_host output\n"
+            "      --decode-bps N    device decode rate, decoded B/s\n"
+            "      --write-bps N     device flash write rate, decoded B/s\n"
+            "      --block-us US     device cost per block (default 0)\n"
+            "      --ram BYTES       decode buffers: block + decoded block + window\n"
+            "                        (default %d, the device buffers)\n"
+            "      --link PROFILE    lan, good-wifi, plant-floor, edge-of-range (default\n"
+            "                        good-wifi, or the calibrated fetch rate)\n"
+            "      --link-bw BPS     override the link bandwidth\n"
+            "      --link-rtt US     override the link round trip time\n"
+            "      --levels LIST     1-2 fast, 3-12 hash chain (default 1,3,6,9,12)\n"
+            "      --blocks LIST     compressed block limits (default 1024,2048,4096)\n"
+            "      --windows LIST    dictionary windows (default 4096,8192,16384)\n"
+            "      --label TEXT      stored in the report\n"
+            "  -r, --report FILE     JSON report with every candidate\n",
+            prog, COMPRESSED_BLOCK_SIZE + DECOMPRESSED_BLOCK_SIZE + (int)DEVICE_WINDOW);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"out", required_argument, nullptr, 'o'},
+        {"project", required_argument, nullptr, 'p'},
+        {"version", required_argument, nullptr, 'v'},
+        {"calibrate", required_argument, nullptr, 'c'},
+        {"decode-bps", required_argument, nullptr, 'D'},
+        {"write-bps", required_argument, nullptr, 'W'},
+        {"block-us", required_argument, nullptr, 'U'},
+        {"ram", required_argument, nullptr, 'M'},
+        {"link", required_argument, nullptr, 'L'},
+        {"link-bw", required_argument, nullptr, 'B'},
+        {"link-rtt", required_argument, nullptr, 'R'},
+        {"levels", required_argument, nullptr, 'l'},
+        {"blocks", required_argument, nullptr, 'b'},
+        {"windows", required_argument, nullptr, 'w'},
+        {"label", required_argument, nullptr, 'T'},
+        {"report", required_argument, nullptr, 'r'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}};
+
+    DeviceProfile dev, given;
+    std::string outPath, project, version, label;
+    const char *calibration = nullptr, *linkName = nullptr, *reportPath = nullptr;
+    uint32_t linkBw = 0, linkRtt = 0;
+    bool rttGiven = false;
+    std::vector<size_t> levels = {1, 3, 6, 9, 12};
+    std::vector<size_t> blockList = {1024, 2048, 4096};
+    std::vector<size_t> windows = {4096, 8192, 16384};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:p:v:c:r:h", options, nullptr)) != -1) {
+        switch (opt) {
+            case 'o': outPath = optarg; break;
+            case 'p': project = optarg; break;
+            case 'v': version = optarg; break;
+            case 'c': calibration = optarg; break;
+            case 'D': given.decodeBps = (uint32_t)atol(optarg); break;
+            case 'W': given.writeBps = (uint32_t)atol(optarg); break;
+            case 'U': dev.blockUs = (uint32_t)atol(optarg); break;
+            case 'M': dev.ramBytes = (size_t)atol(optarg); break;
+            case 'L': linkName = optarg; break;
+            case 'B': linkBw = (uint32_t)atol(optarg); break;
+            case 'R':
+                linkRtt = (uint32_t)atol(optarg);
+                rttGiven = true;
+                break;
+            case 'l': levels = parseList(optarg); break;
+            case 'b': blockList = parseList(optarg); break;
+            case 'w': windows = parseList(optarg); break;
+            case 'T': label = optarg; break;
+            case 'r': reportPath = optarg; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (optind != argc - 1 || levels.empty() || blockList.empty() || windows.empty()) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (calibration && !calibrate(calibration, dev)) {
+        fprintf(stderr, "%s: no decode and write rates in the device metrics\n", calibration);
+        return 1;
+    }
+    if (given.decodeBps)
+        dev.decodeBps = given.decodeBps;
+    if (given.writeBps)
+        dev.writeBps = given.writeBps;
+    if (dev.decodeBps == 0 || dev.writeBps == 0) {
+        fprintf(stderr, "give --calibrate or both --decode-bps and --write-bps\n");
+        return 2;
+    }
+
+    LinkProfile link = *linkProfile("good-wifi");
+    if (linkName) {
+        const LinkProfile *named = linkProfile(linkName);
+        if (named == nullptr) {
+            fprintf(stderr, "unknown link profile: %s\n", linkName);
+            return 2;
+        }
+        link = *named;
+    } else if (dev.fetchBps) {
+        // the rate the device fetched at: a clean link with the default window
+        link = *linkProfile("lan");
+        link.name = "calibrated";
+        link.bandwidthBps = dev.fetchBps;
+        link.rcvWindow = linkProfile("good-wifi")->rcvWindow;
+    }
+    if (linkBw)
+        link.bandwidthBps = linkBw;
+    if (rttGiven)
+        link.rttUs = linkRtt;
+
+    const char *inPath = argv[optind];
+    std::vector<uint8_t> image;
+    if (!readFile(inPath, image) || image.empty()) {
+        fprintf(stderr, "cannot read %s\n", inPath);
+        return 1;
+    }
+    std::string descProject, descVersion;
+    if (readAppDesc(image, descProject, descVersion)) {
+        if (project.empty())
+            project = descProject;
+        if (version.empty())
+            version = descVersion;
+    } else if (project.empty() || version.empty()) {
+        fprintf(stderr, "%s: no ESP-IDF app descriptor, give --project and --version\n", inPath);
+        return 1;
+    }
+    if (outPath.empty()) {
+        std::string dir = inPath;
+        size_t slash = dir.rfind('/');
+        dir = slash == std::string::npos ? "" : dir.substr(0, slash + 1);
+        outPath = dir + project + "_" + version + ".bin.lz4";
+    }
+
+    // candidates within the device decoder and the RAM budget, cheapest level first
+    std::sort(levels.begin(), levels.end());
+    std::vector<Candidate> candidates;
+    size_t best = SIZE_MAX;
+    for (size_t level : levels) {
+        for (size_t block : blockList) {
+            for (size_t window : windows) {
+                Candidate c = {};
+                c.level = (int)std::min<size_t>(level, 12);
+                c.block = block;
+                c.maxBlock = std::min<size_t>(4 * block, DECOMPRESSED_BLOCK_SIZE);
+                c.window = window;
+                if (block > COMPRESSED_BLOCK_SIZE || window > DEVICE_WINDOW ||
+                    block + c.maxBlock + window > dev.ramBytes)
+                    continue;
+                PackParams params;
+                params.maxCompressed = block;
+                params.maxBlock = c.maxBlock;
+                params.window = window;
+                params.level = c.level >= 3 ? c.level : 0;
+                std::vector<uint8_t> packed;
+                if (!lz4PackImage(image.data(), image.size(), params, packed, &c.blocks))
+                    continue;
+                c.packedBytes = packed.size() + sizeof(OtaImageHeader);
+                c.p = predict(c.blocks, sizeof(OtaImageHeader), link, dev);
+                candidates.push_back(c);
+                if (best == SIZE_MAX || c.p.totalUs < candidates[best].p.totalUs)
+                    best = candidates.size() - 1;
+            }
+        }
+    }
+    if (best == SIZE_MAX) {
+        fprintf(stderr, "no packing fits --ram %zu\n", dev.ramBytes);
+        return 1;
+    }
+
+    // the winner, packed again and checked through the session
+    const Candidate &w = candidates[best];
+    PackParams params;
+    params.maxCompressed = w.block;
+    params.maxBlock = w.maxBlock;
+    params.window = w.window;
+    params.level = w.level >= 3 ? w.level : 0;
+    std::vector<uint8_t> blocksOut, packed;
+    std::vector<PackBlock> blocks;
+    lz4PackImage(image.data(), image.size(), params, blocksOut, &blocks);
+    OtaImageHeader h = makeImageHeader(image.data(), image.size(), blocks, params.window,
+                                       project.c_str(), version.c_str());
+    packed.insert(packed.end(), (const uint8_t *)&h, (const uint8_t *)&h + sizeof(h));
+    packed.insert(packed.end(), blocksOut.begin(), blocksOut.end());
+    otaLogLevel = 'E';
+    if (!sessionRoundTrip(packed, image, project.c_str(), 0)) {
+        fprintf(stderr, "%s: OtaSession does not decode the packed image\n", inPath);
+        return 1;
+    }
+    FILE *out = fopen(outPath.c_str(), "wb");
+    if (out == nullptr || fwrite(packed.data(), 1, packed.size(), out) != packed.size() ||
+        fclose(out) != 0) {
+        perror(outPath.c_str());
+        return 1;
+    }
+
+    printf("%s: level %d, block %zu/%zu, window %zu, %zu -> %zu bytes\n", outPath.c_str(),
+           w.level, w.block, w.maxBlock, w.window, image.size(), w.packedBytes);
+    printf("link        %s, %u B/s, rtt %u us\n", link.name, (unsigned)link.bandwidthBps,
+           (unsigned)link.rttUs);
+    printf("device      decode %u B/s, write %u B/s, %u us per block\n",
+           (unsigned)dev.decodeBps, (unsigned)dev.writeBps, (unsigned)dev.blockUs);
+    printf("predicted   %.3f s: setup %.3f, transfer %.3f, waiting %.3f, decode %.3f, "
+           "write %.3f (%zu candidates)\n",
+           w.p.totalUs / 1e6, w.p.setupUs / 1e6, w.p.transferUs / 1e6, w.p.waitUs / 1e6,
+           w.p.decodeUs / 1e6, w.p.writeUs / 1e6, candidates.size());
+
+    if (reportPath) {
+        FILE *r = fopen(reportPath, "w");
+        if (r == nullptr) {
+            perror(reportPath);
+            return 1;
+        }
+        fprintf(r, "{\n  \"tool\": \"ota_packopt\",\n  \"rev\": %s,\n  \"label\": %s,\n"
+                   "  \"image\": %s,\n  \"imageBytes\": %zu,\n  \"output\": %s,\n",
+                jsonString(ED_OTA_GIT_REV).c_str(), jsonString(label).c_str(),
+                jsonString(inPath).c_str(), image.size(), jsonString(outPath).c_str());
+        fprintf(r, "  \"link\": {\"name\": %s, \"bandwidthBps\": %u, \"rttUs\": %u, "
+                   "\"usPerByte\": %.4f, \"rcvWindow\": %u},\n",
+                jsonString(link.name).c_str(), (unsigned)link.bandwidthBps,
+                (unsigned)link.rttUs, linkUsPerByte(link), (unsigned)link.rcvWindow);
+        fprintf(r, "  \"device\": {\"decodeBps\": %u, \"writeBps\": %u, \"fetchBps\": %u, "
+                   "\"blockUs\": %u, \"ramBytes\": %zu, \"calibration\": %s},\n",
+                (unsigned)dev.decodeBps, (unsigned)dev.writeBps, (unsigned)dev.fetchBps,
+                (unsigned)dev.blockUs, dev.ramBytes,
+                calibration ? jsonString(calibration).c_str() : "null");
+        fprintf(r, "  \"best\": %s,\n  \"candidates\": [", candidateJson(w).c_str());
+        for (size_t i = 0; i < candidates.size(); i++)
+            fprintf(r, "%s\n    %s", i ? "," : "", candidateJson(candidates[i]).c_str());
+        fprintf(r, "\n  ]\n}\n");
+        fclose(r);
+    }
+    return 0;
+}
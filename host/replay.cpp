@@ -0,0 +1,133 @@
+#include "replay.h"
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+namespace ED_OTA {
+
+static const char *TAG = "ED_OTA";
+
+// ---------- FileTraceOutput ----------
+
+bool FileTraceOutput::begin() {
+    f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+        OTA_LOGE(TAG, "cannot write %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool FileTraceOutput::write(const uint8_t *data, size_t len) {
+    return f && fwrite(data, 1, len, f) == len;
+}
+
+void FileTraceOutput::end(uint32_t recordBytes) {
+    if (f == nullptr)
+        return;
+    if (recordBytes != 0xFFFFFFFF && fseek(f, OTA_TRACE_LENGTH_OFFSET, SEEK_SET) == 0)
+        fwrite(&recordBytes, sizeof(recordBytes), 1, f);
+    fclose(f);
+    f = nullptr;
+}
+
+bool readTraceFile(const char *path, std::vector<uint8_t> &out) {
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr)
+        return false;
+    out.clear();
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// ---------- ReplaySource ----------
+
+bool ReplaySource::load(const std::vector<uint8_t> &trace) {
+    TraceReader reader;
+    if (!reader.begin(trace.data(), trace.size()))
+        return false;
+    events.clear();
+    TraceEvent e;
+    while (reader.next(e))
+        events.push_back(e);
+    reads = std::count_if(events.begin(), events.end(),
+                          [](const TraceEvent &ev) { return ev.type == 'R'; });
+    next = 0;
+    return true;
+}
+
+void ReplaySource::sleepUntil(int64_t us) {
+    int64_t now = otaNowUs();
+    while (now < us) {
+        otaSleepUs((uint32_t)std::min<int64_t>(us - now, UINT32_MAX));
+        int64_t then = otaNowUs();
+        waited += then - now;
+        now = then;
+    }
+}
+
+bool ReplaySource::open(const char *url) {
+    timed = false;
+    arrived = 0;
+    while (next < events.size() && events[next].type != 'O' && events[next].type != 'F')
+        next++;
+    if (next >= events.size()) {
+        untimed++;
+        return inner.open(url);
+    }
+    const TraceEvent &e = events[next++];
+    int64_t start = otaNowUs();
+    if (e.type == 'F') {
+        sleepUntil(start + e.openUs);   // the recorded open failed: so does this one
+        return false;
+    }
+    bool ok = inner.open(url);
+    sleepUntil(start + e.openUs);
+    if (ok && inner.status() != e.status)
+        OTA_LOGW(TAG, "replay: status %d, recorded %d", inner.status(), e.status);
+    timed = ok;
+    baseUs = otaNowUs();
+    traceUs = 0;
+    return ok;
+}
+
+int ReplaySource::read(char *buf, size_t len) {
+    if (timed && arrived == 0) {
+        if (next >= events.size() || events[next].type != 'R') {
+            timed = false;   // the trace has no more reads for this body
+        } else {
+            const TraceEvent &e = events[next++];
+            traceUs += (int64_t)e.idleUs + e.waitUs;
+            sleepUntil(baseUs + traceUs);
+            replayed++;
+            if (e.result < 0)
+                return e.result;   // the recorded read failed
+            arrived = e.result;
+            if (arrived == 0)
+                return inner.read(buf, len);
+        }
+    }
+    if (!timed) {
+        untimed++;
+        return inner.read(buf, len);
+    }
+    int n = inner.read(buf, std::min(len, arrived));
+    if (n > 0)
+        arrived -= n;
+    else if (n != OTA_READ_AGAIN)
+        arrived = 0;
+    return n;
+}
+
+void ReplaySource::close() {
+    inner.close();
+    timed = false;
+    arrived = 0;
+}
+
+} // namespace ED_OTA
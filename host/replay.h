@@ -0,0 +1,88 @@
+// #region StdManifest
+/**
+ * @file replay.h
+ * @brief transfer trace replay for the host harness: an HttpSource that
+ * delivers the body of another source with the call sizes and timing of a
+ * trace recorded by TraceRecorder (on a device or with ota_host --record).
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_trace.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace ED_OTA {
+
+/// @brief trace file for TraceRecorder.
+class FileTraceOutput : public TraceOutput {
+public:
+  explicit FileTraceOutput(const char *path) : path(path) {}
+  ~FileTraceOutput() { end(0xFFFFFFFF); }
+
+  bool begin() override;
+  bool write(const uint8_t *data, size_t len) override;
+  void end(uint32_t recordBytes) override;
+
+private:
+  std::string path;
+  FILE *f = nullptr;
+};
+
+/**
+ * @brief wraps an HttpSource and replays a trace on it.
+ *
+ * The k-th open() of the session takes the time of the k-th recorded open,
+ * and recorded failures fail again. The bytes of every recorded read arrive
+ * when that read returned on the recording device, relative to the end of
+ * its open; bytes that were already buffered there are taken to have arrived
+ * when the device asked for them. A faster consumer therefore waits for the
+ * recorded network, a slower one finds the data ready. Reads of a different
+ * size than recorded are served from the recorded arrivals, and calls beyond
+ * the trace pass through untimed. The content comes from the inner source.
+ */
+class ReplaySource : public HttpSource {
+public:
+  ReplaySource(HttpSource &inner) : inner(inner) {}
+
+  /// @brief parses a trace image; false when it is not a valid trace.
+  bool load(const std::vector<uint8_t> &trace);
+
+  bool open(const char *url) override;
+  int status() override { return inner.status(); }
+  int64_t contentLength() override { return inner.contentLength(); }
+  int read(char *buf, size_t len) override;
+  void close() override;
+
+  size_t recordedReads() const { return reads; }
+  size_t replayedReads() const { return replayed; }
+  size_t untimedCalls() const { return untimed; }
+  /// @brief time spent waiting for recorded arrivals, microseconds.
+  int64_t waitedUs() const { return waited; }
+
+private:
+  HttpSource &inner;
+  std::vector<TraceEvent> events;
+  size_t next = 0;          // next event to replay
+  bool timed = false;       // the current body follows a recorded open
+  int64_t baseUs = 0;       // host time of the recorded open's return
+  int64_t traceUs = 0;      // trace time since that return
+  size_t arrived = 0;       // bytes of consumed read records not yet delivered
+  size_t reads = 0;
+  size_t replayed = 0;
+  size_t untimed = 0;
+  int64_t waited = 0;
+
+  void sleepUntil(int64_t us);
+};
+
+/// @brief reads a whole file; false when it cannot be read.
+bool readTraceFile(const char *path, std::vector<uint8_t> &out);
+
+} // namespace ED_OTA
@@ -0,0 +1,68 @@
+// #region StdManifest
+/**
+ * @file check.h
+ * @brief minimal checks for the host unit tests: CHECK records a failure and
+ * goes on, checkResult() turns the count into the exit status for ctest.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+static int checkFailures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      checkFailures++;                                                         \
+    }                                                                          \
+  } while (0)
+
+/// @brief exit status of a test program: 0 when every check passed.
+static inline int checkResult(const char *name) {
+  if (checkFailures)
+    fprintf(stderr, "%s: %d check(s) failed\n", name, checkFailures);
+  else
+    printf("%s: ok\n", name);
+  return checkFailures ? 1 : 0;
+}
+
+/// @brief xorshift32, so every run sees the same data.
+static inline uint32_t checkRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/// @brief firmware-like test data: short random literal runs between copies
+/// of earlier bytes, near (overlapping, as in fills) and up to 48 KB back, so
+/// LZ4 blocks refer into the window of previous blocks.
+static inline std::vector<uint8_t> sampleImage(size_t len, uint32_t seed) {
+  std::vector<uint8_t> image;
+  image.reserve(len);
+  uint32_t s = seed ? seed : 1;
+  while (image.size() < len) {
+    size_t literals = 1 + checkRandom(s) % 24;
+    for (size_t i = 0; i < literals && image.size() < len; i++)
+      image.push_back((uint8_t)checkRandom(s));
+    if (image.size() < 8)
+      continue;
+    uint32_t r = checkRandom(s);
+    size_t back = r % 4 == 0 ? 1 + r / 4 % 3 : 1 + r / 4 % 48000;
+    back = back < image.size() ? back : image.size();
+    size_t copy = 4 + checkRandom(s) % (r % 16 == 0 ? 600 : 40);
+    for (size_t i = 0; i < copy && image.size() < len; i++)
+      image.push_back(image[image.size() - back]);
+  }
+  return image;
+}
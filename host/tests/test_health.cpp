@@ -0,0 +1,132 @@
+// #region StdManifest
+/**
+ * @file test_health.cpp
+ * @brief OtaHealth: verdicts of the probe rounds (pending, pass, fail,
+ * missed deadline), passed probes not polled again, a full registry and
+ * probes registering more probes while a round runs.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "check.h"
+#include "ED_OTA_health.h"
+#include <string.h>
+
+using namespace ED_OTA;
+
+/// @brief a probe that answers PENDING until its calls reach passAt (then
+/// result), counting the calls.
+struct Counter {
+    int calls = 0;
+    int passAt = 1;
+    OtaHealth::Result result = OtaHealth::PASS;
+};
+
+static OtaHealth::Result counted(void *arg) {
+    Counter *c = (Counter *)arg;
+    return ++c->calls >= c->passAt ? c->result : OtaHealth::PENDING;
+}
+
+static const int64_t MS = 1000;
+
+static void checkEmpty() {
+    OtaHealth health;
+    CHECK(health.size() == 0);
+    CHECK(health.run(0, 0) == OtaHealth::PENDING);   // no probe: nothing to confirm
+    CHECK(health.failed() == nullptr);
+}
+
+static void checkPass() {
+    OtaHealth health;
+    Counter mqtt, sensor;
+    mqtt.passAt = 1;
+    sensor.passAt = 3;
+    CHECK(health.add("mqtt", counted, &mqtt, 10000));
+    CHECK(health.add("sensor", counted, &sensor, 10000));
+    CHECK(health.run(0, 0) == OtaHealth::PENDING);
+    CHECK(health.passed() == 1);
+    CHECK(health.run(0, 500 * MS) == OtaHealth::PENDING);
+    CHECK(health.run(0, 1000 * MS) == OtaHealth::PASS);
+    CHECK(health.passed() == 2 && health.failed() == nullptr);
+    CHECK(mqtt.calls == 1);   // a passed probe is kept, not polled again
+    CHECK(sensor.calls == 3);
+}
+
+static void checkFail() {
+    OtaHealth health;
+    Counter mqtt, sensor;
+    sensor.passAt = 2;
+    sensor.result = OtaHealth::FAIL;
+    CHECK(health.add("mqtt", counted, &mqtt, 10000));
+    CHECK(health.add("sensor", counted, &sensor, 10000));
+    CHECK(health.run(0, 0) == OtaHealth::PENDING);
+    CHECK(health.run(0, 500 * MS) == OtaHealth::FAIL);
+    CHECK(health.failed() != nullptr && strcmp(health.failed(), "sensor") == 0);
+    CHECK(health.passed() == 1);
+}
+
+static void checkDeadline() {
+    OtaHealth health;
+    Counter slow, never;
+    slow.passAt = 1000;
+    never.passAt = 1000;
+    CHECK(health.add("slow", counted, &slow, 2000));
+    CHECK(health.add("never", counted, &never, 1000));
+    int64_t start = 5000 * MS;   // deadlines count from the start given to run()
+    CHECK(health.run(start, start + 1000 * MS) == OtaHealth::PENDING);   // at the deadline
+    CHECK(health.run(start, start + 1001 * MS) == OtaHealth::FAIL);
+    CHECK(health.failed() != nullptr && strcmp(health.failed(), "never") == 0);
+}
+
+static void checkFull() {
+    OtaHealth health;
+    Counter c;
+    for (int i = 0; i < OTA_HEALTH_MAX_PROBES; i++)
+        CHECK(health.add("probe", counted, &c, 1000));
+    CHECK(!health.add("one more", counted, &c, 1000));
+    CHECK(health.size() == OTA_HEALTH_MAX_PROBES);
+
+    OtaHealth other;
+    CHECK(!other.add("no function", nullptr, nullptr, 1000));
+    CHECK(other.size() == 0);
+}
+
+/// @brief a probe registering a second one, as a component started late does.
+struct Registrar {
+    OtaHealth *health;
+    Counter late;
+    bool added = false;
+};
+
+static OtaHealth::Result registering(void *arg) {
+    Registrar *r = (Registrar *)arg;
+    if (!r->added)
+        r->added = r->health->add("late", counted, &r->late, 10000);
+    return OtaHealth::PASS;
+}
+
+static void checkAddDuringRun() {
+    OtaHealth health;
+    Registrar r;
+    r.health = &health;
+    r.late.passAt = 2;
+    CHECK(health.add("registrar", registering, &r, 10000));
+    CHECK(health.run(0, 0) == OtaHealth::PASS);   // the new probe joins the next round
+    CHECK(r.added && health.size() == 2);
+    CHECK(health.run(0, 500 * MS) == OtaHealth::PENDING);
+    CHECK(health.run(0, 1000 * MS) == OtaHealth::PASS);
+    CHECK(health.passed() == 2);
+}
+
+int main() {
+    checkEmpty();
+    checkPass();
+    checkFail();
+    checkDeadline();
+    checkFull();
+    checkAddDuringRun();
+    return checkResult("test_health");
+}
@@ -0,0 +1,117 @@
+// #region StdManifest
+/**
+ * @file test_lz4pack.cpp
+ * @brief the host packer: fast and hash-chain levels round trip through the
+ * device window rules, keep the block limits, and the chain levels pack
+ * smaller than the fast one; short, incompressible and headered images.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "check.h"
+#include "lz4pack.h"
+#include <string.h>
+
+using namespace ED_OTA;
+
+/// @brief packs image, checks the block list against the limits and unpacks
+/// it again; returns the packed size, 0 when packing failed.
+static size_t roundTrip(const std::vector<uint8_t> &image, const PackParams &params) {
+    std::vector<uint8_t> packed, unpacked;
+    std::vector<PackBlock> blocks;
+    bool packedOk = lz4PackImage(image.data(), image.size(), params, packed, &blocks);
+    CHECK(packedOk);
+    if (!packedOk)
+        return 0;
+    size_t offset = 0, decoded = 0;
+    for (const PackBlock &b : blocks) {
+        CHECK(b.offset == offset);
+        CHECK(b.compressed > 0 && b.compressed <= params.maxCompressed);
+        CHECK(b.decoded > 0 && b.decoded <= params.maxBlock);
+        offset += 4 + b.compressed;
+        decoded += b.decoded;
+    }
+    CHECK(offset == packed.size());
+    CHECK(decoded == image.size());
+    // the device keeps only params.window bytes: a match reaching further fails here
+    CHECK(lz4UnpackImage(packed.data(), packed.size(), params, unpacked));
+    CHECK(unpacked == image);
+    return packed.size();
+}
+
+static void checkLevels() {
+    std::vector<uint8_t> image = sampleImage(200000, 11);
+    static const int levels[] = {0, 3, 6, 9, 12};
+    static const size_t windows[] = {4096, 16 * 1024};
+    for (size_t window : windows) {
+        size_t fastSize = 0;
+        for (int level : levels) {
+            PackParams params;
+            params.window = window;
+            params.level = level;
+            size_t size = roundTrip(image, params);
+            if (level == 0)
+                fastSize = size;
+            else if (level >= 6)
+                CHECK(size > 0 && size < fastSize);
+        }
+    }
+}
+
+/// @brief images shorter than the last-match limit are literals only.
+static void checkShort() {
+    std::vector<uint8_t> image = sampleImage(64, 5);
+    PackParams params;
+    params.level = 9;
+    for (size_t len = 0; len <= image.size(); len++)
+        roundTrip(std::vector<uint8_t>(image.begin(), image.begin() + len), params);
+    std::vector<uint8_t> zeros(100000, 0);   // one long overlapping match per block
+    roundTrip(zeros, params);
+}
+
+/// @brief random bytes do not fit the compressed limit: blocks are halved.
+static void checkIncompressible() {
+    std::vector<uint8_t> image(40000);
+    uint32_t s = 99;
+    for (uint8_t &b : image)
+        b = (uint8_t)checkRandom(s);
+    PackParams params;
+    params.level = 9;
+    roundTrip(image, params);
+    params.level = 0;
+    roundTrip(image, params);
+}
+
+/// @brief a header in front of the blocks is read back and skipped.
+static void checkHeader() {
+    std::vector<uint8_t> image = sampleImage(50000, 21), packed, unpacked;
+    std::vector<PackBlock> blocks;
+    PackParams params;
+    params.level = 9;
+    CHECK(lz4PackImage(image.data(), image.size(), params, packed, &blocks));
+    OtaImageHeader header = makeImageHeader(image.data(), image.size(), blocks, params.window,
+                                            "P029", "v2.0.0-3");
+    std::vector<uint8_t> withHeader((const uint8_t *)&header, (const uint8_t *)(&header + 1));
+    withHeader.insert(withHeader.end(), packed.begin(), packed.end());
+
+    OtaImageHeader read;
+    size_t headerBytes = 0;
+    CHECK(readImageHeader(withHeader.data(), withHeader.size(), read, headerBytes));
+    CHECK(headerBytes == sizeof(header));
+    CHECK(read.imageSize == image.size() && read.window == params.window);
+    CHECK(strcmp(read.project, "P029") == 0 && strcmp(read.version, "v2.0.0-3") == 0);
+    CHECK(lz4UnpackImage(withHeader.data(), withHeader.size(), params, unpacked));
+    CHECK(unpacked == image);
+    CHECK(readImageHeader(packed.data(), packed.size(), read, headerBytes) && headerBytes == 0);
+}
+
+int main() {
+    checkLevels();
+    checkShort();
+    checkIncompressible();
+    checkHeader();
+    return checkResult("test_lz4pack");
+}
@@ -0,0 +1,125 @@
+// #region StdManifest
+/**
+ * @file test_lz4slice.cpp
+ * @brief LZ4SliceDecoder against LZ4_decompress_safe_continue: packed images
+ * decoded block by block with the window as dictionary, each block stopped
+ * and resumed at fixed and random slice sizes, plus malformed blocks.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "check.h"
+#include "ED_OTA_lz4slice.h"
+#include "lz4pack.h"
+#include <string.h>
+
+using namespace ED_OTA;
+
+/// @brief decodes block in slices of slice bytes (0: random sizes) and checks
+/// that no call overruns its slice and the result equals expect.
+static void checkSliced(const uint8_t *block, size_t size, const uint8_t *dict, int dictSize,
+                        const uint8_t *expect, int expectSize, size_t capacity, size_t slice,
+                        uint32_t &seed) {
+    std::vector<uint8_t> out(capacity);
+    LZ4SliceDecoder slicer;
+    slicer.begin(block, size, out.data(), capacity, dict, dictSize);
+    LZ4SliceDecoder::Result r;
+    size_t calls = 0;
+    do {
+        size_t before = slicer.produced();
+        size_t maxOut = slice ? slice : 1 + checkRandom(seed) % 700;
+        r = slicer.decode(maxOut);
+        CHECK(slicer.produced() - before <= maxOut);
+        CHECK(r == LZ4SliceDecoder::DONE || slicer.produced() > before);
+        calls++;
+    } while (r == LZ4SliceDecoder::MORE && calls <= capacity);
+    CHECK(r == LZ4SliceDecoder::DONE);
+    CHECK(slicer.produced() == (size_t)expectSize);
+    CHECK(memcmp(out.data(), expect, expectSize) == 0);
+}
+
+/// @brief packs image with params and decodes it twice, by the reference and
+/// sliced, resuming at each of the slice sizes.
+static void checkPacked(const std::vector<uint8_t> &image, const PackParams &params) {
+    std::vector<uint8_t> packed;
+    std::vector<PackBlock> blocks;
+    CHECK(lz4PackImage(image.data(), image.size(), params, packed, &blocks));
+
+    static const size_t slices[] = {1, 2, 3, 5, 16, 255, 256, 4096, 0};
+    std::vector<uint8_t> window(params.window), reference(params.maxBlock), decoded;
+    LZ4_streamDecode_t *stream = LZ4_createStreamDecode();
+    uint32_t seed = 7;
+    int used = 0;
+    for (const PackBlock &b : blocks) {
+        const uint8_t *src = packed.data() + b.offset + 4;
+        LZ4_setStreamDecode(stream, (const char *)window.data(), used);
+        int n = LZ4_decompress_safe_continue(stream, (const char *)src,
+                                             (char *)reference.data(), (int)b.compressed,
+                                             (int)params.maxBlock);
+        CHECK(n == (int)b.decoded);
+        if (n < 0)
+            break;
+        for (size_t slice : slices)
+            checkSliced(src, b.compressed, window.data(), used, reference.data(), n,
+                        params.maxBlock, slice, seed);
+        decoded.insert(decoded.end(), reference.begin(), reference.begin() + n);
+        used = windowAppend(window.data(), used, (int)params.window, reference.data(), n);
+    }
+    LZ4_freeStreamDecode(stream);
+    CHECK(decoded == image);
+}
+
+/// @brief blocks the reference rejects are rejected, not overrun.
+static void checkMalformed() {
+    std::vector<uint8_t> image = sampleImage(20000, 3);
+    std::vector<uint8_t> packed;
+    std::vector<PackBlock> blocks;
+    PackParams params;
+    CHECK(lz4PackImage(image.data(), image.size(), params, packed, &blocks));
+    const uint8_t *src = packed.data() + blocks[0].offset + 4;
+    size_t size = blocks[0].compressed;
+    std::vector<uint8_t> out(params.maxBlock);
+    LZ4SliceDecoder slicer;
+
+    // truncated input
+    slicer.begin(src, size - 1, out.data(), out.size(), nullptr, 0);
+    CHECK(slicer.decode(out.size()) == LZ4SliceDecoder::ERROR);
+    // output one byte short of the block
+    slicer.begin(src, size, out.data(), blocks[0].decoded - 1, nullptr, 0);
+    CHECK(slicer.decode(out.size()) == LZ4SliceDecoder::ERROR);
+
+    // a match reaching before the dictionary: 1 literal, offset 5, then 5 literals
+    const uint8_t bad[] = {0x10, 'A', 0x05, 0x00, 0x50, 'a', 'b', 'c', 'd', 'e'};
+    CHECK(LZ4_decompress_safe((const char *)bad, (char *)out.data(), sizeof(bad),
+                              (int)out.size()) < 0);
+    slicer.begin(bad, sizeof(bad), out.data(), out.size(), nullptr, 0);
+    CHECK(slicer.decode(out.size()) == LZ4SliceDecoder::ERROR);
+    // the same block is valid with 4 bytes of dictionary
+    const uint8_t dict[] = {'w', 'x', 'y', 'z'};
+    slicer.begin(bad, sizeof(bad), out.data(), out.size(), dict, sizeof(dict));
+    CHECK(slicer.decode(1) == LZ4SliceDecoder::MORE);
+    CHECK(slicer.decode(out.size()) == LZ4SliceDecoder::DONE);
+    CHECK(slicer.produced() == 10 && memcmp(out.data(), "Awxyzabcde", 10) == 0);
+}
+
+int main() {
+    std::vector<uint8_t> image = sampleImage(300000, 1);
+
+    PackParams device;   // the device geometry: 4 KB compressed, 16 KB blocks and window
+    checkPacked(image, device);
+
+    PackParams chained = device;   // hash-chain matches, longer and farther back
+    chained.level = 9;
+    checkPacked(image, chained);
+
+    PackParams small = device;   // small window, blocks split by the compressed limit
+    small.window = 4096;
+    small.maxCompressed = 1024;
+    checkPacked(image, small);
+
+    checkMalformed();
+    return checkResult("test_lz4slice");
+}
@@ -0,0 +1,141 @@
+// #region StdManifest
+/**
+ * @file test_release.cpp
+ * @brief OtaSession with an announced release (FWRA): fetched directly when
+ * its URL answers, the listing scanned as usual when the URL cannot be
+ * opened or answers 404, with and without the announced size and digest;
+ * messages of the release topic parsed.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "check.h"
+#include "ED_OTA_session.h"
+#include "lz4pack.h"
+#include "memio.h"
+#include <string.h>
+#include <string>
+
+using namespace ED_OTA;
+
+static const char *const IMAGE_NAME = "P029_v1.0.0-0.bin.lz4";
+
+/// @brief MemorySource behind a CDN stand-in: URLs under "mem://gone/"
+/// answer 404, under "mem://down/" the connection fails; every URL opened
+/// is recorded.
+class CdnSource : public HttpSource {
+public:
+    explicit CdnSource(MemorySource &origin) : origin(origin) {}
+
+    bool open(const char *url) override {
+        opened.push_back(url);
+        gone = strncmp(url, "mem://gone/", 11) == 0;
+        if (strncmp(url, "mem://down/", 11) == 0)
+            return false;
+        return gone || origin.open(url);
+    }
+    int status() override { return gone ? 404 : origin.status(); }
+    int64_t contentLength() override { return gone ? 0 : origin.contentLength(); }
+    int read(char *buf, size_t len) override { return gone ? 0 : origin.read(buf, len); }
+    void close() override { origin.close(); }
+
+    std::vector<std::string> opened;
+
+private:
+    MemorySource &origin;
+    bool gone = false;
+};
+
+/// @brief runs an update of P029 from v0.0.0-0 with the release announced at
+/// url (size and digest of image when announced) and checks that image is
+/// written; returns the URLs the session opened.
+static std::vector<std::string> update(const std::vector<uint8_t> &packed,
+                                       const std::vector<uint8_t> &image, const char *url,
+                                       bool announced) {
+    MemorySource origin(IMAGE_NAME, packed);
+    CdnSource source(origin);
+    MemorySink sink(image.size());
+    OtaContext ctx = {&source, &sink, "P029", "v0.0.0-0"};
+    OtaRequest request = {};
+    char size[16], digest[2 * OTA_DIGEST_SIZE + 1];
+    uint8_t sha[OTA_DIGEST_SIZE];
+    OtaSha256 hash;
+    hash.update(image.data(), image.size());
+    hash.finish(sha);
+    for (int i = 0; i < OTA_DIGEST_SIZE; i++)
+        snprintf(digest + 2 * i, 3, "%02x", sha[i]);
+    snprintf(size, sizeof(size), "%zu", image.size());
+    CHECK(request.release.set(url, "v1.0.0-0", announced ? size : nullptr,
+                              announced ? digest : nullptr, "lz4") == nullptr);
+
+    OtaSession session(request, "mem://fware/", nullptr, ctx);
+    while (!session.finished())
+        session.step();
+    CHECK(session.state() == OtaSession::DONE);
+    CHECK(sink.used == image.size() && memcmp(sink.image.data(), image.data(), image.size()) == 0);
+    CHECK(session.targetFile() != nullptr && strcmp(session.targetFile(), IMAGE_NAME) == 0);
+    return source.opened;
+}
+
+/// @brief messages of the release topic: the FWRA fields read from flat
+/// JSON, string or bare values, key names inside values and unknown keys
+/// skipped; malformed messages rejected with the reason set() gives.
+static void checkParse() {
+    char topic[40];
+    CHECK(otaReleaseTopic(topic, sizeof(topic), "P029"));
+    CHECK(strcmp(topic, "fware/P029/release") == 0);
+    CHECK(!otaReleaseTopic(topic, 12, "P029"));
+
+    const std::string sha(64, 'a');
+    std::string json = "{ \"cmd\" : \"FWRA\", \"version\":\"data\", "
+                       "\"data\":\"https://cdn/fware/P029_v1.4.0-2.bin.lz4\","
+                       "\"size\": 1210368, \"sha256\":\"" + sha +
+                       "\",\"codec\":\"LZ4\",\"stage\":true}";
+    OtaRelease release;
+    bool stage = false;
+    CHECK(release.parse(json.c_str(), json.size(), &stage) == nullptr);
+    CHECK(strcmp(release.url, "https://cdn/fware/P029_v1.4.0-2.bin.lz4") == 0);
+    CHECK(strcmp(release.version, "data") == 0 && release.imageSize == 1210368 && stage);
+    CHECK(release.sha256[0] == 0xaa && release.sha256[OTA_DIGEST_SIZE - 1] == 0xaa);
+    // bounded by len: the message need not be NUL-terminated
+    CHECK(release.parse(json.c_str(), json.find("\"size\""), &stage) == nullptr);
+    CHECK(release.imageSize == 0 && !stage);
+
+    json = "{\"data\":\"https://cdn/fware/P029_v1.4.0-2.bin.lz4\",\"stage\":\"0\"}";
+    CHECK(release.parse(json.c_str(), json.size(), &stage) == nullptr && !stage);
+    CHECK(release.parse("", 0, nullptr) != nullptr);   // the retained message deleted
+    json = "{\"data\":\"https://cdn/" + std::string(OTA_RELEASE_URL_LEN, 'x') + "\"}";
+    CHECK(release.parse(json.c_str(), json.size(), nullptr) != nullptr);
+    json = "{\"data\":\"https://cdn/P029_v1.4.0-2.bin.lz4\",\"size\":\"12\"}";
+    CHECK(release.parse(json.c_str(), json.size(), nullptr) != nullptr);
+    json = "{\"data\":\"https://cdn/P029_v1.4.0-2.bin.lz4\",\"codec\":\"zstd\"}";
+    CHECK(release.parse(json.c_str(), json.size(), nullptr) != nullptr);
+}
+
+int main() {
+    otaLogLevel = 'W';   // the session logs every stage of the six updates
+    std::vector<uint8_t> image = sampleImage(100000, 50), packed;
+    PackParams params;
+    CHECK(lz4PackImage(image.data(), image.size(), params, packed));
+    const std::string listing = "mem://fware/";
+    const std::string file = listing + IMAGE_NAME;
+
+    for (bool announced : {false, true}) {
+        // the release URL answers: no listing is read
+        std::string cdn = std::string("mem://cdn/") + IMAGE_NAME;
+        std::vector<std::string> opened = update(packed, image, cdn.c_str(), announced);
+        CHECK(opened == std::vector<std::string>({cdn}));
+
+        // 404 and a failed connection: the listing is scanned as without a release
+        for (const char *dir : {"mem://gone/", "mem://down/"}) {
+            std::string url = std::string(dir) + IMAGE_NAME;
+            opened = update(packed, image, url.c_str(), announced);
+            CHECK(opened == std::vector<std::string>({url, listing, file}));
+        }
+    }
+    checkParse();
+    return checkResult("test_release");
+}
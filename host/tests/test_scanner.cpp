@@ -0,0 +1,103 @@
+// #region StdManifest
+/**
+ * @file test_scanner.cpp
+ * @brief FirmwareScanner on a small listing: numeric version order, images
+ * without build number, partial and exact targets, targets without "v",
+ * decoys (.sha256, .elf, projects sharing the prefix, regex characters in
+ * the project name), fed whole and in chunks down to one byte.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-17
+ */
+// #endregion
+
+#include "check.h"
+#include "ED_OTA_core.h"
+#include <algorithm>
+#include <string.h>
+#include <string>
+
+using namespace ED_OTA;
+
+static const char *const files[] = {
+    "P029_v1.2.3-4.bin.lz4",
+    "P029_v1.2.3-12.bin.lz4",      // build 12 above 4
+    "P029_v1.2.10-1.bin",          // patch 10 above 3
+    "P029_v1.9.9-9.bin.lz4",
+    "P029_v1.10.0-2.bin.lz4",      // minor 10 above 9
+    "P029_v2.0.0.bin.lz4",         // no build number: build 0
+    "P029_v2.0.0-1.bin.lz4.sha256",
+    "P029_v3.0.0-1.elf",
+    "P029X_v9.9.9-9.bin.lz4",      // another project sharing the prefix
+    "P0.9_v1.0.0-1.bin.lz4",
+};
+
+/// @brief nginx autoindex listing of files.
+static std::string listing() {
+    std::string html = "<html>\r\n<head><title>Index of /fware/</title></head>\r\n<body>\r\n"
+                       "<h1>Index of /fware/</h1><hr><pre><a href=\"../\">../</a>\r\n"
+                       "<a href=\"obs/\">obs/</a>          14-Oct-2025 10:22       -\r\n";
+    for (const char *f : files)
+        html += std::string("<a href=\"") + f + "\">" + f + "</a>  14-Oct-2025 10:22  124617\r\n";
+    return html + "</pre><hr></body>\r\n</html>\r\n";
+}
+
+/// @brief the file the scanner picks from the listing fed in chunks of chunk
+/// bytes, "" when none.
+static std::string scan(const char *project, const char *version,
+                        FirmwareScanner::UpdateType mode, size_t chunk) {
+    std::string html = listing();
+    FirmwareScanner *scanner = new FirmwareScanner(project, version, mode);
+    for (size_t pos = 0; pos < html.size(); pos += chunk)
+        scanner->file_scanner_parse_chunk(html.c_str() + pos, std::min(chunk, html.size() - pos));
+    const char *file = scanner->targetFwFile();
+    std::string picked = file ? file : "";
+    delete scanner;
+    return picked;
+}
+
+/// @brief every chunking picks expected.
+static void expect(const char *project, const char *version, FirmwareScanner::UpdateType mode,
+                   const char *expected) {
+    static const size_t chunks[] = {COMPRESSED_BLOCK_SIZE - 1, 100, 64, 7, 1};
+    for (size_t chunk : chunks) {
+        std::string picked = scan(project, version, mode, chunk);
+        if (picked != expected)
+            fprintf(stderr, "%s %s chunk %zu: picked \"%s\", expected \"%s\"\n", project, version,
+                    chunk, picked.c_str(), expected);
+        CHECK(picked == expected);
+    }
+}
+
+int main() {
+    const FirmwareScanner::UpdateType latest = FirmwareScanner::UPDATE_TO_LATEST;
+    const FirmwareScanner::UpdateType specific = FirmwareScanner::UPDATE_TO_SPECIFIC;
+
+    CHECK(listing().size() < COMPRESSED_BLOCK_SIZE);   // the whole chunk holds it all
+
+    // latest: strictly above the running version, compared as numbers
+    expect("P029", "v0.0.0-0", latest, "P029_v2.0.0.bin.lz4");
+    expect("P029", "v1.10.0-1", latest, "P029_v2.0.0.bin.lz4");
+    expect("P029", "v2.0.0-0", latest, "");
+    expect("P029", "v2.0.0", latest, "");
+    expect("P029", "2.0.1-0", latest, "");
+
+    // specific: the given parts must match, the highest of the rest wins
+    expect("P029", "v1.2", specific, "P029_v1.2.10-1.bin");
+    expect("P029", "v1.2.3", specific, "P029_v1.2.3-12.bin.lz4");
+    expect("P029", "v1.2.3-4", specific, "P029_v1.2.3-4.bin.lz4");
+    expect("P029", "1.9", specific, "P029_v1.9.9-9.bin.lz4");
+    expect("P029", "v1", specific, "P029_v1.10.0-2.bin.lz4");
+    expect("P029", "v2.0.0-0", specific, "P029_v2.0.0.bin.lz4");
+    expect("P029", "v3", specific, "");
+    expect("P029", "v9", specific, "");
+
+    // the project name is matched literally
+    expect("P0.9", "v0.0.0-0", latest, "P0.9_v1.0.0-1.bin.lz4");
+    expect("P0.", "v0.0.0-0", latest, "");
+    expect("P029X", "v9.9.9-8", latest, "P029X_v9.9.9-9.bin.lz4");
+    expect("P02", "v0.0.0-0", latest, "");
+
+    return checkResult("test_scanner");
+}
@@ -57,6 +57,13 @@
  */
 #define LZ4_ACCELERATION_MAX 65537
 
+/*
+ * LZ4_DECOMPRESS_ONLY :
+ * Build the safe decoder only (`LZ4_decompress_safe*()` and the streaming
+ * decode state). Compression, dictionary loading, the deprecated
+ * `LZ4_decompress_fast*()` entry points and the obsolete wrappers are left out.
+ */
+
 
 /*-************************************
 *  CPU Feature Detection
@@ -247,7 +254,9 @@ void  LZ4_free(void* p);
 #define MFLIMIT       12   /* see ../doc/lz4_Block_format.md#parsing-restrictions */
 #define MATCH_SAFEGUARD_DISTANCE  ((2*WILDCOPYLENGTH) - MINMATCH)   /* ensure it's possible to write 2 x wildcopyLength without overflowing output buffer */
 #define FASTLOOP_SAFE_DISTANCE 64
+#ifndef LZ4_DECOMPRESS_ONLY
 static const int LZ4_minLength = (MFLIMIT+1);
+#endif
 
 #define KB *(1 <<10)
 #define MB *(1 <<20)
@@ -290,10 +299,12 @@ static const int LZ4_minLength = (MFLIMIT+1);
 #  define DEBUGLOG(l, ...) {}    /* disabled */
 #endif
 
+#ifndef LZ4_DECOMPRESS_ONLY
 static int LZ4_isAligned(const void* ptr, size_t alignment)
 {
     return ((size_t)ptr & (alignment -1)) == 0;
 }
+#endif
 
 
 /*-************************************
@@ -380,7 +391,9 @@ static U16 LZ4_read16(const void* memPtr) { return *(const U16*) memPtr; }
 static U32 LZ4_read32(const void* memPtr) { return *(const U32*) memPtr; }
 static reg_t LZ4_read_ARCH(const void* memPtr) { return *(const reg_t*) memPtr; }
 
+#ifndef LZ4_DECOMPRESS_ONLY
 static void LZ4_write16(void* memPtr, U16 value) { *(U16*)memPtr = value; }
+#endif
 static void LZ4_write32(void* memPtr, U32 value) { *(U32*)memPtr = value; }
 
 #elif defined(LZ4_FORCE_MEMORY_ACCESS) && (LZ4_FORCE_MEMORY_ACCESS==1)
@@ -395,7 +408,9 @@ static U16 LZ4_read16(const void* ptr) { return ((const LZ4_unalign16*)ptr)->u16
 static U32 LZ4_read32(const void* ptr) { return ((const LZ4_unalign32*)ptr)->u32; }
 static reg_t LZ4_read_ARCH(const void* ptr) { return ((const LZ4_unalignST*)ptr)->uArch; }
 
+#ifndef LZ4_DECOMPRESS_ONLY
 static void LZ4_write16(void* memPtr, U16 value) { ((LZ4_unalign16*)memPtr)->u16 = value; }
+#endif
 static void LZ4_write32(void* memPtr, U32 value) { ((LZ4_unalign32*)memPtr)->u32 = value; }
 
 #else  /* safe and portable access using memcpy() */
@@ -415,10 +430,12 @@ static reg_t LZ4_read_ARCH(const void* memPtr)
     reg_t val; LZ4_memcpy(&val, memPtr, sizeof(val)); return val;
 }
 
+#ifndef LZ4_DECOMPRESS_ONLY
 static void LZ4_write16(void* memPtr, U16 value)
 {
     LZ4_memcpy(memPtr, &value, sizeof(value));
 }
+#endif
 
 static void LZ4_write32(void* memPtr, U32 value)
 {
@@ -450,6 +467,7 @@ static U32 LZ4_readLE32(const void* memPtr)
 }
 #endif
 
+#ifndef LZ4_DECOMPRESS_ONLY
 static void LZ4_writeLE16(void* memPtr, U16 value)
 {
     if (LZ4_isLittleEndian()) {
@@ -460,6 +478,7 @@ static void LZ4_writeLE16(void* memPtr, U16 value)
         p[1] = (BYTE)(value>>8);
     }
 }
+#endif
 
 /* customized variant of memcpy, which can overwrite up to 8 bytes beyond dstEnd */
 LZ4_FORCE_INLINE
@@ -703,8 +722,10 @@ unsigned LZ4_count(const BYTE* pIn, const BYTE* pMatch, const BYTE* pInLimit)
 /*-************************************
 *  Local Constants
 **************************************/
+#ifndef LZ4_DECOMPRESS_ONLY
 static const int LZ4_64Klimit = ((64 KB) + (MFLIMIT-1));
 static const U32 LZ4_skipTrigger = 6;  /* Increase this value ==> compression run slower on incompressible data */
+#endif
 
 
 /*-************************************
@@ -744,8 +765,10 @@ typedef enum { noDictIssue = 0, dictSmall } dictIssue_directive;
 **************************************/
 int LZ4_versionNumber (void) { return LZ4_VERSION_NUMBER; }
 const char* LZ4_versionString(void) { return LZ4_VERSION_STRING; }
+#ifndef LZ4_DECOMPRESS_ONLY
 int LZ4_compressBound(int isize)  { return LZ4_COMPRESSBOUND(isize); }
 int LZ4_sizeofState(void) { return sizeof(LZ4_stream_t); }
+#endif /* LZ4_DECOMPRESS_ONLY */
 
 
 /*-****************************************
@@ -767,6 +790,8 @@ int LZ4_decompress_safe_partial_forceExtDict(const char* source, char* dest,
 }
 #endif
 
+#ifndef LZ4_DECOMPRESS_ONLY
+
 /*-******************************
 *  Compression functions
 ********************************/
@@ -1829,6 +1854,7 @@ int LZ4_saveDict (LZ4_stream_t* LZ4_dict, char* safeBuffer, int dictSize)
     return dictSize;
 }
 
+#endif /* LZ4_DECOMPRESS_ONLY */
 
 
 /*-*******************************
@@ -1841,6 +1867,7 @@ typedef enum { decode_full_block = 0, partial_decode = 1 } earlyEnd_directive;
 #define MIN(a,b)    ( (a) < (b) ? (a) : (b) )
 
 
+#ifndef LZ4_DECOMPRESS_ONLY
 /* variant for decompress_unsafe()
  * does not know end of input
  * presumes input is well formed
@@ -1960,6 +1987,7 @@ LZ4_decompress_unsafe_generic(
     } /* main loop */
     return (int)(ip - istart);
 }
+#endif /* LZ4_DECOMPRESS_ONLY */
 
 
 /* Read the variable-length literal or match length.
@@ -2460,6 +2488,7 @@ int LZ4_decompress_safe_partial(const char* src, char* dst, int compressedSize,
                                   noDict, (BYTE*)dst, NULL, 0);
 }
 
+#ifndef LZ4_DECOMPRESS_ONLY
 LZ4_FORCE_O2
 int LZ4_decompress_fast(const char* source, char* dest, int originalSize)
 {
@@ -2468,6 +2497,7 @@ int LZ4_decompress_fast(const char* source, char* dest, int originalSize)
                 (const BYTE*)source, (BYTE*)dest, originalSize,
                 0, NULL, 0);
 }
+#endif /* LZ4_DECOMPRESS_ONLY */
 
 /*===== Instantiate a few more decoding cases, used more than once. =====*/
 
@@ -2488,6 +2518,7 @@ static int LZ4_decompress_safe_partial_withPrefix64k(const char* source, char* d
                                   (BYTE*)dest - 64 KB, NULL, 0);
 }
 
+#ifndef LZ4_DECOMPRESS_ONLY
 /* Another obsolete API function, paired with the previous one. */
 int LZ4_decompress_fast_withPrefix64k(const char* source, char* dest, int originalSize)
 {
@@ -2495,6 +2526,7 @@ int LZ4_decompress_fast_withPrefix64k(const char* source, char* dest, int origin
                 (const BYTE*)source, (BYTE*)dest, originalSize,
                 64 KB, NULL, 0);
 }
+#endif /* LZ4_DECOMPRESS_ONLY */
 
 LZ4_FORCE_O2
 static int LZ4_decompress_safe_withSmallPrefix(const char* source, char* dest, int compressedSize, int maxOutputSize,
@@ -2537,6 +2569,7 @@ int LZ4_decompress_safe_partial_forceExtDict(const char* source, char* dest,
                                   (BYTE*)dest, (const BYTE*)dictStart, dictSize);
 }
 
+#ifndef LZ4_DECOMPRESS_ONLY
 LZ4_FORCE_O2
 static int LZ4_decompress_fast_extDict(const char* source, char* dest, int originalSize,
                                        const void* dictStart, size_t dictSize)
@@ -2545,6 +2578,7 @@ static int LZ4_decompress_fast_extDict(const char* source, char* dest, int origi
                 (const BYTE*)source, (BYTE*)dest, originalSize,
                 0, (const BYTE*)dictStart, dictSize);
 }
+#endif /* LZ4_DECOMPRESS_ONLY */
 
 /* The "double dictionary" mode, for use with e.g. ring buffers: the first part
  * of the dictionary is passed as prefix, and the second via dictStart + dictSize.
@@ -2663,6 +2697,7 @@ int LZ4_decompress_safe_continue (LZ4_streamDecode_t* LZ4_streamDecode, const ch
     return result;
 }
 
+#ifndef LZ4_DECOMPRESS_ONLY
 LZ4_FORCE_O2 int
 LZ4_decompress_fast_continue (LZ4_streamDecode_t* LZ4_streamDecode,
                         const char* source, char* dest, int originalSize)
@@ -2703,6 +2738,7 @@ LZ4_decompress_fast_continue (LZ4_streamDecode_t* LZ4_streamDecode,
 
     return result;
 }
+#endif /* LZ4_DECOMPRESS_ONLY */
 
 
 /*
@@ -2742,6 +2778,7 @@ int LZ4_decompress_safe_partial_usingDict(const char* source, char* dest, int co
     return LZ4_decompress_safe_partial_forceExtDict(source, dest, compressedSize, targetOutputSize, dstCapacity, dictStart, (size_t)dictSize);
 }
 
+#ifndef LZ4_DECOMPRESS_ONLY
 int LZ4_decompress_fast_usingDict(const char* source, char* dest, int originalSize, const char* dictStart, int dictSize)
 {
     if (dictSize==0 || dictStart+dictSize == dest)
@@ -2751,8 +2788,10 @@ int LZ4_decompress_fast_usingDict(const char* source, char* dest, int originalSi
     assert(dictSize >= 0);
     return LZ4_decompress_fast_extDict(source, dest, originalSize, dictStart, (size_t)dictSize);
 }
+#endif /* LZ4_DECOMPRESS_ONLY */
 
 
+#ifndef LZ4_DECOMPRESS_ONLY
 /*=*************************************************
 *  Obsolete Functions
 ***************************************************/
@@ -2821,5 +2860,6 @@ char* LZ4_slideInputBuffer (void* state)
     /* avoid const char * -> char * conversion warning */
     return (char *)(uptrval)((LZ4_stream_t*)state)->internal_donotuse.dictionary;
 }
+#endif /* LZ4_DECOMPRESS_ONLY */
 
 #endif   /* LZ4_COMMONDEFS_ONLY */
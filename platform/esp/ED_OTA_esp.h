@@ -0,0 +1,145 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_esp.h
+ * @brief ESP-IDF HTTP source (esp_http_client) and OTA partition sink
+ * (esp_ota_ops) for the OTA engine.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-14
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_core.h"
+#include "ED_OTA_health.h"
+#include "ED_OTA_platform.h"
+#include "ED_OTA_trace.h"
+#include <esp_http_client.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <string>
+
+#define OTA_TRACE_PARTITION "otatrace" // data partition for transfer traces
+#define OTA_HTTP_STALL_MS 15000        // reads without data for this long fail the transfer
+#define OTA_BENCH_FLASH_BYTES (64 * 1024) // scratch region of the flash benchmark
+
+namespace ED_OTA {
+
+/// @brief HTTPS GET through esp_http_client, certificates from the bundle.
+class EspHttpSource : public HttpSource {
+public:
+  ~EspHttpSource() { close(); }
+
+  /// @brief once the headers are in, reads wait at most timeoutMs for data
+  /// and return OTA_READ_AGAIN meanwhile; 0 keeps the client default. The
+  /// connection and the TLS handshake keep the default timeout.
+  void setReadTimeoutMs(int timeoutMs) { readTimeoutMs = timeoutMs; }
+
+  bool open(const char *url) override;
+  int status() override;
+  int64_t contentLength() override { return length; }
+  int read(char *buf, size_t len) override;
+  void close() override;
+
+private:
+  esp_http_client_handle_t client = nullptr;
+  int64_t length = -1;
+  int readTimeoutMs = 0;
+  int64_t stallSinceUs = 0;   // first OTA_READ_AGAIN of the current wait, 0 = none
+};
+
+/// @brief writes the image to the next OTA partition and switches the boot
+/// partition to it when finished, unless staging.
+class EspOtaSink : public OtaSink {
+public:
+  ~EspOtaSink() { abort(); }
+
+  bool begin(bool sequentialErase) override;
+  bool write(const uint8_t *data, size_t len) override;
+  bool finish() override;
+  void abort() override;
+  /// @brief compares digest with the first imageSize bytes of the running
+  /// and of the next OTA partition; the digests are cached until the next
+  /// partition is written.
+  Held holds(const uint8_t *digest, size_t imageSize) override;
+  bool activate() override;
+
+  const esp_partition_t *partition() const { return updatePartition; }
+  /// @brief finish() and activate() leave the boot partition alone: the
+  /// image stays staged in partition().
+  void setStageOnly(bool stage) { stageOnly = stage; }
+
+private:
+  const esp_partition_t *updatePartition = nullptr;
+  bool stageOnly = false;
+  esp_ota_handle_t otaHandle = 0;
+  bool begun = false;
+};
+
+/// @brief stores a transfer trace in the OTA_TRACE_PARTITION data partition,
+/// where it survives the post-update reboot. The partition is erased in
+/// begin(), before the first timed call; the header length is programmed over
+/// its erased value in end().
+class EspPartitionTraceOutput : public TraceOutput {
+public:
+  bool begin() override;
+  bool write(const uint8_t *data, size_t len) override;
+  void end(uint32_t recordBytes) override;
+
+  /// @brief the trace partition, nullptr when the partition table has none.
+  static const esp_partition_t *partition();
+
+private:
+  const esp_partition_t *part = nullptr;
+  size_t offset = 0;
+};
+
+/// @brief pre-flight check against this chip, the running app and the slot
+/// an update writes to.
+OtaAppCheck espAppCheck();
+
+/// @brief the image kept in the inactive OTA slot, target of a rollback.
+struct RollbackImage {
+  const esp_partition_t *partition;  // nullptr when there is no other slot
+  OtaAppInfo app;                    // chip, project and version of the image
+  uint32_t imageSize;                // verified length of the image
+  uint32_t checkMs;                  // time of the image check, 0 when cached
+  const char *error;                 // why it cannot be booted
+};
+
+/// @brief checks the image in the inactive OTA slot against this chip and
+/// the running app (as espAppCheck(), the slot size aside) and verifies its
+/// checksum and appended SHA-256. A verified slot is remembered until it is
+/// written again. Refused with more than two OTA slots, where the inactive
+/// slot need not be the one that ran before.
+bool espRollbackImage(RollbackImage &out);
+
+/// @brief makes the checked image the boot partition; it runs after the
+/// next reboot.
+bool espRollback(const RollbackImage &image);
+
+/// @brief health probe passing once the station is associated with an AP.
+OtaHealth::Result espWifiProbe(void *arg);
+
+/// @brief erase and program speed of the inactive OTA slot.
+struct FlashBench {
+  const char *partition;   // label of the slot, nullptr when not measured
+  uint32_t offset;         // scratch region: the last OTA_BENCH_FLASH_BYTES
+  uint32_t bytes;
+  uint32_t sectorEraseUs;  // mean of one 4 KB sector erase
+  uint32_t blockEraseUs;   // one 64 KB block erase
+  uint32_t programBps;     // 4 KB writes to erased flash
+  uint32_t readBps;
+  uint32_t writeBps;       // sector erase and program, as sequential-erase OTA writes
+  const char *error;       // why it was not measured
+};
+
+/// @brief times erase, program and read on the tail of the inactive OTA
+/// slot, which is left erased. Refuses when the image kept in the slot (the
+/// rollback image) reaches into that region.
+bool benchFlash(FlashBench &out);
+std::string benchJson(const FlashBench &f);
+
+} // namespace ED_OTA
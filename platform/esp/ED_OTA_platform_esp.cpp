@@ -0,0 +1,450 @@
+#include "ED_OTA_esp.h"
+#include "esp_crt_bundle.h"
+#include <esp_app_desc.h>
+#include <esp_image_format.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <hal/efuse_hal.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace ED_OTA {
+
+static const char *TAG = "ED_OTA";
+
+int64_t otaNowUs() { return esp_timer_get_time(); }
+
+void otaSleepUs(uint32_t us) {
+    TickType_t ticks = pdMS_TO_TICKS((us + 999) / 1000);
+    vTaskDelay(ticks ? ticks : 1);
+}
+
+/// @brief needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS with the esp_timer
+/// clock, whose run time counter ticks in microseconds.
+bool otaIdleUs(uint32_t &idleUs) {
+#if configGENERATE_RUN_TIME_STATS
+    idleUs = ulTaskGetIdleRunTimeCounter();
+    return true;
+#else
+    (void)idleUs;
+    return false;
+#endif
+}
+
+// ---------- EspHttpSource ----------
+
+bool EspHttpSource::open(const char *url) {
+    close();
+    esp_http_client_config_t config = {
+        .url = url,
+        .transport_type = HTTP_TRANSPORT_OVER_SSL,
+        .crt_bundle_attach = esp_crt_bundle_attach,
+    };
+    client = esp_http_client_init(&config);
+    if (client == nullptr) {
+        ESP_LOGE(TAG, "failed to init client for %s", url);
+        return false;
+    }
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "failed to open client to %s error: %s", url, esp_err_to_name(err));
+        close();
+        return false;
+    }
+    int fetched = esp_http_client_fetch_headers(client);
+    if (fetched < 0) {
+        ESP_LOGE(TAG, "Failed to fetch headers, error: %d", fetched);
+        close();
+        return false;
+    }
+    length = esp_http_client_get_content_length(client);
+    if (readTimeoutMs)
+        esp_http_client_set_timeout_ms(client, readTimeoutMs);
+    return true;
+}
+
+int EspHttpSource::status() {
+    return client ? esp_http_client_get_status_code(client) : 0;
+}
+
+int EspHttpSource::read(char *buf, size_t len) {
+    int n = esp_http_client_read(client, buf, (int)len);
+    if (n != -ESP_ERR_HTTP_EAGAIN) {
+        stallSinceUs = 0;
+        return n;
+    }
+    int64_t now = esp_timer_get_time();
+    if (stallSinceUs == 0)
+        stallSinceUs = now;
+    if (now - stallSinceUs < OTA_HTTP_STALL_MS * 1000LL)
+        return OTA_READ_AGAIN;
+    ESP_LOGE(TAG, "no data for %d ms", OTA_HTTP_STALL_MS);
+    return -1;
+}
+
+void EspHttpSource::close() {
+    if (client)
+        esp_http_client_cleanup(client);
+    client = nullptr;
+    length = -1;
+    stallSinceUs = 0;
+}
+
+// ---------- EspOtaSink ----------
+
+/// @brief SHA-256 of the first len bytes of a partition, one entry per OTA
+/// slot: hashing a slot reads it whole, so it is done once per boot and
+/// image size, and again only after the slot has been written.
+struct SlotDigest {
+    uint32_t address;
+    size_t len;
+    uint8_t sha256[OTA_DIGEST_SIZE];
+};
+static SlotDigest slot_digests[2];
+static OtaMutex slot_digests_mutex;
+// the inactive slot passed esp_image_verify with this length (0: not known)
+static uint32_t verified_slot_address;
+static uint32_t verified_slot_len;
+
+static void forgetSlotDigest(const esp_partition_t *part) {
+    OtaLock lock(slot_digests_mutex);
+    for (SlotDigest &d : slot_digests)
+        if (d.len && d.address == part->address)
+            d.len = 0;
+    if (verified_slot_address == part->address)
+        verified_slot_len = 0;
+}
+
+static bool slotDigest(const esp_partition_t *part, size_t len, uint8_t *out) {
+    if (part == nullptr || len == 0 || len > part->size)
+        return false;
+    OtaLock lock(slot_digests_mutex);
+    SlotDigest *slot = &slot_digests[0];
+    for (SlotDigest &d : slot_digests) {
+        if (d.len == len && d.address == part->address) {
+            memcpy(out, d.sha256, OTA_DIGEST_SIZE);
+            return true;
+        }
+        if (d.address == part->address || d.len == 0)
+            slot = &d;
+    }
+    uint8_t *buf = (uint8_t *)malloc(4096);
+    if (buf == nullptr)
+        return false;
+    OtaSha256 sha;
+    bool ok = true;
+    int64_t t0 = esp_timer_get_time();
+    for (size_t off = 0; ok && off < len; off += 4096) {
+        size_t n = len - off < 4096 ? len - off : 4096;
+        ok = esp_partition_read(part, off, buf, n) == ESP_OK;
+        if (ok)
+            sha.update(buf, n);
+    }
+    free(buf);
+    if (!ok)
+        return false;
+    sha.finish(slot->sha256);
+    slot->address = part->address;
+    slot->len = len;
+    memcpy(out, slot->sha256, OTA_DIGEST_SIZE);
+    ESP_LOGI(TAG, "digest of '%s' (%u bytes) in %lld ms", part->label, (unsigned)len,
+             (long long)((esp_timer_get_time() - t0) / 1000));
+    return true;
+}
+
+OtaSink::Held EspOtaSink::holds(const uint8_t *digest, size_t imageSize) {
+    uint8_t sha[OTA_DIGEST_SIZE];
+    if (slotDigest(esp_ota_get_running_partition(), imageSize, sha) &&
+        memcmp(sha, digest, OTA_DIGEST_SIZE) == 0)
+        return HELD_RUNNING;
+    updatePartition = esp_ota_get_next_update_partition(NULL);
+    // an image the bootloader or a health check rolled back from is written again
+    esp_ota_img_states_t state;
+    if (updatePartition && esp_ota_get_state_partition(updatePartition, &state) == ESP_OK &&
+        (state == ESP_OTA_IMG_INVALID || state == ESP_OTA_IMG_ABORTED))
+        return HELD_NONE;
+    if (slotDigest(updatePartition, imageSize, sha) && memcmp(sha, digest, OTA_DIGEST_SIZE) == 0)
+        return HELD_STAGED;
+    return HELD_NONE;
+}
+
+bool EspOtaSink::activate() {
+    if (stageOnly) {
+        ESP_LOGI(TAG, "image already staged in %s", updatePartition->label);
+        return true;
+    }
+    // esp_ota_set_boot_partition verifies the image before switching
+    esp_err_t err = esp_ota_set_boot_partition(updatePartition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGI(TAG, "boot partition switched to %s", updatePartition->label);
+    return true;
+}
+
+bool EspOtaSink::begin(bool sequentialErase) {
+    updatePartition = esp_ota_get_next_update_partition(NULL);
+    if (updatePartition)
+        forgetSlotDigest(updatePartition);
+    size_t imageSize = OTA_SIZE_UNKNOWN;   // erases the whole partition up front
+#ifdef OTA_WITH_SEQUENTIAL_WRITES
+    if (sequentialErase)
+        imageSize = OTA_WITH_SEQUENTIAL_WRITES;   // erase sector by sector while writing
+#endif
+    esp_err_t err = esp_ota_begin(updatePartition, imageSize, &otaHandle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to begin OTA: %s", esp_err_to_name(err));
+        return false;
+    }
+    begun = true;
+    return true;
+}
+
+bool EspOtaSink::write(const uint8_t *data, size_t len) {
+    esp_err_t err = esp_ota_write(otaHandle, data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write OTA chunk: %s", esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+bool EspOtaSink::finish() {
+    begun = false;   // esp_ota_end releases the handle on any outcome
+    esp_err_t err = esp_ota_end(otaHandle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to complete OTA: %s", esp_err_to_name(err));
+        return false;
+    }
+    if (stageOnly) {   // esp_ota_end has verified the image
+        ESP_LOGI(TAG, "image staged in %s", updatePartition->label);
+        return true;
+    }
+    err = esp_ota_set_boot_partition(updatePartition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGI(TAG, "boot partition switched to %s", updatePartition->label);
+    return true;
+}
+
+void EspOtaSink::abort() {
+    if (begun)
+        esp_ota_abort(otaHandle);
+    begun = false;
+}
+
+OtaAppCheck espAppCheck() {
+    const esp_app_desc_t *app = esp_app_get_description();
+    const esp_partition_t *slot = esp_ota_get_next_update_partition(NULL);
+    OtaAppCheck check = {CONFIG_IDF_FIRMWARE_CHIP_ID, (int)efuse_hal_chip_revision(),
+                         slot ? (uint32_t)slot->size : 0, app->project_name, app->version};
+    return check;
+}
+
+// ---------- rollback ----------
+
+bool espRollbackImage(RollbackImage &out) {
+    out = {};
+    // with two slots the next update slot is the previous one; with more,
+    // otadata does not record which slot ran before
+    if (esp_ota_get_app_partition_count() > 2) {
+        out.error = "more than two OTA slots, the previous one is not known";
+        return false;
+    }
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+    if (part == nullptr || part == esp_ota_get_running_partition()) {
+        out.error = "no other OTA slot";
+        return false;
+    }
+    out.partition = part;
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(part, &state) == ESP_OK &&
+        (state == ESP_OTA_IMG_INVALID || state == ESP_OTA_IMG_ABORTED)) {
+        out.error = "image marked invalid by an earlier rollback";
+        return false;
+    }
+    uint8_t head[OTA_APP_HEADER_BYTES];
+    if (esp_partition_read(part, 0, head, sizeof(head)) != ESP_OK ||
+        !out.app.parse(head, sizeof(head))) {
+        out.error = "no application image in the slot";
+        return false;
+    }
+    OtaAppCheck check = espAppCheck();
+    check.slotSize = 0;
+    if ((out.error = check.reject(out.app)) != nullptr)
+        return false;
+
+    OtaLock lock(slot_digests_mutex);
+    if (verified_slot_len && verified_slot_address == part->address) {
+        out.imageSize = verified_slot_len;
+        return true;
+    }
+    int64_t t0 = esp_timer_get_time();
+    esp_image_metadata_t image = {};
+    const esp_partition_pos_t pos = {part->address, part->size};
+    if (esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &pos, &image) != ESP_OK) {
+        out.error = "image checksum or digest mismatch";
+        return false;
+    }
+    out.checkMs = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    out.imageSize = image.image_len;
+    verified_slot_address = part->address;
+    verified_slot_len = image.image_len;
+    return true;
+}
+
+bool espRollback(const RollbackImage &image) {
+    // esp_ota_set_boot_partition verifies the image once more before switching
+    esp_err_t err = esp_ota_set_boot_partition(image.partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        return false;
+    }
+    ESP_LOGI(TAG, "boot partition switched back to %s (%s %s)", image.partition->label,
+             image.app.project, image.app.version);
+    return true;
+}
+
+OtaHealth::Result espWifiProbe(void *arg) {
+    (void)arg;
+    wifi_ap_record_t ap;
+    return esp_wifi_sta_get_ap_info(&ap) == ESP_OK ? OtaHealth::PASS : OtaHealth::PENDING;
+}
+
+// ---------- EspPartitionTraceOutput ----------
+
+const esp_partition_t *EspPartitionTraceOutput::partition() {
+    return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                    OTA_TRACE_PARTITION);
+}
+
+bool EspPartitionTraceOutput::begin() {
+    part = partition();
+    offset = 0;
+    if (part == nullptr) {
+        ESP_LOGW(TAG, "no '%s' partition for the transfer trace", OTA_TRACE_PARTITION);
+        return false;
+    }
+    esp_err_t err = esp_partition_erase_range(part, 0, part->size);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to erase trace partition: %s", esp_err_to_name(err));
+        part = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool EspPartitionTraceOutput::write(const uint8_t *data, size_t len) {
+    if (part == nullptr || offset + len > part->size)
+        return false;
+    if (esp_partition_write(part, offset, data, len) != ESP_OK)
+        return false;
+    offset += len;
+    return true;
+}
+
+void EspPartitionTraceOutput::end(uint32_t recordBytes) {
+    if (part == nullptr)
+        return;
+    // erased flash reads 0xFF: programming the length only clears bits
+    esp_partition_write(part, OTA_TRACE_LENGTH_OFFSET, &recordBytes, sizeof(recordBytes));
+    ESP_LOGI(TAG, "transfer trace: %u bytes in '%s'", (unsigned)recordBytes, part->label);
+    part = nullptr;
+}
+
+// ---------- flash benchmark ----------
+
+bool benchFlash(FlashBench &out) {
+    out = {};
+    const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+    if (part == nullptr || part->size < 2 * OTA_BENCH_FLASH_BYTES) {
+        out.error = "no inactive OTA slot";
+        return false;
+    }
+    out.partition = part->label;
+    out.offset = part->size - OTA_BENCH_FLASH_BYTES;
+    out.bytes = OTA_BENCH_FLASH_BYTES;
+
+    // the slot keeps the previous firmware for rollback: only its unused tail is scratch
+    esp_image_metadata_t image = {};
+    const esp_partition_pos_t pos = {part->address, part->size};
+    if (esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &pos, &image) == ESP_OK &&
+        image.image_len > out.offset) {
+        out.error = "slot image reaches the scratch region";
+        return false;
+    }
+
+    const size_t sector = 4096;   // SPI_FLASH_SEC_SIZE
+    uint8_t *buf = (uint8_t *)malloc(sector);
+    if (buf == nullptr) {
+        out.error = "out of memory";
+        return false;
+    }
+    out.error = "flash operation failed";
+    forgetSlotDigest(part);   // a digest cached over the scratch region no longer holds
+    int64_t t0 = esp_timer_get_time();
+    bool ok = esp_partition_erase_range(part, out.offset, out.bytes) == ESP_OK;
+    out.blockEraseUs = (uint32_t)(esp_timer_get_time() - t0);
+
+    int64_t programUs = 0;
+    for (uint32_t off = 0; ok && off < out.bytes; off += sector) {
+        for (size_t i = 0; i < sector; i++)
+            buf[i] = (uint8_t)(off / sector * 31 + i);
+        t0 = esp_timer_get_time();
+        ok = esp_partition_write(part, out.offset + off, buf, sector) == ESP_OK;
+        programUs += esp_timer_get_time() - t0;
+    }
+    int64_t readUs = 0;
+    for (uint32_t off = 0; ok && off < out.bytes; off += sector) {
+        t0 = esp_timer_get_time();
+        ok = esp_partition_read(part, out.offset + off, buf, sector) == ESP_OK;
+        readUs += esp_timer_get_time() - t0;
+        for (size_t i = 0; ok && i < sector; i++)
+            ok = buf[i] == (uint8_t)(off / sector * 31 + i);
+        if (!ok)
+            out.error = "read-back mismatch";
+    }
+    // sector by sector, as esp_ota_write erases with OTA_WITH_SEQUENTIAL_WRITES
+    int64_t sectorUs = 0;
+    for (uint32_t off = 0; ok && off < out.bytes; off += sector) {
+        t0 = esp_timer_get_time();
+        ok = esp_partition_erase_range(part, out.offset + off, sector) == ESP_OK;
+        sectorUs += esp_timer_get_time() - t0;
+    }
+    free(buf);
+    if (!ok) {
+        ESP_LOGE(TAG, "flash benchmark on '%s': %s", part->label, out.error);
+        return false;
+    }
+    out.error = nullptr;
+    out.sectorEraseUs = (uint32_t)(sectorUs / (out.bytes / sector));
+    out.programBps = programUs > 0 ? (uint32_t)(out.bytes * 1000000ll / programUs) : 0;
+    out.readBps = readUs > 0 ? (uint32_t)(out.bytes * 1000000ll / readUs) : 0;
+    out.writeBps = programUs + sectorUs > 0
+                       ? (uint32_t)(out.bytes * 1000000ll / (programUs + sectorUs))
+                       : 0;
+    return true;
+}
+
+std::string benchJson(const FlashBench &f) {
+    char buf[256];
+    if (f.error)
+        snprintf(buf, sizeof(buf), "{\"partition\": \"%s\", \"error\": \"%s\"}",
+                 f.partition ? f.partition : "", f.error);
+    else
+        snprintf(buf, sizeof(buf),
+                 "{\"partition\": \"%s\", \"offset\": %u, \"bytes\": %u, "
+                 "\"sectorEraseUs\": %u, \"blockEraseUs\": %u, \"programBps\": %u, "
+                 "\"readBps\": %u, \"writeBps\": %u}",
+                 f.partition, (unsigned)f.offset, (unsigned)f.bytes, (unsigned)f.sectorEraseUs,
+                 (unsigned)f.blockEraseUs, (unsigned)f.programBps, (unsigned)f.readBps,
+                 (unsigned)f.writeBps);
+    return buf;
+}
+
+} // namespace ED_OTA
@@ -0,0 +1,59 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_port.h
+ * @brief ESP-IDF port of the OTA engine: logging, locking and hashing
+ * primitives.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-14
+ */
+// #endregion
+
+#pragma once
+
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <mbedtls/sha256.h>
+
+#define OTA_LOGE(tag, ...) ESP_LOGE(tag, __VA_ARGS__)
+#define OTA_LOGW(tag, ...) ESP_LOGW(tag, __VA_ARGS__)
+#define OTA_LOGI(tag, ...) ESP_LOGI(tag, __VA_ARGS__)
+#define OTA_LOGD(tag, ...) ESP_LOGD(tag, __VA_ARGS__)
+#define OTA_LOGV(tag, ...) ESP_LOGV(tag, __VA_ARGS__)
+
+namespace ED_OTA {
+
+/// @brief FreeRTOS mutex in static storage, usable from static constructors.
+class OtaMutex {
+public:
+  OtaMutex() { handle = xSemaphoreCreateMutexStatic(&storage); }
+  void lock() { xSemaphoreTake(handle, portMAX_DELAY); }
+  void unlock() { xSemaphoreGive(handle); }
+
+private:
+  StaticSemaphore_t storage;
+  SemaphoreHandle_t handle;
+  OtaMutex(const OtaMutex &) = delete;
+  OtaMutex &operator=(const OtaMutex &) = delete;
+};
+
+/// @brief SHA-256 on mbedtls (hardware accelerated where the chip has it).
+class OtaSha256 {
+public:
+  OtaSha256() {
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts(&ctx, 0);
+  }
+  ~OtaSha256() { mbedtls_sha256_free(&ctx); }
+  void update(const uint8_t *data, size_t len) { mbedtls_sha256_update(&ctx, data, len); }
+  void finish(uint8_t digest[32]) { mbedtls_sha256_finish(&ctx, digest); }
+
+private:
+  mbedtls_sha256_context ctx;
+  OtaSha256(const OtaSha256 &) = delete;
+  OtaSha256 &operator=(const OtaSha256 &) = delete;
+};
+
+} // namespace ED_OTA
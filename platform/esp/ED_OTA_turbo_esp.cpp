@@ -0,0 +1,93 @@
+#include "ED_OTA_turbo.h"
+#include "ED_OTA_session.h"
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_rom_sys.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace ED_OTA {
+
+static const char *TAG = "ED_OTA";
+
+uint32_t OtaTurbo::cpuMhz() { return esp_rom_get_cpu_ticks_per_us(); }
+
+void OtaTurbo::apply(const TurboProfile &profile, OtaMetrics &metrics) {
+    if (applied)
+        return;
+    applied = true;
+    esp_err_t err;
+
+    // PM locks are only available with CONFIG_PM_ENABLE: without it the
+    // clocks are already fixed and there is nothing to hold.
+    esp_pm_lock_handle_t lock;
+    if (profile.cpuFreqMax) {
+        err = esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "ota_cpu", &lock);
+        if (err == ESP_OK) {
+            esp_pm_lock_acquire(lock);
+            cpuLock = lock;
+        } else {
+            ESP_LOGD(TAG, "turbo: CPU lock unavailable: %s", esp_err_to_name(err));
+        }
+    }
+    if (profile.apbFreqMax) {
+        err = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "ota_apb", &lock);
+        if (err == ESP_OK) {
+            esp_pm_lock_acquire(lock);
+            apbLock = lock;
+        } else {
+            ESP_LOGD(TAG, "turbo: APB lock unavailable: %s", esp_err_to_name(err));
+        }
+    }
+
+    wifi_ps_type_t ps;
+    if (profile.wifiNoPs && esp_wifi_get_ps(&ps) == ESP_OK) {
+        savedPs = ps;
+        metrics.wifiPsBefore = (int8_t)ps;
+        if (ps != WIFI_PS_NONE && esp_wifi_set_ps(WIFI_PS_NONE) == ESP_OK)
+            psChanged = true;
+    }
+
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    task = self;
+    savedPriority = uxTaskPriorityGet(self);
+    metrics.priorityBefore = (uint8_t)savedPriority;
+    if (profile.priority >= 0 && (unsigned)profile.priority != savedPriority)
+        vTaskPrioritySet(self, profile.priority);
+    else
+        task = nullptr;   // nothing to restore
+    metrics.priorityDuring = (uint8_t)uxTaskPriorityGet(xTaskGetCurrentTaskHandle());
+
+    metrics.turbo = true;
+    metrics.cpuMhzDuring = (uint16_t)cpuMhz();
+    ESP_LOGI(TAG, "turbo: CPU %u -> %u MHz, Wi-Fi PS %s, priority %u -> %u",
+             metrics.cpuMhzBefore, metrics.cpuMhzDuring,
+             psChanged ? "off" : "unchanged", metrics.priorityBefore,
+             metrics.priorityDuring);
+}
+
+void OtaTurbo::restore() {
+    if (!applied)
+        return;
+    applied = false;
+
+    if (task)
+        vTaskPrioritySet((TaskHandle_t)task, savedPriority);
+    task = nullptr;
+    if (psChanged)
+        esp_wifi_set_ps((wifi_ps_type_t)savedPs);
+    psChanged = false;
+    if (apbLock) {
+        esp_pm_lock_release((esp_pm_lock_handle_t)apbLock);
+        esp_pm_lock_delete((esp_pm_lock_handle_t)apbLock);
+    }
+    if (cpuLock) {
+        esp_pm_lock_release((esp_pm_lock_handle_t)cpuLock);
+        esp_pm_lock_delete((esp_pm_lock_handle_t)cpuLock);
+    }
+    apbLock = cpuLock = nullptr;
+    ESP_LOGI(TAG, "turbo: previous power profile restored");
+}
+
+} // namespace ED_OTA
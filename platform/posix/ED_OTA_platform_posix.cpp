@@ -0,0 +1,541 @@
+#include "ED_OTA_posix.h"
+#include "ED_OTA_core.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <netdb.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#ifdef ED_OTA_HOST_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+namespace ED_OTA {
+
+static const char *TAG = "ED_OTA";
+
+char otaLogLevel = 'I';
+
+static std::atomic<bool> virtualClock{false};
+static std::atomic<int64_t> virtualOffsetUs{0};   // sleeps skipped so far
+
+void otaSetVirtualClock(bool enabled) { virtualClock = enabled; }
+
+int64_t otaNowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + virtualOffsetUs;
+}
+
+void otaSleepUs(uint32_t us) {
+    if (virtualClock) {
+        virtualOffsetUs += us;
+        return;
+    }
+    struct timespec ts = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+bool otaIdleUs(uint32_t &idleUs) {
+    (void)idleUs;
+    return false;   // the host application reports its load instead
+}
+
+void otaLog(char level, const char *tag, const char *fmt, ...) {
+    static const char levels[] = "EWIDV";
+    if (strchr(levels, level) > strchr(levels, otaLogLevel))
+        return;
+    static int64_t startUs = otaNowUs();
+    fprintf(stderr, "%c (%lld) %s: ", level, (long long)((otaNowUs() - startUs) / 1000),
+            tag);
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+// ---------- PosixHttpSource ----------
+
+bool PosixHttpSource::open(const char *url) {
+    close();
+    if (strncmp(url, "http://", 7) == 0)
+        return openHttp(url, false);
+    if (strncmp(url, "https://", 8) == 0)
+        return openHttp(url, true);
+    return openLocal(strncmp(url, "file://", 7) == 0 ? url + 7 : url);
+}
+
+/// @brief a file is served as is, a directory as an HTML listing.
+bool PosixHttpSource::openLocal(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        httpStatus = 404;
+        length = 0;
+        body = LISTING;   // empty body, like a server error page
+        listing.clear();
+        return true;
+    }
+    if (S_ISREG(st.st_mode)) {
+        file = fopen(path, "rb");
+        if (file == nullptr) {
+            OTA_LOGE(TAG, "cannot open %s: %s", path, strerror(errno));
+            return false;
+        }
+        body = FILE_BODY;
+        httpStatus = 200;
+        length = st.st_size;
+        return true;
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == nullptr) {
+        OTA_LOGE(TAG, "cannot list %s: %s", path, strerror(errno));
+        return false;
+    }
+    std::vector<std::string> names;
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.')
+            continue;
+        std::string name = entry->d_name;
+        struct stat est;
+        std::string full = std::string(path) + "/" + name;
+        if (stat(full.c_str(), &est) == 0 && S_ISDIR(est.st_mode))
+            name += "/";
+        names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    listing = "<html>\r\n<head><title>Index of /</title></head>\r\n<body>\r\n"
+              "<h1>Index of /</h1><hr><pre><a href=\"../\">../</a>\r\n";
+    for (const std::string &name : names)
+        listing += "<a href=\"" + name + "\">" + name + "</a>\r\n";
+    listing += "</pre><hr></body>\r\n</html>\r\n";
+    listingPos = 0;
+    body = LISTING;
+    httpStatus = 200;
+    length = (int64_t)listing.size();
+    return true;
+}
+
+bool PosixHttpSource::openHttp(const char *url, bool https) {
+    std::string rest = url + (https ? 8 : 7);
+    size_t slash = rest.find('/');
+    std::string hostPort = rest.substr(0, slash);
+    std::string path = slash == std::string::npos ? "/" : rest.substr(slash);
+    std::string host = hostPort, port = https ? "443" : "80";
+    size_t colon = hostPort.rfind(':');
+    if (colon != std::string::npos) {
+        host = hostPort.substr(0, colon);
+        port = hostPort.substr(colon + 1);
+    }
+
+    struct addrinfo hints = {}, *addrs = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs);
+    if (err != 0) {
+        OTA_LOGE(TAG, "cannot resolve %s: %s", host.c_str(), gai_strerror(err));
+        return false;
+    }
+    for (struct addrinfo *a = addrs; a != nullptr && sock < 0; a = a->ai_next) {
+        sock = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (sock >= 0 && connect(sock, a->ai_addr, a->ai_addrlen) != 0) {
+            ::close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+    if (sock < 0) {
+        OTA_LOGE(TAG, "failed to open client to %s error: %s", url, strerror(errno));
+        return false;
+    }
+    struct timeval tv = {timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (https && !startTls(host)) {
+        close();
+        return false;
+    }
+
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + hostPort +
+                          "\r\nUser-Agent: ED_OTA-host\r\nConnection: close\r\n\r\n";
+    if (!sockSend(request)) {
+        OTA_LOGE(TAG, "failed to send request to %s", url);
+        close();
+        return false;
+    }
+
+    body = IDENTITY;   // rawRead() reads the socket until the body is known
+    std::string line;
+    if (!readLine(line) || sscanf(line.c_str(), "HTTP/%*d.%*d %d", &httpStatus) != 1) {
+        OTA_LOGE(TAG, "Failed to fetch headers from %s", url);
+        close();
+        return false;
+    }
+    bool chunked = false;
+    while (true) {
+        if (!readLine(line)) {
+            OTA_LOGE(TAG, "Failed to fetch headers from %s", url);
+            close();
+            return false;
+        }
+        if (line.empty())
+            break;
+        if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0)
+            length = strtoll(line.c_str() + 15, nullptr, 10);
+        else if (strncasecmp(line.c_str(), "Transfer-Encoding:", 18) == 0 &&
+                 strstr(line.c_str() + 18, "chunked") != nullptr)
+            chunked = true;
+    }
+    if (chunked) {
+        body = CHUNKED;
+        length = -1;
+    } else {
+        bodyLeft = length;
+    }
+    return true;
+}
+
+/// @brief TLS handshake on the connected socket, verifying the server
+/// certificate and host name against caFile or the system store.
+bool PosixHttpSource::startTls(const std::string &host) {
+#ifdef ED_OTA_HOST_TLS
+    static SSL_CTX *sharedCtx = nullptr;
+    static std::string sharedCaFile;
+    if (sharedCtx == nullptr || sharedCaFile != caFile) {
+        SSL_CTX_free(sharedCtx);
+        sharedCtx = SSL_CTX_new(TLS_client_method());
+        sharedCaFile = caFile;
+        SSL_CTX_set_verify(sharedCtx, SSL_VERIFY_PEER, nullptr);
+        if (caFile.empty() ? SSL_CTX_set_default_verify_paths(sharedCtx) != 1
+                           : SSL_CTX_load_verify_locations(sharedCtx, caFile.c_str(), nullptr) != 1) {
+            OTA_LOGE(TAG, "cannot load CA certificates %s", caFile.c_str());
+            SSL_CTX_free(sharedCtx);
+            sharedCtx = nullptr;
+            return false;
+        }
+    }
+    SSL *ssl = SSL_new(sharedCtx);
+    tls = ssl;
+    SSL_set_fd(ssl, sock);
+    SSL_set_tlsext_host_name(ssl, host.c_str());
+    SSL_set1_host(ssl, host.c_str());
+    if (SSL_connect(ssl) != 1) {
+        unsigned long err = ERR_get_error();
+        long verify = SSL_get_verify_result(ssl);
+        OTA_LOGE(TAG, "TLS handshake with %s failed: %s", host.c_str(),
+                 verify != X509_V_OK ? X509_verify_cert_error_string(verify)
+                                     : ERR_reason_error_string(err));
+        return false;
+    }
+    return true;
+#else
+    OTA_LOGE(TAG, "HTTPS needs a host build with OpenSSL: %s", host.c_str());
+    return false;
+#endif
+}
+
+int PosixHttpSource::sockRecv(char *buf, size_t len) {
+#ifdef ED_OTA_HOST_TLS
+    if (tls) {
+        int n = SSL_read((SSL *)tls, buf, (int)len);
+        if (n > 0)
+            return n;
+        int err = SSL_get_error((SSL *)tls, n);
+        return err == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+    }
+#endif
+    return (int)recv(sock, buf, len, 0);
+}
+
+bool PosixHttpSource::sockSend(const std::string &data) {
+#ifdef ED_OTA_HOST_TLS
+    if (tls)
+        return SSL_write((SSL *)tls, data.data(), (int)data.size()) == (int)data.size();
+#endif
+    return send(sock, data.data(), data.size(), MSG_NOSIGNAL) == (ssize_t)data.size();
+}
+
+/// @brief bytes already received past the headers first, then the socket.
+int PosixHttpSource::rawRead(char *buf, size_t len) {
+    if (!pending.empty()) {
+        size_t n = std::min(len, pending.size());
+        memcpy(buf, pending.data(), n);
+        pending.erase(0, n);
+        return (int)n;
+    }
+    int n = sockRecv(buf, len);
+    if (n < 0) {
+        OTA_LOGE(TAG, "HTTP receive failed: %s", strerror(errno));
+        return -1;
+    }
+    return n;
+}
+
+/// @brief reads one CRLF-terminated line, without the terminator.
+bool PosixHttpSource::readLine(std::string &line) {
+    line.clear();
+    while (true) {
+        size_t eol = pending.find("\r\n");
+        if (eol != std::string::npos) {
+            line = pending.substr(0, eol);
+            pending.erase(0, eol + 2);
+            return true;
+        }
+        if (pending.size() > 8192)
+            return false;
+        char buf[1024];
+        int n = sockRecv(buf, sizeof(buf));
+        if (n <= 0)
+            return false;
+        pending.append(buf, n);
+    }
+}
+
+int PosixHttpSource::readChunked(char *buf, size_t len) {
+    if (chunkLeft == 0) {
+        std::string line;
+        if (chunkStarted && (!readLine(line) || !line.empty()))
+            return -1;   // chunk data not followed by CRLF
+        if (!readLine(line))
+            return -1;
+        chunkStarted = true;
+        chunkLeft = strtoll(line.c_str(), nullptr, 16);
+        if (chunkLeft == 0) {
+            while (readLine(line) && !line.empty()) {   // trailer
+            }
+            bodyDone = true;
+            return 0;
+        }
+    }
+    int n = rawRead(buf, (size_t)std::min<int64_t>(len, chunkLeft));
+    if (n == 0)
+        return -1;   // connection closed inside a chunk
+    if (n > 0)
+        chunkLeft -= n;
+    return n;
+}
+
+int PosixHttpSource::read(char *buf, size_t len) {
+    if (len == 0)
+        return 0;
+    switch (body) {
+        case FILE_BODY: {
+            size_t n = fread(buf, 1, len, file);
+            return n == 0 && ferror(file) ? -1 : (int)n;
+        }
+        case LISTING: {
+            size_t n = std::min(len, listing.size() - listingPos);
+            memcpy(buf, listing.data() + listingPos, n);
+            listingPos += n;
+            return (int)n;
+        }
+        case IDENTITY: {
+            if (bodyLeft == 0)
+                return 0;
+            if (bodyLeft > 0 && (int64_t)len > bodyLeft)
+                len = (size_t)bodyLeft;
+            int n = rawRead(buf, len);
+            if (n > 0 && bodyLeft > 0)
+                bodyLeft -= n;
+            else if (n == 0 && bodyLeft > 0)
+                return -1;   // connection closed before Content-Length bytes
+            return n;
+        }
+        case CHUNKED:
+            return bodyDone ? 0 : readChunked(buf, len);
+        default:
+            return -1;
+    }
+}
+
+void PosixHttpSource::close() {
+    if (file)
+        fclose(file);
+    file = nullptr;
+#ifdef ED_OTA_HOST_TLS
+    if (tls) {
+        SSL_shutdown((SSL *)tls);
+        SSL_free((SSL *)tls);
+    }
+#endif
+    tls = nullptr;
+    if (sock >= 0)
+        ::close(sock);
+    sock = -1;
+    body = NONE;
+    httpStatus = 0;
+    length = -1;
+    listing.clear();
+    listingPos = 0;
+    pending.clear();
+    bodyLeft = -1;
+    chunkLeft = 0;
+    chunkStarted = bodyDone = false;
+}
+
+// ---------- FileSink ----------
+
+/// @brief SHA-256 over the first len bytes of a file; false when shorter.
+static bool fileDigest(const std::string &path, size_t len, uint8_t out[OTA_DIGEST_SIZE]) {
+    FILE *f = path.empty() ? nullptr : fopen(path.c_str(), "rb");
+    if (f == nullptr)
+        return false;
+    OtaSha256 sha;
+    uint8_t buf[4096];
+    size_t left = len;
+    while (left > 0) {
+        size_t n = fread(buf, 1, left < sizeof(buf) ? left : sizeof(buf), f);
+        if (n == 0)
+            break;
+        sha.update(buf, n);
+        left -= n;
+    }
+    fclose(f);
+    sha.finish(out);
+    return left == 0;
+}
+
+OtaSink::Held FileSink::holds(const uint8_t *digest, size_t imageSize) {
+    uint8_t d[OTA_DIGEST_SIZE];
+    if (fileDigest(running, imageSize, d) && memcmp(d, digest, OTA_DIGEST_SIZE) == 0)
+        return HELD_RUNNING;
+    if (fileDigest(target, imageSize, d) && memcmp(d, digest, OTA_DIGEST_SIZE) == 0)
+        return HELD_STAGED;
+    return HELD_NONE;
+}
+
+bool FileSink::begin(bool sequentialErase) {
+    (void)sequentialErase;
+    abort();
+    out = fopen((target + ".part").c_str(), "wb");
+    if (out == nullptr) {
+        OTA_LOGE(TAG, "Failed to begin OTA: %s: %s", target.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool FileSink::write(const uint8_t *data, size_t len) {
+    if (fwrite(data, 1, len, out) != len) {
+        OTA_LOGE(TAG, "Failed to write OTA chunk: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool FileSink::finish() {
+    bool ok = fclose(out) == 0;
+    out = nullptr;
+    std::string part = target + ".part";
+    if (!ok || rename(part.c_str(), target.c_str()) != 0) {
+        OTA_LOGE(TAG, "Failed to complete OTA: %s: %s", target.c_str(), strerror(errno));
+        remove(part.c_str());
+        return false;
+    }
+    return true;
+}
+
+void FileSink::abort() {
+    if (out == nullptr)
+        return;
+    fclose(out);
+    out = nullptr;
+    remove((target + ".part").c_str());
+}
+
+// ---------- OtaSha256 ----------
+
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t ror(uint32_t x, int n) { return x >> n | x << (32 - n); }
+
+OtaSha256::OtaSha256()
+    : state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab,
+            0x5be0cd19} {}
+
+void OtaSha256::transform(const uint8_t *chunk) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)chunk[4 * i] << 24 | chunk[4 * i + 1] << 16 | chunk[4 * i + 2] << 8 |
+               chunk[4 * i + 3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ w[i - 15] >> 3;
+        uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ w[i - 2] >> 10;
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) +
+                      sha256K[i] + w[i];
+        uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void OtaSha256::update(const uint8_t *data, size_t len) {
+    size_t used = length % 64;
+    length += len;
+    if (used) {
+        size_t n = std::min(len, 64 - used);
+        memcpy(block + used, data, n);
+        data += n;
+        len -= n;
+        if (used + n < 64)
+            return;
+        transform(block);
+    }
+    for (; len >= 64; data += 64, len -= 64)
+        transform(data);
+    memcpy(block, data, len);
+}
+
+void OtaSha256::finish(uint8_t digest[32]) {
+    uint64_t bits = length * 8;
+    uint8_t pad[72] = {0x80};
+    size_t padLen = (length % 64 < 56 ? 56 : 120) - length % 64;
+    for (int i = 0; i < 8; i++)
+        pad[padLen + i] = (uint8_t)(bits >> (56 - 8 * i));
+    update(pad, padLen + 8);
+    for (int i = 0; i < 8; i++)
+        for (int j = 0; j < 4; j++)
+            digest[4 * i + j] = (uint8_t)(state[i] >> (24 - 8 * j));
+}
+
+} // namespace ED_OTA
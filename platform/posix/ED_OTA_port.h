@@ -0,0 +1,66 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_port.h
+ * @brief POSIX port of the OTA engine: logging, locking and hashing
+ * primitives.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-14
+ */
+// #endregion
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_LOGE(tag, ...) ED_OTA::otaLog('E', tag, __VA_ARGS__)
+#define OTA_LOGW(tag, ...) ED_OTA::otaLog('W', tag, __VA_ARGS__)
+#define OTA_LOGI(tag, ...) ED_OTA::otaLog('I', tag, __VA_ARGS__)
+#define OTA_LOGD(tag, ...) ED_OTA::otaLog('D', tag, __VA_ARGS__)
+#define OTA_LOGV(tag, ...) ED_OTA::otaLog('V', tag, __VA_ARGS__)
+
+namespace ED_OTA {
+
+/// @brief most verbose level printed by otaLog: one of "EWIDV", default 'I'.
+extern char otaLogLevel;
+/// @brief prints one log line to stderr, ESP_LOGx style.
+void otaLog(char level, const char *tag, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+/// @brief virtual clock: otaSleepUs() advances otaNowUs() instead of
+/// sleeping, so waits cost no wall time while computation still counts.
+void otaSetVirtualClock(bool enabled);
+
+class OtaMutex {
+public:
+  OtaMutex() { pthread_mutex_init(&mutex, nullptr); }
+  ~OtaMutex() { pthread_mutex_destroy(&mutex); }
+  void lock() { pthread_mutex_lock(&mutex); }
+  void unlock() { pthread_mutex_unlock(&mutex); }
+
+private:
+  pthread_mutex_t mutex;
+  OtaMutex(const OtaMutex &) = delete;
+  OtaMutex &operator=(const OtaMutex &) = delete;
+};
+
+/// @brief SHA-256 (FIPS 180-4), self-contained so the host build needs no
+/// crypto library.
+class OtaSha256 {
+public:
+  OtaSha256();
+  void update(const uint8_t *data, size_t len);
+  void finish(uint8_t digest[32]);
+
+private:
+  uint32_t state[8];
+  uint64_t length = 0;  // bytes hashed so far
+  uint8_t block[64];
+  void transform(const uint8_t *chunk);
+  OtaSha256(const OtaSha256 &) = delete;
+  OtaSha256 &operator=(const OtaSha256 &) = delete;
+};
+
+} // namespace ED_OTA
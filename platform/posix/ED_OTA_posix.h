@@ -0,0 +1,108 @@
+// #region StdManifest
+/**
+ * @file ED_OTA_posix.h
+ * @brief POSIX HTTP source (plain HTTP or a local directory) and image file
+ * sink, to run the OTA engine on a workstation.
+ *
+ * @author Emanuele Dolis (edoliscom@gmail.com)
+ * @version 0.1
+ * @date 2025-10-14
+ */
+// #endregion
+
+#pragma once
+
+#include "ED_OTA_platform.h"
+#include <stdio.h>
+#include <string>
+
+namespace ED_OTA {
+
+/**
+ * @brief GET over HTTP/1.1 (Content-Length or chunked bodies, HTTPS when
+ * built with OpenSSL), or from the local file system when the URL is a path
+ * or a file:// URL.
+ *
+ * A local directory is served as an autoindex-style HTML listing, so the
+ * scanner sees what it gets from the firmware server.
+ */
+class PosixHttpSource : public HttpSource {
+public:
+  PosixHttpSource() {}
+  ~PosixHttpSource() { close(); }
+  PosixHttpSource(const PosixHttpSource &) = delete;
+  PosixHttpSource &operator=(const PosixHttpSource &) = delete;
+
+  bool open(const char *url) override;
+  int status() override { return httpStatus; }
+  int64_t contentLength() override { return length; }
+  int read(char *buf, size_t len) override;
+  void close() override;
+
+  /// @brief receive timeout of the socket, in milliseconds.
+  void setTimeout(int ms) { timeoutMs = ms; }
+  /// @brief PEM bundle that verifies HTTPS servers (default: system store).
+  void setCaFile(const char *path) { caFile = path ? path : ""; }
+
+private:
+  enum Body { NONE, FILE_BODY, LISTING, IDENTITY, CHUNKED };
+
+  Body body = NONE;
+  int httpStatus = 0;
+  int64_t length = -1;
+  int timeoutMs = 10000;
+  std::string caFile;
+
+  FILE *file = nullptr;    // FILE_BODY
+  std::string listing;     // LISTING
+  size_t listingPos = 0;
+
+  int sock = -1;           // IDENTITY, CHUNKED
+  void *tls = nullptr;     // SSL session on sock, https:// only
+  std::string pending;     // bytes received past the headers
+  int64_t bodyLeft = -1;   // IDENTITY: -1 until the connection closes
+  int64_t chunkLeft = 0;   // CHUNKED: bytes left in the current chunk
+  bool chunkStarted = false;
+  bool bodyDone = false;
+
+  bool openLocal(const char *path);
+  bool openHttp(const char *url, bool https);
+  bool startTls(const std::string &host);
+  int sockRecv(char *buf, size_t len);
+  bool sockSend(const std::string &data);
+  int rawRead(char *buf, size_t len);
+  bool readLine(std::string &line);
+  int readChunked(char *buf, size_t len);
+};
+
+/// @brief writes the decoded image to a file: path.part while receiving,
+/// renamed to path when finished.
+class FileSink : public OtaSink {
+public:
+  explicit FileSink(const char *path) : target(path) {}
+  ~FileSink() { abort(); }
+  FileSink(const FileSink &) = delete;
+  FileSink &operator=(const FileSink &) = delete;
+
+  /// @brief RUNNING when the running image file starts with the image,
+  /// STAGED when the image file does.
+  Held holds(const uint8_t *digest, size_t imageSize) override;
+  /// @brief the staged image file is already in place.
+  bool activate() override { return true; }
+  bool begin(bool sequentialErase) override;
+  bool write(const uint8_t *data, size_t len) override;
+  bool finish() override;
+  void abort() override;
+
+  /// @brief changes the image file; only before begin().
+  void setPath(const char *path) { target = path; }
+  /// @brief the image standing for the running app in holds().
+  void setRunning(const char *path) { running = path ? path : ""; }
+
+private:
+  std::string target;
+  std::string running;
+  FILE *out = nullptr;
+};
+
+} // namespace ED_OTA
@@ -0,0 +1,24 @@
+#include "ED_OTA_platform.h"
+#include "ED_OTA_session.h"
+#include "ED_OTA_turbo.h"
+
+namespace ED_OTA {
+
+static const char *TAG = "ED_OTA";
+
+uint32_t OtaTurbo::cpuMhz() { return 0; }
+
+/// @brief clocks, radio and scheduling are left to the host OS: the session
+/// runs as if turbo had not been requested.
+void OtaTurbo::apply(const TurboProfile &profile, OtaMetrics &metrics) {
+    (void)profile;
+    (void)metrics;
+    if (applied)
+        return;
+    applied = true;
+    OTA_LOGI(TAG, "turbo: not available on this platform, ignored");
+}
+
+void OtaTurbo::restore() { applied = false; }
+
+} // namespace ED_OTA